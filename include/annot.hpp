@@ -1,14 +1,141 @@
 #pragma once
 
+#include <array>
 #include <iostream>
 
+#include "exif.hpp"
+#include "ibox.hpp"
+#include "utils.hpp"
+
 namespace fdt {
 
     namespace annot {
 
+        // Resolution of the COCO dataset, to which box areas are scaled; the
+        // small / medium / large areas are split at 32^2 and 96^2 there
+        inline constexpr float kCocoWidth = 640.0f;
+        inline constexpr float kCocoHeight = 480.0f;
+        inline constexpr float kCocoMedium = 32.0f * 32.0f;
+        inline constexpr float kCocoLarge = 96.0f * 96.0f;
+
+        // Engines joining annotations to images; both assign the same ids
+        enum class Backend {
+            SQLITE, // SQL statements on an in-memory database
+            NATIVE, // sort and hash join in memory
+        };
+
+        // Assignment of images to the train / val / test splits
+        enum class SplitBy {
+            NONE,   // a single split
+            HASH,   // by a hash of "<prefix>/<image>"
+            PREFIX, // by a hash of the prefix, keeping a survey in one split
+        };
+
+        struct CocoOpts {
+            Backend backend = Backend::SQLITE;
+            bool compact = false; // JSON without indentation
+            SplitBy split_by = SplitBy::NONE;
+            // train / val / test weights of the split
+            std::array<unsigned, 3> split = {80, 10, 10};
+            unsigned shards = 1; // files per split
+            // Root of "<prefix>/<image>" files whose frame header gives the
+            // size of annotated images without EXIF rows; empty to drop them
+            std::string img_root = {};
+        };
+
         void print(const std::string &, const std::string &);
 
-        void toCoco(const std::string &, const std::string &, std::ostream &);
+        // Pavement distress statistics of the annotations joined to their
+        // images, as a JSON document: counts, area sums and log2 histograms
+        // of box areas, in image pixels and scaled as by `toCoco`, in total
+        // and by category, level, prefix and capture date, plus the levels
+        // of each category. Rows are aggregated in parallel.
+        //
+        // @param dir_exif: as for `toCoco`
+        void stats(const std::string &dir_annot, const std::string &dir_exif,
+                   std::ostream &);
+
+        // Records are streamed to the output as they are read, so with the
+        // SQLite backend memory does not depend on the number of annotations.
+        // Splits and shards need `toCocoFiles`.
+        //
+        // @param dir_exif: directory of EXIF TSV / columnar files, or an
+        //                  SQLite file written by `exportExifDb`
+        void toCoco(const std::string &, const std::string &dir_exif,
+                    std::ostream &, const CocoOpts & = {});
+
+        // Export to one file per split and shard, each serialised on its own
+        // thread, named "<stem>[.train|.val|.test][.<k>-of-<n>]<ext>" after
+        // `path`. An image and its annotations go to the file picked by a
+        // stable hash of its key, so the same input always gives the same
+        // files; every file has all categories. Ids and areas are those of
+        // the single-file export.
+        //
+        // @return: paths of the files written, in split then shard order
+        Paths toCocoFiles(const std::string &, const std::string &dir_exif,
+                          const std::string &path, const CocoOpts & = {});
+
+        // Load annotation and EXIF TSVs, and columnar EXIF files, into an
+        // annotation database file, created if needed. The rows of each
+        // prefix found in the new files replace the existing rows of that
+        // prefix, or are added to them if `append`; other prefixes are left
+        // alone. Rows are indexed by (prefix, image) and category.
+        //
+        // @param dir_annot, dir_exif: directories to load; empty to skip
+        void updateDb(const std::string &db_file, const std::string &dir_annot,
+                      const std::string &dir_exif, bool append = false);
+
+        // Export an annotation database written by `updateDb` as `toCoco`
+        // would export the files it was loaded from.
+        void dbToCoco(const std::string &db_file, std::ostream &,
+                      const CocoOpts & = {});
+
+        // Export an annotation database as `toCocoFiles` would
+        Paths dbToCocoFiles(const std::string &db_file, const std::string &path,
+                            const CocoOpts & = {});
+
+        struct EvalOpts {
+            // resolution of the images, which scales the box areas
+            int img_width = 5568;
+            int img_height = 4872;
+            unsigned threads = 0; // 0 for the hardware concurrency
+        };
+
+        // COCO detection metrics in the order of `COCOeval.stats` of
+        // pycocotools: AP @[.50:.95], AP @.50, AP @.75, AP of small, medium
+        // and large boxes, AR with 1, 10 and 100 detections per image, AR of
+        // small, medium and large boxes; -1 where there is no ground truth.
+        using EvalStats = std::array<double, 12>;
+
+        struct EvalResult {
+            EvalStats all;
+            // fault types with ground truth, in the order of `ibox::Fault`
+            std::vector<std::pair<std::string, EvalStats>> categories;
+            uint64_t skipped = 0; // detections of images without labels
+        };
+
+        // Score detections against ground truth per fault type as
+        // pycocotools' COCOeval does for bounding boxes, images being matched
+        // by name; a box with several fault types counts for each of them.
+        // IoU matrices are computed per image and category, and images are
+        // evaluated in parallel.
+        //
+        // Only images with ground truth boxes are evaluated: detections of
+        // other images, including labelled images without regions, are
+        // skipped rather than counted as false positives, and reported.
+        EvalResult evaluate(const std::vector<ibox::ImgBox> &gt,
+                            const std::vector<ibox::ImgBox> &dt,
+                            const EvalOpts & = {});
+
+        // Print the metrics as `COCOeval.summarize` does, then AP and AR by
+        // category
+        void printEval(const EvalResult &, std::ostream &);
+
+        // Decode the EXIF of the images under a directory straight into the
+        // `images` table of a new SQLite file, in the schema used by
+        // `toCoco`; the prefix of an image is the name of its directory.
+        void exportExifDb(const std::string &dir, const std::string &db_file,
+                          const exif::ExportOpts & = {});
 
     } // namespace annot
 
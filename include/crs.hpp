@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cmath>
+#include <span>
 #include <tuple>
 
 #define DEG2RAD(deg) ((deg) * M_PI / 180)
@@ -12,6 +13,14 @@ namespace fdt {
     namespace crs {
         std::tuple<double, double> ToNzgd2000(const double, const double);
 
+        // Batch conversion of latitudes / longitudes into eastings /
+        // northings; all spans must be of the same size. Out-of-range or NaN
+        // inputs give NaN outputs instead of throwing, so that missing
+        // positions can be passed through.
+        void ToNzgd2000(std::span<const double> lat,
+                        std::span<const double> lon, std::span<double> east,
+                        std::span<double> north);
+
         std::tuple<double, double> FromNzgd2000(const double, const double);
     } // namespace crs
 
@@ -1,8 +1,18 @@
 #pragma once
 
+#include <array>
 #include <exiv2/exiv2.hpp>
+#include <functional>
+#include <limits>
 #include <nlohmann/json.hpp>
 #include <optional>
+#include <span>
+#include <unordered_map>
+
+#include "utils.hpp"
+
+struct sqlite3;
+struct sqlite3_stmt;
 
 namespace fdt {
     namespace exif {
@@ -13,6 +23,71 @@ namespace fdt {
         using OptInt = std::optional<int>;
         using OptTm = std::optional<std::tm>;
 
+        // EXIF decoders
+        enum class Backend : uint8_t {
+            AUTO,   // native decoder, falling back to Exiv2 on failure
+            NATIVE, // native APP1 / TIFF decoder only
+            EXIV2,  // Exiv2 only
+        };
+
+        // Attributes selectable for export, in their column order; see
+        // `parseFields` for their names.
+        enum class Field : uint32_t {
+            NONE = 0,
+            PATH = 1 << 0,
+            HEIGHT = 1 << 1,
+            WIDTH = 1 << 2,
+            ALTITUDE = 1 << 3,
+            TS_GPS = 1 << 4,
+            LAT = 1 << 5,
+            LON = 1 << 6,
+            EASTING = 1 << 7,  // NZGD2000, from lat / lon
+            NORTHING = 1 << 8, // NZGD2000, from lat / lon
+            EXIF_VER = 1 << 9,
+            DESC = 1 << 10,
+            MODEL = 1 << 11,
+            COC = 1 << 12, // from model
+            SUBJ_DIST = 1 << 13,
+            ISO = 1 << 14,
+            APERTURE = 1 << 15,
+            SHUTTER_SPEED = 1 << 16,
+            EXPOSURE_TIME = 1 << 17,
+            FOCAL_LENGTH = 1 << 18,
+            HYPERFOCAL_DIST = 1 << 19, // from focal length, aperture and coc
+            ALL = (1 << 20) - 1,
+        };
+
+        inline constexpr Field operator|(Field lhs, Field rhs) {
+            return static_cast<Field>(static_cast<uint32_t>(lhs) |
+                                      static_cast<uint32_t>(rhs));
+        }
+
+        inline constexpr Field operator&(Field lhs, Field rhs) {
+            return static_cast<Field>(static_cast<uint32_t>(lhs) &
+                                      static_cast<uint32_t>(rhs));
+        }
+
+        // Whether any of `f` is in `fields`
+        inline constexpr bool hasField(Field fields, Field f) {
+            return (fields & f) != Field::NONE;
+        }
+
+        // Default columns of the CSV and JSON exporters
+        inline constexpr Field kCsvFields =
+            Field::PATH | Field::HEIGHT | Field::WIDTH | Field::ALTITUDE |
+            Field::TS_GPS | Field::LAT | Field::LON | Field::EASTING |
+            Field::NORTHING;
+        inline constexpr Field kJsonFields =
+            Field::PATH | Field::EXIF_VER | Field::DESC | Field::MODEL |
+            Field::HEIGHT | Field::WIDTH | Field::LAT | Field::LON |
+            Field::ALTITUDE | Field::TS_GPS;
+
+        // Parse a comma-separated list of field names, e.g. "path,lat,lon".
+        // Both the JSON keys and the CSV column names are accepted.
+        //
+        // @throws std::runtime_error on an unknown name
+        Field parseFields(const std::string &);
+
         // This structure holds the desired EXIF attributes.
         struct Attrs {
             std::string path;
@@ -48,21 +123,224 @@ namespace fdt {
                   exposure_time(std::nullopt), focal_length(std::nullopt),
                   hyperfocal_dist(std::nullopt) {}
 
-            // constructor based on GetAttrs function
-            Attrs(const std::string &path);
+            // constructor based on GetAttrs function; only the tags needed
+            // by `fields` are decoded, the other attributes stay empty
+            Attrs(const std::string &path, Backend backend = Backend::AUTO,
+                  Field fields = Field::ALL);
 
-            nlohmann::json ToJson() const;
+            nlohmann::json ToJson(Field fields = kJsonFields) const;
 
-            void ToCsv(std::ostream &) const;
+            // Tab-separated row of `fields`, without a line break
+            void ToCsv(std::ostream &, Field fields = kCsvFields) const;
 
             void Print() const;
 
             static void ListAll(const std::string &path);
         };
 
-        void exportCsv(const std::string &, std::ostream &);
+        // Size and modification time of a file; a cached entry is only
+        // valid while both are unchanged.
+        struct FileStamp {
+            int64_t size = -1;
+            int64_t mtime = 0; // in ticks of the filesystem clock
+
+            bool operator==(const FileStamp &) const = default;
+
+            // Stamp of a file; `size` is -1 if the file cannot be stat'ed
+            static FileStamp Of(const std::string &path);
+        };
+
+        // Persistent cache of decoded attributes in an SQLite file, keyed by
+        // absolute path, size and mtime. Usage per export:
+        //
+        // 1. `Load` the entries under the exported directory
+        // 2. `Find` unchanged files (thread-safe) and `Put` decoded ones
+        // 3. `Commit` to prune deleted files and persist the new entries
+        class Cache {
+          public:
+            explicit Cache(const std::string &path);
+            ~Cache();
+
+            Cache(const Cache &) = delete;
+            Cache &operator=(const Cache &) = delete;
+
+            // Read the entries of the images under a directory into memory
+            // and start the write transaction.
+            void Load(const std::string &dir);
+
+            // Cached attributes of an image, or nullptr if it is unknown or
+            // its stamp has changed; `path` of the result is not set.
+            const Attrs *Find(const std::string &path,
+                              const FileStamp &stamp) const;
+
+            // Insert or replace the entry of a decoded image
+            void Put(const Attrs &attrs, const FileStamp &stamp);
+
+            // Delete the loaded entries that are not in `paths`, i.e. images
+            // removed from the directory, and commit.
+            void Commit(const std::vector<std::string> &paths);
+
+          private:
+            sqlite3 *db_;
+            sqlite3_stmt *stmt_put_;
+            // absolute path -> (stamp, attributes) of the loaded entries
+            std::unordered_map<std::string, std::pair<FileStamp, Attrs>>
+                entries_;
+        };
+
+        // Options shared by the exporters
+        struct ExportOpts {
+            unsigned threads = 0;   // worker threads; 0 = hardware concurrency
+            std::string cache = {}; // SQLite cache file; empty = no cache
+            bool ndjson = false;    // JSON: one record per line, no array
+            Field fields = Field::NONE; // columns; NONE = exporter default
+        };
+
+        void exportCsv(const std::string &, std::ostream &,
+                       const ExportOpts & = {});
+
+        // Decode the images under a directory in parallel and pass them to
+        // `sink` chunk by chunk, in path order. `opts` applies as for the
+        // exporters, except that `fields` defaults to all attributes.
+        void scan(const std::string &dir, const ExportOpts &opts,
+                  const std::function<void(std::span<const Attrs>)> &sink);
+
+        // JPEG thumbnail embedded in IFD1 of an image
+        struct Thumb {
+            std::string path;
+            std::vector<uint8_t> jpeg; // empty if the image has none
+        };
+
+        // Read the embedded thumbnail of an image; only the EXIF segment is
+        // read and the main image is never decoded.
+        //
+        // @return: the thumbnail JPEG stream; empty if the image has none
+        std::vector<uint8_t> readThumb(const std::string &path);
+
+        // Read the thumbnails of the images under a directory in parallel and
+        // pass them to `sink` chunk by chunk, in path order. Only
+        // `opts.threads` applies.
+        void
+        scanThumbs(const std::string &dir, const ExportOpts &opts,
+                   const std::function<void(std::span<const Thumb>)> &sink);
+
+        // Write the thumbnails of the images under `dir` to `out_dir`, keeping
+        // their paths relative to `dir`; images without one are skipped.
+        //
+        // @return: number of thumbnails written
+        size_t exportThumbs(const std::string &dir, const std::string &out_dir,
+                            const ExportOpts &opts = {});
+
+        // Columnar EXIF file (.fdtc): a header, a table of column descriptors
+        // and the column data, each column 8-byte aligned and little-endian,
+        // so that a memory-mapped file can be scanned column by column.
+        //
+        // Columns, all of `n_rows` values unless noted:
+        // - dir (U32): index into dir_dict of the image's directory
+        // - dir_dict (STR): distinct directories, `count` strings
+        // - name (STR): file name of the image
+        // - height, width (I32): kNullI32 if missing
+        // - timestamp (I64): GPS time in seconds since the epoch (UTC);
+        //   kNullI64 if missing
+        // - altitude, lat, lon, easting, northing (F64): NaN if missing
+        //
+        // A STR column holds `count + 1` U64 offsets into the string bytes
+        // that follow them.
+        namespace fdtc {
+
+            inline constexpr std::array<char, 4> kMagic = {'F', 'D', 'T', 'C'};
+            inline constexpr uint32_t kVersion = 1;
+
+            inline constexpr int32_t kNullI32 =
+                std::numeric_limits<int32_t>::min();
+            inline constexpr int64_t kNullI64 =
+                std::numeric_limits<int64_t>::min();
+
+            enum class Type : uint32_t { I32, I64, F64, U32, STR };
+
+            struct Header {
+                std::array<char, 4> magic;
+                uint32_t version;
+                uint64_t n_rows;
+                uint32_t n_cols;
+                uint32_t reserved;
+            };
+
+            struct ColumnDesc {
+                std::array<char, 16> name; // NUL-padded
+                Type type;
+                uint32_t reserved;
+                uint64_t count;  // number of values
+                uint64_t offset; // from the start of the file
+                uint64_t size;   // in bytes
+            };
+
+            static_assert(sizeof(Header) == 24);
+            static_assert(sizeof(ColumnDesc) == 48);
+
+            template <typename T> inline constexpr Type typeOf();
+            template <> inline constexpr Type typeOf<int32_t>() {
+                return Type::I32;
+            }
+            template <> inline constexpr Type typeOf<int64_t>() {
+                return Type::I64;
+            }
+            template <> inline constexpr Type typeOf<double>() {
+                return Type::F64;
+            }
+            template <> inline constexpr Type typeOf<uint32_t>() {
+                return Type::U32;
+            }
+
+        } // namespace fdtc
+
+        // Write the EXIF attributes of the images under a directory as a
+        // columnar file; the file must be seekable as every column is filled
+        // in place, one chunk of images at a time.
+        void exportColumnar(const std::string &dir, const std::string &path,
+                            const ExportOpts & = {});
+
+        // Reader of a columnar EXIF file, mapped into memory
+        class ColumnarReader {
+          public:
+            // @throws std::runtime_error if the file is not a valid .fdtc
+            explicit ColumnarReader(const std::string &path);
+
+            size_t Size() const { return n_rows_; }
+
+            // Directory of the i-th image
+            std::string_view Dir(size_t i) const;
+
+            // File name of the i-th image
+            std::string_view Name(size_t i) const;
+
+            // Values of a fixed-width column
+            // @throws std::runtime_error if there is no such column of type T
+            template <typename T>
+            std::span<const T> Column(std::string_view name) const {
+                const fdtc::ColumnDesc &desc = find(name, fdtc::typeOf<T>());
+                return {reinterpret_cast<const T *>(file_.data() + desc.offset),
+                        desc.count};
+            }
+
+          private:
+            const fdtc::ColumnDesc &find(std::string_view name,
+                                         fdtc::Type type) const;
+
+            // i-th string of a STR column
+            std::string_view str(const fdtc::ColumnDesc &desc,
+                                 size_t i) const;
+
+            utils::MappedFile file_;
+            size_t n_rows_;
+            std::span<const fdtc::ColumnDesc> cols_;
+            std::span<const uint32_t> dir_;
+            const fdtc::ColumnDesc *dir_dict_;
+            const fdtc::ColumnDesc *name_;
+        };
 
-        void exportJson(const std::string &, std::ostream &);
+        void exportJson(const std::string &, std::ostream &,
+                        const ExportOpts & = {});
 
     } // namespace exif
 } // namespace fdt
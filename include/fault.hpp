@@ -0,0 +1,193 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+namespace fdt {
+    namespace ibox {
+
+        // Define the Fault enum class with bitmask values
+        enum class Fault : uint16_t {
+            NONE = 0,
+            BUMP_FAIR = 0b01 << 0,
+            BUMP_POOR = 0b10 << 0,
+            BUMP_VPOOR = 0b11 << 0,
+            CRACK_FAIR = 0b01 << 2,
+            CRACK_POOR = 0b10 << 2,
+            CRACK_VPOOR = 0b11 << 2,
+            DEPRESSION_FAIR = 0b01 << 4,
+            DEPRESSION_POOR = 0b10 << 4,
+            DEPRESSION_VPOOR = 0b11 << 4,
+            DISPLACEMENT_FAIR = 0b01 << 6,
+            DISPLACEMENT_POOR = 0b10 << 6,
+            DISPLACEMENT_VPOOR = 0b11 << 6,
+            POTHOLE_FAIR = 0b01 << 8,
+            POTHOLE_POOR = 0b10 << 8,
+            POTHOLE_VPOOR = 0b11 << 8,
+            UNEVEN_FAIR = 0b01 << 10,
+            UNEVEN_POOR = 0b10 << 10,
+            UNEVEN_VPOOR = 0b11 << 10,
+            VEGETATION_FAIR = 0b01 << 12,
+            VEGETATION_POOR = 0b10 << 12,
+            VEGETATION_VPOOR = 0b11 << 12,
+            PADDING_FAIR = 0b01 << 14,
+            PADDING_POOR = 0b10 << 14,
+            PADDING_VPOOR = 0b11 << 14,
+        };
+
+        // Define bitwise OR operator for Fault enum class
+        inline constexpr Fault operator|(Fault lhs, Fault rhs) {
+            return static_cast<Fault>(static_cast<uint16_t>(lhs) |
+                                      static_cast<uint16_t>(rhs));
+        }
+
+        // Define bitwise OR assignment operator for Fault enum class
+        inline constexpr Fault &operator|=(Fault &lhs, Fault rhs) {
+            lhs = lhs | rhs;
+            return lhs;
+        }
+
+        // Define bitwise AND operator for Fault enum class
+        inline constexpr Fault operator&(Fault lhs, Fault rhs) {
+            return static_cast<Fault>(static_cast<uint16_t>(lhs) &
+                                      static_cast<uint16_t>(rhs));
+        }
+
+        // Fault codec. A fault packs the level of each type in two bits,
+        // type `t` (0 for "bump") at bits 2t and 2t + 1; levels are 0 (none)
+        // to 3 ("verypoor"). Names decode without exceptions: an unknown
+        // type is `kNFaultType`, an unknown level 0.
+
+        inline constexpr uint8_t kNFaultType = 7;
+        inline constexpr uint8_t kNFaultLevel = 3;
+
+        namespace detail {
+            // Bits of the level types, all lanes but the padding
+            inline constexpr uint16_t kLanes = 0x3FFF;
+            inline constexpr uint16_t kLaneLo = 0x1555; // low bit of a lane
+            inline constexpr uint16_t kLaneHi = 0x2AAA; // high bit of a lane
+
+            inline constexpr std::string_view kTypeStr[kNFaultType + 1] = {
+                "bump",    "crack",  "depression", "displacement",
+                "pothole", "uneven", "vegetation", ""};
+
+            inline constexpr std::string_view kLevelStr[kNFaultLevel + 1] = {
+                "", "fair", "poor", "verypoor"};
+        } // namespace detail
+
+        // Level of fault type `type`
+        inline constexpr uint8_t faultLevel(const Fault f, const uint8_t type) {
+            return (static_cast<uint16_t>(f) >> (type * 2)) & 0b11;
+        }
+
+        // Name of a fault type, empty if out of range
+        inline constexpr std::string_view faultTypeStr(const uint8_t type) {
+            return detail::kTypeStr[type < kNFaultType ? type : kNFaultType];
+        }
+
+        // Name of a level, empty if none or out of range
+        inline constexpr std::string_view faultLevelStr(const uint8_t level) {
+            return detail::kLevelStr[level <= kNFaultLevel ? level : 0];
+        }
+
+        // Fault type of a name, `kNFaultType` if unknown. The length tells
+        // the names apart but for "depression" and "vegetation", so a name
+        // is compared with one candidate at most.
+        inline constexpr uint8_t faultTypeOf(const std::string_view str) {
+            uint8_t type = kNFaultType;
+            switch (str.size()) {
+            case 4:
+                type = 0;
+                break;
+            case 5:
+                type = 1;
+                break;
+            case 10:
+                type = str[0] == 'd' ? 2 : 6;
+                break;
+            case 12:
+                type = 3;
+                break;
+            case 7:
+                type = 4;
+                break;
+            case 6:
+                type = 5;
+                break;
+            }
+            return str == faultTypeStr(type) ? type : kNFaultType;
+        }
+
+        // Level of a name, 0 if unknown
+        inline constexpr uint8_t faultLevelOf(const std::string_view str) {
+            const uint8_t kLevel = str.size() == 8   ? 3
+                                   : str.size() != 4 ? 0
+                                   : str[0] == 'p'   ? 2
+                                                     : 1;
+            return str == faultLevelStr(kLevel) ? kLevel : 0;
+        }
+
+        // Fault with level `level` for each type `t` of which bit t of
+        // `types` is set: the bits are spread to lanes, then scaled
+        inline constexpr Fault faultOf(const uint8_t types,
+                                       const uint8_t level) {
+            uint16_t lanes = types & 0x7F;
+            lanes = (lanes | lanes << 4) & 0x0F0F;
+            lanes = (lanes | lanes << 2) & 0x3333;
+            lanes = (lanes | lanes << 1) & 0x5555;
+            return static_cast<Fault>(lanes * (level & 0b11));
+        }
+
+        // Type-wise maximum level of two faults, all types at once: a lane
+        // of `lhs` is taken where its high bit beats that of `rhs`, or the
+        // high bits tie and its low bit does. Padding bits are cleared.
+        inline constexpr Fault maxFault(const Fault lhs, const Fault rhs) {
+            const uint16_t kA = static_cast<uint16_t>(lhs) & detail::kLanes;
+            const uint16_t kB = static_cast<uint16_t>(rhs) & detail::kLanes;
+            const uint16_t kAHi = (kA & detail::kLaneHi) >> 1;
+            const uint16_t kBHi = (kB & detail::kLaneHi) >> 1;
+            const uint16_t kGt = ((kAHi & ~kBHi) |
+                                  (~(kAHi ^ kBHi) & kA & ~kB)) &
+                                 detail::kLaneLo;
+            const uint16_t kMask = kGt | kGt << 1;
+            return static_cast<Fault>((kA & kMask) | (kB & ~kMask));
+        }
+
+        // Maximum level over the fault types: 3 if a lane has both bits, 2 if
+        // one has the high bit only, else 1 if one has the low bit
+        inline constexpr uint8_t maxSeverity(const Fault f) {
+            const uint16_t kV = static_cast<uint16_t>(f) & detail::kLanes;
+            const uint8_t kHi = (kV & detail::kLaneHi) != 0;
+            const uint8_t kBoth = (kV & kV >> 1 & detail::kLaneLo) != 0;
+            const uint8_t kLo = (kV & detail::kLaneLo) != 0;
+            return (kHi << 1) | (kHi & kBoth) | ((kHi ^ 1) & kLo);
+        }
+
+        // Type-wise maximum level over an array of faults
+        inline constexpr Fault maxFault(const std::span<const Fault> faults) {
+            Fault res = Fault::NONE;
+            for (const Fault f : faults) {
+                res = maxFault(res, f);
+            }
+            return res;
+        }
+
+        // Maximum level over the fault types of an array of faults
+        inline constexpr uint8_t
+        maxSeverity(const std::span<const Fault> faults) {
+            return maxSeverity(maxFault(faults));
+        }
+
+        // Maximum level of each fault of `faults` into `levels`, of the same
+        // size
+        inline constexpr void maxSeverity(const std::span<const Fault> faults,
+                                          const std::span<uint8_t> levels) {
+            for (size_t i = 0; i < faults.size() && i < levels.size(); ++i) {
+                levels[i] = maxSeverity(faults[i]);
+            }
+        }
+
+    } // namespace ibox
+} // namespace fdt
@@ -1,59 +1,20 @@
 #pragma once
 
 #include <csv.hpp>
+#include <deque>
 #include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <span>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
+#include "fault.hpp"
+
 namespace fdt {
     namespace ibox {
 
-        // Define the Fault enum class with bitmask values
-        enum class Fault : uint16_t {
-            NONE = 0,
-            BUMP_FAIR = 0b01 << 0,
-            BUMP_POOR = 0b10 << 0,
-            BUMP_VPOOR = 0b11 << 0,
-            CRACK_FAIR = 0b01 << 2,
-            CRACK_POOR = 0b10 << 2,
-            CRACK_VPOOR = 0b11 << 2,
-            DEPRESSION_FAIR = 0b01 << 4,
-            DEPRESSION_POOR = 0b10 << 4,
-            DEPRESSION_VPOOR = 0b11 << 4,
-            DISPLACEMENT_FAIR = 0b01 << 6,
-            DISPLACEMENT_POOR = 0b10 << 6,
-            DISPLACEMENT_VPOOR = 0b11 << 6,
-            POTHOLE_FAIR = 0b01 << 8,
-            POTHOLE_POOR = 0b10 << 8,
-            POTHOLE_VPOOR = 0b11 << 8,
-            UNEVEN_FAIR = 0b01 << 10,
-            UNEVEN_POOR = 0b10 << 10,
-            UNEVEN_VPOOR = 0b11 << 10,
-            VEGETATION_FAIR = 0b01 << 12,
-            VEGETATION_POOR = 0b10 << 12,
-            VEGETATION_VPOOR = 0b11 << 12,
-            PADDING_FAIR = 0b01 << 14,
-            PADDING_POOR = 0b10 << 14,
-            PADDING_VPOOR = 0b11 << 14,
-        };
-
-        // Define bitwise OR operator for Fault enum class
-        inline Fault operator|(Fault lhs, Fault rhs) {
-            return static_cast<Fault>(static_cast<uint16_t>(lhs) |
-                                      static_cast<uint16_t>(rhs));
-        }
-
-        // Define bitwise OR assignment operator for Fault enum class
-        inline Fault &operator|=(Fault &lhs, Fault rhs) {
-            lhs = lhs | rhs;
-            return lhs;
-        }
-
-        // Define bitwise AND operator for Fault enum class
-        inline Fault operator&(Fault lhs, Fault rhs) {
-            return static_cast<Fault>(static_cast<uint16_t>(lhs) &
-                                      static_cast<uint16_t>(rhs));
-        }
-
         struct Box {
             int x;
             int y;
@@ -61,6 +22,7 @@ namespace fdt {
             int h;
             std::string image;
             Fault fault;
+            float score = 1.0f; // confidence of a prediction; 1 for labels
 
             // Get the maximum severity level of the fault
             uint8_t MaxSeverity() const;
@@ -77,6 +39,120 @@ namespace fdt {
             void Draw(const std::string &, const std::string &) const;
         };
 
+        // Boxes of a load grouped by image, without a string per box: image
+        // names are interned once, and the boxes kept in one array sorted by
+        // image name. Everything lives in a monotonic arena owned by the set,
+        // so it is released at once.
+        class BoxSet {
+          public:
+            // A box without its image name
+            struct Rec {
+                int x;
+                int y;
+                int w;
+                int h;
+                Fault fault;
+                float score = 1.0f;
+            };
+
+            // Boxes of one image, valid as long as the set
+            struct View {
+                std::string_view image;
+                std::span<const Rec> boxes;
+            };
+
+            // Boxes of one source, e.g. a file, with the names of its images
+            // interned; parts are built concurrently, then merged
+            class Part {
+              public:
+                Part() = default;
+                Part(Part &&) = default;
+                Part &operator=(Part &&) = default;
+                Part(const Part &) = delete;
+                Part &operator=(const Part &) = delete;
+
+                void Add(std::string_view image, const Rec &);
+
+              private:
+                friend class BoxSet;
+
+                std::deque<std::string> names_; // stable for views of ids_
+                std::unordered_map<std::string_view, uint32_t> ids_;
+                uint32_t last_ = 0; // id of the last image added
+                std::vector<std::pair<uint32_t, Rec>> recs_;
+            };
+
+            class Iterator {
+              public:
+                using iterator_category = std::forward_iterator_tag;
+                using value_type = View;
+                using difference_type = std::ptrdiff_t;
+
+                Iterator() = default;
+
+                View operator*() const { return (*set_)[idx_]; }
+
+                Iterator &operator++() {
+                    ++idx_;
+                    return *this;
+                }
+
+                Iterator operator++(int) {
+                    Iterator it = *this;
+                    ++idx_;
+                    return it;
+                }
+
+                bool operator==(const Iterator &) const = default;
+
+              private:
+                friend class BoxSet;
+
+                Iterator(const BoxSet *set, const size_t idx)
+                    : set_(set), idx_(idx) {}
+
+                const BoxSet *set_ = nullptr;
+                size_t idx_ = 0;
+            };
+
+            BoxSet();
+
+            // Merge parts: images by name, and the boxes of an image in
+            // part order, then in the order added. Boxes without a fault are
+            // dropped, and so are images left without boxes.
+            explicit BoxSet(std::vector<Part> &&);
+
+            // Number of images
+            size_t Size() const { return data_ ? data_->names.size() : 0; }
+
+            size_t NumBoxes() const { return data_ ? data_->recs.size() : 0; }
+
+            View operator[](const size_t i) const {
+                const uint32_t kBegin = data_->offsets[i];
+                return {data_->names[i],
+                        {data_->recs.data() + kBegin,
+                         data_->offsets[i + 1] - kBegin}};
+            }
+
+            Iterator begin() const { return {this, 0}; }
+
+            Iterator end() const { return {this, Size()}; }
+
+            // Copy into one `ImgBox` per image
+            std::vector<ImgBox> ToImgBoxes() const;
+
+          private:
+            // Heap-allocated so that moving a set keeps the arena in place
+            struct Data {
+                std::pmr::monotonic_buffer_resource arena;
+                std::pmr::vector<std::string_view> names{&arena};
+                std::pmr::vector<uint32_t> offsets{&arena}; // into recs
+                std::pmr::vector<Rec> recs{&arena};
+            };
+
+            std::unique_ptr<Data> data_;
+        };
+
 #ifdef GTEST_ACCESS
         std::vector<ImgBox> from_via_csv(std::istream &);
 
@@ -88,12 +164,36 @@ namespace fdt {
 
         std::vector<ImgBox> fromTsv(const std::string &);
 
+        // Load into a `BoxSet` rather than `ImgBox` records
+        void fromVia(const std::string &, BoxSet &);
+
+        void fromTsv(const std::string &, BoxSet &);
+
+        // Header of the TSVs written by `toTsv` and `cocoToTsv`
+        inline constexpr const char *kTsvHeader =
+            "prefix\timage\tcate\tlevel\tx\ty\tw\th";
+
         void toTsv(const std::vector<ibox::ImgBox> &, const std::string &,
                    std::ostream &);
 
+        void toTsv(const BoxSet &, const std::string &, std::ostream &);
+
+        // Convert a COCO document to the TSV rows of `toTsv`, streaming it
+        // with a SAX parser in two passes: images and categories first, then
+        // the annotations, which are written as they are read. Memory is
+        // proportional to the images and categories only.
+        //
+        // A file name "<prefix>/<image>" gives the prefix of an image, other
+        // names take the given prefix; a category name "<cate>-<level>" or
+        // "<cate>_<level>" with a known level gives the level column.
+        void cocoToTsv(const std::string &coco_file, const std::string &,
+                       std::ostream &);
+
         void drawBBox(const std::vector<ibox::ImgBox> &, const std::string &,
                       const std::string &);
 
+        void drawBBox(const BoxSet &, const std::string &, const std::string &);
+
     } // namespace ibox
 
 } // namespace fdt
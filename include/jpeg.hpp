@@ -0,0 +1,433 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace fdt {
+
+    // Minimal readers for the metadata segments of JPEG files. Only the few KB
+    // in front of the entropy-coded image data are ever read.
+    namespace jpeg {
+
+        // JPEG markers
+        inline static constexpr uint8_t kMarkerSOI = 0xD8;
+        inline static constexpr uint8_t kMarkerEOI = 0xD9;
+        inline static constexpr uint8_t kMarkerSOS = 0xDA;
+        inline static constexpr uint8_t kMarkerAPP1 = 0xE1;
+
+        // Identifier in front of the TIFF structure of an EXIF APP1 segment
+        inline static constexpr std::array<uint8_t, 6> kExifId = {
+            'E', 'x', 'i', 'f', '\0', '\0'};
+
+        // TIFF tags of the sub-IFD pointers in IFD0
+        inline static constexpr uint16_t kTagExifIfd = 0x8769;
+        inline static constexpr uint16_t kTagGpsIfd = 0x8825;
+
+        // TIFF tags of the embedded JPEG thumbnail in IFD1
+        inline static constexpr uint16_t kTagThumbOffset = 0x0201;
+        inline static constexpr uint16_t kTagThumbLength = 0x0202;
+
+        // EXIF image file directories
+        enum class Ifd : uint8_t {
+            IMAGE, // IFD0, i.e. the main image
+            PHOTO, // Exif sub-IFD
+            GPS,   // GPS sub-IFD
+            THUMB, // IFD1, i.e. the thumbnail
+        };
+
+        // TIFF field types
+        enum class Type : uint16_t {
+            BYTE = 1,
+            ASCII,
+            SHORT,
+            LONG,
+            RATIONAL,
+            SBYTE,
+            UNDEFINED,
+            SSHORT,
+            SLONG,
+            SRATIONAL,
+            FLOAT,
+            DOUBLE,
+        };
+
+        // Size in bytes of one component of each field type; 0 if unknown
+        inline constexpr uint32_t typeSize(const Type type) {
+            constexpr std::array<uint8_t, 13> kSizes = {0, 1, 1, 2, 4, 8, 1,
+                                                        1, 2, 4, 8, 4, 8};
+            const auto idx = static_cast<uint16_t>(type);
+            return idx < kSizes.size() ? kSizes[idx] : 0;
+        }
+
+        inline constexpr bool isInteger(const Type type) {
+            return type == Type::BYTE || type == Type::SHORT ||
+                   type == Type::LONG || type == Type::SBYTE ||
+                   type == Type::SSHORT || type == Type::SLONG;
+        }
+
+        inline constexpr bool isRational(const Type type) {
+            return type == Type::RATIONAL || type == Type::SRATIONAL;
+        }
+
+        // Byte-order aware loads
+        inline constexpr uint16_t load16(const uint8_t *p, const bool le) {
+            return le ? static_cast<uint16_t>(p[0] | (p[1] << 8))
+                      : static_cast<uint16_t>((p[0] << 8) | p[1]);
+        }
+
+        inline constexpr uint32_t load32(const uint8_t *p, const bool le) {
+            return le ? (static_cast<uint32_t>(p[0]) |
+                         (static_cast<uint32_t>(p[1]) << 8) |
+                         (static_cast<uint32_t>(p[2]) << 16) |
+                         (static_cast<uint32_t>(p[3]) << 24))
+                      : ((static_cast<uint32_t>(p[0]) << 24) |
+                         (static_cast<uint32_t>(p[1]) << 16) |
+                         (static_cast<uint32_t>(p[2]) << 8) |
+                         static_cast<uint32_t>(p[3]));
+        }
+
+        struct Rational {
+            int64_t num;
+            int64_t den;
+
+            double value() const {
+                return static_cast<double>(num) / static_cast<double>(den);
+            }
+        };
+
+        // One IFD entry; `data` points at its value inside the TIFF buffer,
+        // which has been checked to hold `count` components.
+        struct Entry {
+            Ifd ifd;
+            uint16_t tag;
+            Type type;
+            uint32_t count;
+            const uint8_t *data;
+            bool le; // little-endian (II) or big-endian (MM)
+
+            bool IsInteger() const {
+                return isInteger(type);
+            }
+
+            bool IsRational() const {
+                return isRational(type);
+            }
+
+            // Value of the i-th component of an integer entry; the bytes of
+            // an UNDEFINED entry are read as BYTE
+            int64_t Integer(const size_t i = 0) const {
+                switch (type) {
+                case Type::BYTE:
+                case Type::UNDEFINED:
+                    return data[i];
+                case Type::SBYTE:
+                    return static_cast<int8_t>(data[i]);
+                case Type::SHORT:
+                    return load16(data + 2 * i, le);
+                case Type::SSHORT:
+                    return static_cast<int16_t>(load16(data + 2 * i, le));
+                case Type::LONG:
+                    return load32(data + 4 * i, le);
+                case Type::SLONG:
+                    return static_cast<int32_t>(load32(data + 4 * i, le));
+                default:
+                    return 0;
+                }
+            }
+
+            // Value of the i-th component of a rational entry
+            Rational Rat(const size_t i = 0) const {
+                const uint32_t num = load32(data + 8 * i, le);
+                const uint32_t den = load32(data + 8 * i + 4, le);
+                if (type == Type::SRATIONAL) {
+                    return {static_cast<int32_t>(num),
+                            static_cast<int32_t>(den)};
+                }
+                return {num, den};
+            }
+
+            // Raw bytes of the entry; ASCII entries are cut at the first NUL
+            std::string_view Text() const {
+                const auto *p = reinterpret_cast<const char *>(data);
+                const size_t n = count * typeSize(type);
+                if (type != Type::ASCII) {
+                    return {p, n};
+                }
+                const void *nul = std::memchr(p, '\0', n);
+                return {p, nul ? static_cast<const char *>(nul) - p : n};
+            }
+        };
+
+        // Frame size of a JPEG image
+        struct Size {
+            uint16_t width;
+            uint16_t height;
+        };
+
+        // Start-of-frame markers: SOF0 to SOF15 except DHT, JPG and DAC
+        inline constexpr bool isSof(const int marker) {
+            return marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+                   marker != 0xC8 && marker != 0xCC;
+        }
+
+        // Read the SOI marker at the start of a JPEG file
+        inline bool readSoi(std::istream &is) {
+            return is.get() == 0xFF && is.get() == kMarkerSOI;
+        }
+
+        // Read the header of the next marker segment, skipping fill bytes and
+        // standalone markers; the stream is left at the segment payload.
+        //
+        // @param marker: marker of the segment
+        // @param n: length of the payload in bytes
+        // @return: false at the image data (SOS), EOI or a malformed header
+        inline bool nextSegment(std::istream &is, int &marker, size_t &n) {
+            while (true) {
+                if (is.get() != 0xFF) {
+                    return false;
+                }
+                marker = is.get();
+                while (marker == 0xFF) { // fill bytes
+                    marker = is.get();
+                }
+                if (marker == EOF || marker == kMarkerSOS ||
+                    marker == kMarkerEOI) {
+                    return false;
+                }
+                // standalone markers carry no length
+                if ((marker >= 0xD0 && marker <= 0xD7) || marker == 0x01) {
+                    continue;
+                }
+
+                uint8_t len_be[2];
+                if (!is.read(reinterpret_cast<char *>(len_be), 2)) {
+                    return false;
+                }
+                const uint16_t len = load16(len_be, false);
+                if (len < 2) {
+                    return false;
+                }
+                n = len - 2;
+                return true;
+            }
+        }
+
+        // Read the TIFF structure embedded in the EXIF APP1 segment, i.e. the
+        // payload after the "Exif\0\0" identifier. Segments in front of it are
+        // skipped by their length, so only the marker headers and the APP1
+        // payload are read.
+        //
+        // @param is: input stream positioned at the start of the JPEG file
+        // @param tiff: buffer to receive the TIFF structure
+        // @return: false if the stream is not a JPEG file or has no EXIF data
+        inline bool readExif(std::istream &is, std::vector<uint8_t> &tiff) {
+            if (!readSoi(is)) {
+                return false;
+            }
+
+            int marker;
+            size_t n;
+            while (nextSegment(is, marker, n)) {
+                if (marker == kMarkerAPP1 && n > kExifId.size()) {
+                    std::array<uint8_t, kExifId.size()> id;
+                    if (!is.read(reinterpret_cast<char *>(id.data()),
+                                 id.size())) {
+                        return false;
+                    }
+                    n -= id.size();
+                    if (id == kExifId) {
+                        tiff.resize(n);
+                        return static_cast<bool>(is.read(
+                            reinterpret_cast<char *>(tiff.data()), n));
+                    }
+                }
+                // not EXIF (e.g. JFIF, XMP); skip the rest of the segment
+                if (!is.seekg(n, std::ios::cur)) {
+                    return false;
+                }
+            }
+            return false;
+        }
+
+        // Read the frame size from the SOFn segment. As with `readExif`, the
+        // segments in front of it are skipped by their length, so only the
+        // marker headers and a few bytes of the frame header are read.
+        //
+        // @param is: input stream positioned at the start of the JPEG file
+        // @return: false if the stream is not a JPEG file or has no frame
+        //          header before the image data
+        inline bool readSize(std::istream &is, Size &size) {
+            if (!readSoi(is)) {
+                return false;
+            }
+
+            int marker;
+            size_t n;
+            while (nextSegment(is, marker, n)) {
+                if (isSof(marker)) {
+                    uint8_t sof[5]; // sample precision, height, width
+                    if (n < sizeof(sof) ||
+                        !is.read(reinterpret_cast<char *>(sof), sizeof(sof))) {
+                        return false;
+                    }
+                    size = {load16(sof + 3, false), load16(sof + 1, false)};
+                    return true;
+                }
+                if (!is.seekg(n, std::ios::cur)) {
+                    return false;
+                }
+            }
+            return false;
+        }
+
+        // Visit the entries of the IFD at `offset`; entries of unknown type or
+        // whose value lies outside the buffer are skipped.
+        //
+        // @return: false if the directory itself lies outside the buffer
+        template <typename Visit>
+        inline bool walkIfd(const uint8_t *tiff, const size_t size,
+                            const uint32_t offset, const Ifd ifd, const bool le,
+                            Visit &&visit) {
+            if (offset < 8 || static_cast<size_t>(offset) + 2 > size) {
+                return false;
+            }
+            const uint16_t n = load16(tiff + offset, le);
+            if (static_cast<size_t>(offset) + 2 + 12 * n > size) {
+                return false;
+            }
+
+            for (uint16_t i = 0; i < n; ++i) {
+                const uint8_t *p = tiff + offset + 2 + 12 * i;
+                const auto type = static_cast<Type>(load16(p + 2, le));
+                const uint32_t count = load32(p + 4, le);
+                const uint64_t n_bytes =
+                    static_cast<uint64_t>(count) * typeSize(type);
+                if (n_bytes == 0) {
+                    continue;
+                }
+
+                const uint8_t *data = p + 8;
+                if (n_bytes > 4) {
+                    const uint32_t off_val = load32(p + 8, le);
+                    if (off_val + n_bytes > size) {
+                        continue;
+                    }
+                    data = tiff + off_val;
+                }
+                visit(Entry{ifd, load16(p, le), type, count, data, le});
+            }
+            return true;
+        }
+
+        // Offset of the IFD linked after the IFD at `offset`; 0 if there is
+        // none or the directory lies outside the buffer
+        inline uint32_t nextIfd(const uint8_t *tiff, const size_t size,
+                                const uint32_t offset, const bool le) {
+            if (offset < 8 || static_cast<size_t>(offset) + 2 > size) {
+                return 0;
+            }
+            const size_t link = offset + 2 + 12 * load16(tiff + offset, le);
+            return link + 4 > size ? 0 : load32(tiff + link, le);
+        }
+
+        // Walk IFD0 of a TIFF structure followed by its Exif and GPS sub-IFDs,
+        // calling `visit(const Entry &)` for every entry.
+        //
+        // @param tiff: the TIFF structure, e.g. as read by `readExif`
+        // @param size: size of the TIFF structure in bytes
+        // @return: false if the TIFF header or IFD0 is malformed
+        template <typename Visit>
+        inline bool walkTiff(const uint8_t *tiff, const size_t size,
+                             Visit &&visit) {
+            if (size < 8) {
+                return false;
+            }
+            bool le;
+            if (tiff[0] == 'I' && tiff[1] == 'I') {
+                le = true;
+            } else if (tiff[0] == 'M' && tiff[1] == 'M') {
+                le = false;
+            } else {
+                return false;
+            }
+            if (load16(tiff + 2, le) != 42) {
+                return false;
+            }
+
+            uint32_t off_exif = 0;
+            uint32_t off_gps = 0;
+            const bool ok = walkIfd(
+                tiff, size, load32(tiff + 4, le), Ifd::IMAGE, le,
+                [&](const Entry &e) {
+                    if (e.tag == kTagExifIfd && e.IsInteger()) {
+                        off_exif = static_cast<uint32_t>(e.Integer());
+                    } else if (e.tag == kTagGpsIfd && e.IsInteger()) {
+                        off_gps = static_cast<uint32_t>(e.Integer());
+                    }
+                    visit(e);
+                });
+            if (!ok) {
+                return false;
+            }
+
+            // a broken sub-IFD only loses its own entries
+            if (off_exif != 0) {
+                walkIfd(tiff, size, off_exif, Ifd::PHOTO, le, visit);
+            }
+            if (off_gps != 0) {
+                walkIfd(tiff, size, off_gps, Ifd::GPS, le, visit);
+            }
+            return true;
+        }
+
+        // Locate the JPEG thumbnail referenced by IFD1 of a TIFF structure.
+        // The thumbnail lies inside the EXIF segment, so it is available
+        // without touching the main image.
+        //
+        // @param tiff: the TIFF structure, e.g. as read by `readExif`
+        // @param size: size of the TIFF structure in bytes
+        // @return: the thumbnail bytes; empty if there is no IFD1, the
+        //          thumbnail lies outside the buffer or is not a JPEG stream
+        inline std::span<const uint8_t> findThumbnail(const uint8_t *tiff,
+                                                      const size_t size) {
+            if (size < 8) {
+                return {};
+            }
+            bool le;
+            if (tiff[0] == 'I' && tiff[1] == 'I') {
+                le = true;
+            } else if (tiff[0] == 'M' && tiff[1] == 'M') {
+                le = false;
+            } else {
+                return {};
+            }
+            const uint32_t off_ifd1 =
+                nextIfd(tiff, size, load32(tiff + 4, le), le);
+            if (off_ifd1 == 0) {
+                return {};
+            }
+
+            uint64_t off_thumb = 0;
+            uint64_t len_thumb = 0;
+            walkIfd(tiff, size, off_ifd1, Ifd::THUMB, le, [&](const Entry &e) {
+                if (e.tag == kTagThumbOffset && e.IsInteger()) {
+                    off_thumb = static_cast<uint64_t>(e.Integer());
+                } else if (e.tag == kTagThumbLength && e.IsInteger()) {
+                    len_thumb = static_cast<uint64_t>(e.Integer());
+                }
+            });
+            if (len_thumb < 4 || off_thumb + len_thumb > size ||
+                tiff[off_thumb] != 0xFF || tiff[off_thumb + 1] != kMarkerSOI) {
+                return {};
+            }
+            return {tiff + off_thumb, static_cast<size_t>(len_thumb)};
+        }
+
+    } // namespace jpeg
+
+} // namespace fdt
@@ -1,9 +1,18 @@
 #pragma once
 
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <fcntl.h>
 #include <filesystem>
 #include <fstream>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
 #include <vector>
 
 #define MAX2(x, y) ((x) > (y) ? (x) : (y))
@@ -55,6 +64,119 @@ namespace fdt {
             return files;
         }
 
+        // Number of worker threads to use: `n` if positive, otherwise the
+        // hardware concurrency (at least one).
+        inline unsigned nThreads(const unsigned n) {
+            if (n > 0) {
+                return n;
+            }
+            return MAX2(std::thread::hardware_concurrency(), 1u);
+        }
+
+        // Read-only memory mapping of a whole file
+        class MappedFile {
+          public:
+            explicit MappedFile(const std::string &path)
+                : data_(nullptr), size_(0) {
+                const int fd = ::open(path.c_str(), O_RDONLY);
+                if (fd < 0) {
+                    throw std::runtime_error("Unable to open for reading: " +
+                                             path);
+                }
+                struct stat st;
+                if (::fstat(fd, &st) != 0) {
+                    ::close(fd);
+                    throw std::runtime_error("Unable to stat: " + path);
+                }
+                size_ = static_cast<size_t>(st.st_size);
+                if (size_ > 0) {
+                    void *p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE,
+                                     fd, 0);
+                    if (p == MAP_FAILED) {
+                        ::close(fd);
+                        throw std::runtime_error("Unable to map: " + path);
+                    }
+                    data_ = static_cast<const uint8_t *>(p);
+                }
+                // the mapping stays valid after closing the descriptor
+                ::close(fd);
+            }
+
+            ~MappedFile() {
+                if (data_) {
+                    ::munmap(const_cast<uint8_t *>(data_), size_);
+                }
+            }
+
+            MappedFile(const MappedFile &) = delete;
+            MappedFile &operator=(const MappedFile &) = delete;
+
+            MappedFile(MappedFile &&other) noexcept
+                : data_(other.data_), size_(other.size_) {
+                other.data_ = nullptr;
+                other.size_ = 0;
+            }
+
+            const uint8_t *data() const { return data_; }
+
+            size_t size() const { return size_; }
+
+          private:
+            const uint8_t *data_;
+            size_t size_;
+        };
+
+        // Blocking FIFO of bounded capacity connecting producer threads to a
+        // consumer. Closing it wakes up both sides: `Push` then drops the item
+        // and returns false, `Pop` drains the remaining items and then returns
+        // nullopt.
+        template <typename T> class BoundedQueue {
+          public:
+            explicit BoundedQueue(const size_t capacity)
+                : capacity_(MAX2(capacity, size_t{1})), closed_(false) {}
+
+            bool Push(T item) {
+                std::unique_lock<std::mutex> lock(mutex_);
+                not_full_.wait(lock, [this] {
+                    return closed_ || items_.size() < capacity_;
+                });
+                if (closed_) {
+                    return false;
+                }
+                items_.push_back(std::move(item));
+                not_empty_.notify_one();
+                return true;
+            }
+
+            std::optional<T> Pop() {
+                std::unique_lock<std::mutex> lock(mutex_);
+                not_empty_.wait(lock,
+                                [this] { return closed_ || !items_.empty(); });
+                if (items_.empty()) {
+                    return std::nullopt;
+                }
+                T item = std::move(items_.front());
+                items_.pop_front();
+                not_full_.notify_one();
+                return item;
+            }
+
+            void Close() {
+                std::lock_guard<std::mutex> lock(mutex_);
+                closed_ = true;
+                not_full_.notify_all();
+                not_empty_.notify_all();
+            }
+
+          private:
+            const size_t capacity_;
+            bool closed_;
+            std::deque<T> items_;
+            std::mutex mutex_;
+            std::condition_variable not_full_;
+            std::condition_variable not_empty_;
+        };
+
     } // namespace utils
 
 } // namespace fdt
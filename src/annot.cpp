@@ -1,10 +1,19 @@
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cmath>
 #include <csv.hpp>
+#include <future>
 #include <nlohmann/json.hpp>
 #include <sqlite3.h>
 #include <sstream>
 #include <string_view>
+#include <unordered_set>
 
 #include "annot.hpp"
+#include "exif.hpp"
+#include "jpeg.hpp"
 #include "utils.hpp"
 
 using namespace fdt;
@@ -35,7 +44,8 @@ namespace {
         DROP TABLE raw_exif;
     )";
 
-    static constexpr const char *kSqlNew = R"(
+    // Raw rows of the TSVs, also the tables of the annotation database file
+    static constexpr const char *kSqlNewRaw = R"(
         CREATE TABLE raw_exif (
             prefix TEXT,
             image  TEXT,
@@ -53,7 +63,15 @@ namespace {
             w      INTEGER,
             h      INTEGER
         );
+    )";
+
+    static constexpr const char *kSqlNewRawIndexes = R"(
+        CREATE INDEX raw_exif_key ON raw_exif (prefix, image);
+        CREATE INDEX raw_annot_key ON raw_annot (prefix, image);
+        CREATE INDEX raw_annot_cate ON raw_annot (cate);
+    )";
 
+    static constexpr const char *kSqlNew = R"(
         CREATE TABLE annotations (
             id      INTEGER PRIMARY KEY AUTOINCREMENT,
             img_id  INTEGER,
@@ -61,8 +79,19 @@ namespace {
             x       INTEGER,
             y       INTEGER,
             w       INTEGER,
-            h       INTEGER
+            h       INTEGER,
+            -- resolution of the image, which scales the box area
+            img_w   INTEGER,
+            img_h   INTEGER
+        );
+        CREATE TABLE categories (
+            id    INTEGER PRIMARY KEY AUTOINCREMENT,
+            cate  TEXT
         );
+    )";
+
+    // Images table, shared with the EXIF databases of `exportExifDb`
+    static constexpr const char *kSqlNewImages = R"(
         CREATE TABLE images (
             id     INTEGER PRIMARY KEY AUTOINCREMENT,
             prefix TEXT,
@@ -72,10 +101,6 @@ namespace {
             date   TEXT,
             time   TEXT
         );
-        CREATE TABLE categories (
-            id    INTEGER PRIMARY KEY AUTOINCREMENT,
-            cate  TEXT
-        );
     )";
 
     // Import annotation TSV
@@ -107,6 +132,100 @@ namespace {
                   time ASC;
     )";
 
+    static constexpr const char *kSqlImportImage =
+        "INSERT INTO images (prefix, image, height, width, date, time) "
+        "VALUES (?, ?, ?, ?, ?, ?);";
+
+    static constexpr const char *kSqlAttachExif =
+        "ATTACH DATABASE ? AS exif_db;";
+
+    static constexpr const char *kSqlDetachExif = "DETACH DATABASE exif_db;";
+
+    // Annotation database file, see `updateDb`
+    static constexpr int kAnnotDbVersion = 1;
+
+    static constexpr const char *kSqlAttachAnnot =
+        "ATTACH DATABASE ? AS annot_db;";
+
+    static constexpr const char *kSqlDetachAnnot = "DETACH DATABASE annot_db;";
+
+    // Rows of an update, merged into the raw tables at once
+    static constexpr const char *kSqlNewStage = R"(
+        CREATE TEMP TABLE stage_exif AS SELECT * FROM raw_exif WHERE 0;
+        CREATE TEMP TABLE stage_annot AS SELECT * FROM raw_annot WHERE 0;
+    )";
+
+    static constexpr const char *kSqlStageAnnot =
+        "INSERT INTO stage_annot (prefix, image, cate, level, x, y, w, h) "
+        "VALUES (?, ?, ?, ?, ?, ?, ?, ?);";
+
+    static constexpr const char *kSqlStageExif =
+        "INSERT INTO stage_exif (prefix, image, height, width, timestamp) "
+        "VALUES (?, ?, ?, ?, ?);";
+
+    // Delete the rows of the prefixes being replaced
+    static constexpr const char *kSqlDelStaged = R"(
+        DELETE FROM raw_annot
+         WHERE prefix IN (SELECT DISTINCT prefix FROM stage_annot);
+        DELETE FROM raw_exif
+         WHERE prefix IN (SELECT DISTINCT prefix FROM stage_exif);
+    )";
+
+    static constexpr const char *kSqlMergeStage = R"(
+        INSERT INTO raw_annot (prefix, image, cate, level, x, y, w, h)
+        SELECT prefix, image, cate, level, x, y, w, h
+          FROM stage_annot;
+        INSERT INTO raw_exif (prefix, image, height, width, timestamp)
+        SELECT prefix, image, height, width, timestamp
+          FROM stage_exif;
+        DROP TABLE stage_annot;
+        DROP TABLE stage_exif;
+    )";
+
+    static constexpr const char *kSqlSelRawAnnot = R"(
+        SELECT prefix, image, cate, level, x, y, w, h
+          FROM raw_annot;
+    )";
+
+    static constexpr const char *kSqlSelRawExif = R"(
+        SELECT prefix, image, height, width, timestamp
+          FROM raw_exif;
+    )";
+
+    // Transfer the images of an attached EXIF database, joined by the rows
+    // probed into `raw_exif`, in the same order as `kSqlFillImages`
+    static constexpr const char *kSqlFillImagesDb = R"(
+        INSERT INTO images (prefix, image, height, width, date, time)
+        SELECT prefix, image, height, width, date, time
+          FROM exif_db.images
+         UNION ALL
+        SELECT prefix, image, height, width
+             , substr(timestamp, 1, 10) AS date
+             , substr(timestamp, 12, 8) AS time
+          FROM raw_exif
+         ORDER BY prefix ASC, image ASC, height ASC, width ASC, date ASC,
+                  time ASC;
+    )";
+
+    // Annotated images without EXIF rows, in the flat files or an attached
+    // EXIF database
+    static constexpr const char *kSqlSelMissing = R"(
+        SELECT prefix, image FROM raw_annot
+        EXCEPT
+        SELECT prefix, image FROM raw_exif;
+    )";
+
+    static constexpr const char *kSqlSelMissingDb = R"(
+        SELECT prefix, image FROM raw_annot
+        EXCEPT
+        SELECT prefix, image FROM exif_db.images;
+    )";
+
+    static constexpr const char *kSqlSelImagesDb = R"(
+        SELECT prefix, image, height, width, date, time
+          FROM images;
+    )";
+
     // Populate the annotation table with annotation and image data
     static constexpr const char *kSqlFillAnnot = R"(
         WITH tmp AS (
@@ -116,6 +235,8 @@ namespace {
                  , ann.y
                  , ann.w
                  , ann.h
+                 , img.width AS img_w
+                 , img.height AS img_h
               FROM raw_annot AS ann
              INNER
               JOIN images AS img
@@ -124,14 +245,14 @@ namespace {
               JOIN categories AS cat
                 ON ann.cate = cat.cate
         )
-        INSERT INTO annotations (img_id, cate_id, x, y, w, h)
-        SELECT img_id, cate_id, x, y, w, h
+        INSERT INTO annotations (img_id, cate_id, x, y, w, h, img_w, img_h)
+        SELECT img_id, cate_id, x, y, w, h, img_w, img_h
           FROM tmp
          ORDER BY img_id ASC, cate_id ASC, x ASC, y ASC, w ASC, h ASC;
     )";
 
     static constexpr const char *kSqlSelAnnot = R"(
-        SELECT id, img_id, cate_id, x, y, w, h
+        SELECT id, img_id, cate_id, x, y, w, h, img_w, img_h
           FROM annotations;
     )";
 
@@ -158,8 +279,84 @@ namespace {
             ON img.id= tmp.img_id;
     )";
 
-    static constexpr const float kCoCoWidth = 640.0f;
-    static constexpr const float kCoCoHeight = 480.0f;
+    // The in-memory database lives for one conversion only: no rollback
+    // journal and no syncs
+    static constexpr const char *kSqlPragmas = R"(
+        PRAGMA journal_mode = OFF;
+        PRAGMA synchronous = OFF;
+        PRAGMA temp_store = MEMORY;
+    )";
+
+    // Raw rows tokenised from the TSVs, owned so that they can cross threads
+    struct AnnotRow {
+        std::string prefix;
+        std::string image;
+        std::string cate;
+        std::string level;
+        int x;
+        int y;
+        int w;
+        int h;
+    };
+
+    struct ExifRow {
+        std::string prefix;
+        std::string image;
+        int height;
+        int width;
+        std::string ts;
+    };
+
+    struct RowBatch {
+        std::vector<AnnotRow> annots;
+        std::vector<ExifRow> exifs;
+    };
+
+    // Image row as in the `images` table, before ids are assigned
+    struct ImageRow {
+        std::string prefix;
+        std::string image;
+        std::optional<int> height; // NULL in SQL
+        std::optional<int> width;
+        std::string date;
+        std::string time;
+    };
+
+    // COCO records with their assigned ids
+    struct CateRec {
+        int id;
+        std::string name;
+    };
+
+    struct ImageRec {
+        int id;
+        std::string prefix;
+        std::string image;
+        int height;
+        int width;
+        std::string date;
+        std::string time;
+    };
+
+    struct AnnotRec {
+        int id;
+        int img_id;
+        int cate_id;
+        int x;
+        int y;
+        int w;
+        int h;
+        float scale; // of the area, by the resolution of the image
+    };
+
+    struct Coco {
+        std::vector<CateRec> cates;
+        std::vector<ImageRec> images; // only those with annotations
+        std::vector<AnnotRec> annots;
+    };
+
+    static constexpr size_t kRowsPerBatch = 4096;
+    static constexpr size_t kBatchesPerThread = 4; // queue capacity
 
 } // namespace
 
@@ -186,86 +383,258 @@ inline static void exe_stmt(sqlite3 *db, const std::string &sql) {
     sqlite3_free(errMsg);
 }
 
-inline static void bulk_insert_annot(sqlite3 *db, const std::string &tsv) {
-
+// Tokenise an annotation TSV into batches of raw rows.
+//
+// @return: false if the queue was closed, i.e. loading was aborted
+static bool read_annot_tsv(const std::string &tsv,
+                           utils::BoundedQueue<RowBatch> &queue) {
     csv::CSVFormat format;
     format.delimiter('\t').header_row(0);
     csv::CSVReader reader(tsv, format);
 
-    // Start a transaction
-    exe_stmt(db, kSqlTransStart);
-
+    RowBatch batch;
     for (const auto &row : reader) {
+        batch.annots.push_back({
+            std::string(row["prefix"].get<std::string_view>()),
+            std::string(row["image"].get<std::string_view>()),
+            std::string(row["cate"].get<std::string_view>()),
+            std::string(row["level"].get<std::string_view>()),
+            row["x"].get<int>(),
+            row["y"].get<int>(),
+            row["w"].get<int>(),
+            row["h"].get<int>(),
+        });
+        if (batch.annots.size() == kRowsPerBatch &&
+            !queue.Push(std::exchange(batch, {}))) {
+            return false;
+        }
+    }
+    return batch.annots.empty() || queue.Push(std::move(batch));
+}
 
-        sqlite3_stmt *stmt = nullptr;
-        int rc = sqlite3_prepare_v2(db, kSqlImportAnnot, -1, &stmt, nullptr);
-        StmtCtx stmt_ctx(std::move(stmt));
+// Tokenise an EXIF TSV into batches of raw rows.
+//
+// @return: false if the queue was closed, i.e. loading was aborted
+static bool read_exif_tsv(const std::string &tsv,
+                          utils::BoundedQueue<RowBatch> &queue) {
+    csv::CSVFormat format;
+    format.delimiter('\t').header_row(0);
+    csv::CSVReader reader(tsv, format);
 
-        if (rc != SQLITE_OK) {
-            std::cerr << "Cannot prepare the INSERTION: " << sqlite3_errmsg(db)
-                      << std::endl;
-            continue;
+    RowBatch batch;
+    for (const auto &row : reader) {
+        batch.exifs.push_back({
+            std::string(row["prefix"].get<std::string_view>()),
+            std::string(row["image"].get<std::string_view>()),
+            row["height"].get<int>(),
+            row["width"].get<int>(),
+            std::string(row["timestamp"].get<std::string_view>()),
+        });
+        if (batch.exifs.size() == kRowsPerBatch &&
+            !queue.Push(std::exchange(batch, {}))) {
+            return false;
         }
-        const auto prefix = row["prefix"].get<std::string_view>();
-        const auto image = row["image"].get<std::string_view>();
-        const auto cate = row["cate"].get<std::string_view>();
-        const auto level = row["level"].get<std::string_view>();
+    }
+    return batch.exifs.empty() || queue.Push(std::move(batch));
+}
 
-        sqlite3_bind_text(stmt_ctx.get(), 1, prefix.data(), prefix.size(),
-                          SQLITE_STATIC);
-        sqlite3_bind_text(stmt_ctx.get(), 2, image.data(), image.size(),
-                          SQLITE_STATIC);
-        sqlite3_bind_text(stmt_ctx.get(), 3, cate.data(), cate.size(),
-                          SQLITE_STATIC);
-        sqlite3_bind_text(stmt_ctx.get(), 4, level.data(), level.size(),
-                          SQLITE_STATIC);
-        sqlite3_bind_int(stmt_ctx.get(), 5, row["x"].get<int>());
-        sqlite3_bind_int(stmt_ctx.get(), 6, row["y"].get<int>());
-        sqlite3_bind_int(stmt_ctx.get(), 7, row["w"].get<int>());
-        sqlite3_bind_int(stmt_ctx.get(), 8, row["h"].get<int>());
+inline static sqlite3_stmt *prepare_stmt(sqlite3 *db, const char *sql) {
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        std::cerr << "Cannot prepare the INSERTION: " << sqlite3_errmsg(db)
+                  << std::endl;
+        sqlite3_finalize(stmt);
+        throw std::runtime_error("SQL error");
+    }
+    return stmt;
+}
 
-        rc = sqlite3_step(stmt_ctx.get());
-        if (rc != SQLITE_DONE) {
-            std::cerr << "Failed to execute the INSERTION: "
-                      << sqlite3_errmsg(db) << std::endl;
-            continue;
+// Step a bound INSERT; a failing row is reported and skipped
+inline static void step_insert(sqlite3 *db, sqlite3_stmt *stmt) {
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        std::cerr << "Failed to execute the INSERTION: " << sqlite3_errmsg(db)
+                  << std::endl;
+    }
+    sqlite3_reset(stmt);
+}
+
+inline static void insert_annot(sqlite3 *db, sqlite3_stmt *stmt,
+                                const AnnotRow &row) {
+    sqlite3_bind_text(stmt, 1, row.prefix.data(), row.prefix.size(),
+                      SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, row.image.data(), row.image.size(),
+                      SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, row.cate.data(), row.cate.size(),
+                      SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, row.level.data(), row.level.size(),
+                      SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 5, row.x);
+    sqlite3_bind_int(stmt, 6, row.y);
+    sqlite3_bind_int(stmt, 7, row.w);
+    sqlite3_bind_int(stmt, 8, row.h);
+    step_insert(db, stmt);
+}
+
+inline static void insert_exif(sqlite3 *db, sqlite3_stmt *stmt,
+                               const ExifRow &row) {
+    sqlite3_bind_text(stmt, 1, row.prefix.data(), row.prefix.size(),
+                      SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, row.image.data(), row.image.size(),
+                      SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 3, row.height);
+    sqlite3_bind_int(stmt, 4, row.width);
+    sqlite3_bind_text(stmt, 5, row.ts.data(), row.ts.size(), SQLITE_STATIC);
+    step_insert(db, stmt);
+}
+
+// Tokenise annotation and EXIF TSVs on worker threads, which pass row batches
+// through a bounded queue to `consume(RowBatch &)` on the calling thread.
+// Batches arrive in no particular order.
+template <typename Consume>
+static void scan_tsv(const Paths &annot_tsvs, const Paths &exif_tsvs,
+                     Consume consume) {
+    const size_t n_files = annot_tsvs.size() + exif_tsvs.size();
+    if (n_files == 0) {
+        return;
+    }
+    const unsigned n_threads =
+        static_cast<unsigned>(MIN2(size_t{utils::nThreads(0)}, n_files));
+    utils::BoundedQueue<RowBatch> queue(n_threads * kBatchesPerThread);
+    std::atomic<size_t> next{0};
+    std::atomic<unsigned> active{n_threads};
+
+    // Workers claim files one at a time; the last one to finish closes the
+    // queue, and a failing one closes it at once to stop the others.
+    const auto tokenise = [&]() {
+        try {
+            for (size_t i = next++; i < n_files; i = next++) {
+                const bool ok =
+                    i < annot_tsvs.size()
+                        ? read_annot_tsv(annot_tsvs[i], queue)
+                        : read_exif_tsv(exif_tsvs[i - annot_tsvs.size()],
+                                        queue);
+                if (!ok) {
+                    break;
+                }
+            }
+        } catch (...) {
+            queue.Close();
+            throw;
         }
+        if (--active == 0) {
+            queue.Close();
+        }
+    };
+    std::vector<std::future<void>> futures;
+    for (unsigned i = 0; i < n_threads; ++i) {
+        futures.push_back(std::async(std::launch::async, tokenise));
     }
 
-    // Commit the transaction
+    try {
+        while (auto batch = queue.Pop()) {
+            consume(*batch);
+        }
+    } catch (...) {
+        // unblock the workers before their futures are joined
+        queue.Close();
+        throw;
+    }
+
+    // Rethrow the first tokenising error, e.g. a malformed TSV
+    for (auto &fut : futures) {
+        fut.get();
+    }
+}
+
+// Load annotation and EXIF TSVs into the raw tables, or the tables of the
+// given INSERTs. The calling thread owns the connection and inserts everything
+// with two statements prepared once, in a single transaction. Rows may arrive
+// in any order, which is fine as the raw tables are only read by fully ordered
+// queries.
+static void bulk_insert_tsv(sqlite3 *db, const Paths &annot_tsvs,
+                            const Paths &exif_tsvs,
+                            const char *sql_annot = kSqlImportAnnot,
+                            const char *sql_exif = kSqlImportExif) {
+    StmtCtx stmt_annot(prepare_stmt(db, sql_annot));
+    StmtCtx stmt_exif(prepare_stmt(db, sql_exif));
+    exe_stmt(db, kSqlTransStart);
+    scan_tsv(annot_tsvs, exif_tsvs, [&](const RowBatch &batch) {
+        for (const auto &row : batch.annots) {
+            insert_annot(db, stmt_annot.get(), row);
+        }
+        for (const auto &row : batch.exifs) {
+            insert_exif(db, stmt_exif.get(), row);
+        }
+    });
     exe_stmt(db, kSqlCommit);
 }
 
-inline static void bulk_insert_exif(sqlite3 *db, const std::string &tsv) {
+// Format seconds since the epoch as the EXIF TSV timestamp, i.e.
+// "YYYY-MM-DDTHH:MM:SS"
+inline static std::string epoch_to_ts(const int64_t secs) {
+    using namespace std::chrono;
+    const sys_seconds kTp{seconds{secs}};
+    const sys_days kDays = floor<days>(kTp);
+    const year_month_day kYmd{kDays};
+    const hh_mm_ss kHms{kTp - kDays};
+    // room for any int, two unsigned and three long fields, 5 separators
+    // and NUL, though they never exceed their 2 or 4 digits
+    char buf[11 + 2 * 10 + 3 * 20 + 5 + 1];
+    std::snprintf(buf, sizeof(buf), "%04d-%02u-%02uT%02ld:%02ld:%02ld",
+                  static_cast<int>(kYmd.year()),
+                  static_cast<unsigned>(kYmd.month()),
+                  static_cast<unsigned>(kYmd.day()),
+                  static_cast<long>(kHms.hours().count()),
+                  static_cast<long>(kHms.minutes().count()),
+                  static_cast<long>(kHms.seconds().count()));
+    return buf;
+}
 
-    csv::CSVFormat format;
-    format.delimiter('\t').header_row(0);
-    csv::CSVReader reader(tsv, format);
+// Insert the rows of a columnar EXIF file (see `exif::exportColumnar`); the
+// prefix of an image is the name of its directory.
+inline static void
+bulk_insert_exif_columnar(sqlite3 *db, const std::string &file,
+                          const char *sql_insert = kSqlImportExif) {
+    const fdt::exif::ColumnarReader reader(file);
+    const auto height = reader.Column<int32_t>("height");
+    const auto width = reader.Column<int32_t>("width");
+    const auto timestamp = reader.Column<int64_t>("timestamp");
+
+    sqlite3_stmt *stmt = nullptr;
+    int rc = sqlite3_prepare_v2(db, sql_insert, -1, &stmt, nullptr);
+    StmtCtx stmt_ctx(std::move(stmt));
+    if (rc != SQLITE_OK) {
+        std::cerr << "Cannot prepare the INSERTION: " << sqlite3_errmsg(db)
+                  << std::endl;
+        throw std::runtime_error("SQL error");
+    }
 
     // Start a transaction
     exe_stmt(db, kSqlTransStart);
 
-    for (const auto &row : reader) {
-
-        sqlite3_stmt *stmt;
-        int rc = sqlite3_prepare_v2(db, kSqlImportExif, -1, &stmt, nullptr);
-        StmtCtx stmt_ctx(std::move(stmt));
-
-        if (rc != SQLITE_OK) {
-            std::cerr << "Cannot prepare the INSERTION: " << sqlite3_errmsg(db)
-                      << std::endl;
-            continue;
-        }
-        const auto prefix = row["prefix"].get<std::string_view>();
-        const auto image = row["image"].get<std::string_view>();
-        const auto ts = row["timestamp"].get<std::string_view>();
+    for (size_t i = 0; i < reader.Size(); ++i) {
+        const std::string prefix =
+            std::filesystem::path(reader.Dir(i)).filename().string();
+        const std::string_view image = reader.Name(i);
+        const std::string ts = timestamp[i] == fdt::exif::fdtc::kNullI64
+                                   ? ""
+                                   : epoch_to_ts(timestamp[i]);
 
+        sqlite3_reset(stmt_ctx.get());
         sqlite3_bind_text(stmt_ctx.get(), 1, prefix.data(), prefix.size(),
                           SQLITE_STATIC);
         sqlite3_bind_text(stmt_ctx.get(), 2, image.data(), image.size(),
                           SQLITE_STATIC);
-        sqlite3_bind_int(stmt_ctx.get(), 3, row["height"].get<int>());
-        sqlite3_bind_int(stmt_ctx.get(), 4, row["width"].get<int>());
+        if (height[i] == fdt::exif::fdtc::kNullI32) {
+            sqlite3_bind_null(stmt_ctx.get(), 3);
+        } else {
+            sqlite3_bind_int(stmt_ctx.get(), 3, height[i]);
+        }
+        if (width[i] == fdt::exif::fdtc::kNullI32) {
+            sqlite3_bind_null(stmt_ctx.get(), 4);
+        } else {
+            sqlite3_bind_int(stmt_ctx.get(), 4, width[i]);
+        }
         sqlite3_bind_text(stmt_ctx.get(), 5, ts.data(), ts.size(),
                           SQLITE_STATIC);
 
@@ -331,30 +700,31 @@ inline static void cb_print_exif(sqlite3_stmt *stmt) {
               << sqlite3_column_text(stmt, 6) << "|" << std::endl;
 }
 
-// Load `categories`, `images`, and `annotations` tables from flat files
-static void load_db(sqlite3 *db, const std::string &dir_annot,
-                    const std::string &dir_exif) {
-    // Load annotation & EXIF TSVs
-    for (const auto &f : fdt::utils::listAllFiles(dir_annot, ".tsv")) {
-        bulk_insert_annot(db, f);
+// Attach a database file with an `ATTACH DATABASE ? AS ...` statement
+static void attach_db(sqlite3 *db, const char *sql_attach,
+                      const std::string &file) {
+    sqlite3_stmt *stmt = nullptr;
+    int rc = sqlite3_prepare_v2(db, sql_attach, -1, &stmt, nullptr);
+    StmtCtx stmt_ctx(std::move(stmt));
+    if (rc != SQLITE_OK) {
+        std::cerr << "Cannot prepare the ATTACH: " << sqlite3_errmsg(db)
+                  << std::endl;
+        throw std::runtime_error("SQL error");
     }
-    for (const auto &f : fdt::utils::listAllFiles(dir_exif, ".tsv")) {
-        bulk_insert_exif(db, f);
+    sqlite3_bind_text(stmt_ctx.get(), 1, file.data(), file.size(),
+                      SQLITE_STATIC);
+    if (sqlite3_step(stmt_ctx.get()) != SQLITE_DONE) {
+        std::cerr << "Cannot attach " << file << ": " << sqlite3_errmsg(db)
+                  << std::endl;
+        throw std::runtime_error("SQL error");
     }
-
-    // Populate `categories`, `images`, and `annotations` tables
-    exe_stmt(db, kSqlFillCategories);
-    exe_stmt(db, kSqlFillImages);
-    exe_stmt(db, kSqlFillAnnot);
 }
 
-inline static nlohmann::json::array_t annot2coco(sqlite3 *db,
-                                                 const float &scale) {
-    nlohmann::json::array_t js_annot;
-
-    // Prepare the SQL statement to query the annotations table
+// Prepare a SELECT and pass each row to `read(sqlite3_stmt *)`
+template <typename Read>
+static void select_rows(sqlite3 *db, const char *sql, Read read) {
     sqlite3_stmt *stmt;
-    int rc = sqlite3_prepare_v2(db, kSqlSelAnnot, -1, &stmt, nullptr);
+    int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
     StmtCtx stmt_ctx(std::move(stmt));
 
     if (rc != SQLITE_OK) {
@@ -363,35 +733,8 @@ inline static nlohmann::json::array_t annot2coco(sqlite3 *db,
         throw std::runtime_error("SQL error");
     }
 
-    // Execute the query and process the results
     while ((rc = sqlite3_step(stmt_ctx.get())) == SQLITE_ROW) {
-        // Create the annotation object
-        nlohmann::json js;
-
-        const int id = sqlite3_column_int(stmt_ctx.get(), 0);
-        const int img_id = sqlite3_column_int(stmt_ctx.get(), 1);
-        const int cate_id = sqlite3_column_int(stmt_ctx.get(), 2);
-        const int x = sqlite3_column_int(stmt_ctx.get(), 3);
-        const int y = sqlite3_column_int(stmt_ctx.get(), 4);
-        const int w = sqlite3_column_int(stmt_ctx.get(), 5);
-        const int h = sqlite3_column_int(stmt_ctx.get(), 6);
-        // during evaluation, mmdet will determine small / medium / large
-        // based on the area of the bounding box; according to the definition
-        // of COCO dataset (resolution 640x480), the small and medium areas in
-        // an image are less than 1024 (32*32), 9216 (96*96), respectively
-        // Here we scale the area to the COCO dataset resolution to simulate the
-        // same behavior; scale = 640*480/(original image resolution)
-        const float area = w * h * scale;
-
-        js["id"] = id;
-        js["category_id"] = cate_id;
-        js["iscrowd"] = 0;
-        js["image_id"] = img_id;
-        js["bbox"] = {x, y, w, h};
-        js["area"] = area;
-
-        // Add the annotation to the JSON array
-        js_annot.push_back(js);
+        read(stmt_ctx.get());
     }
 
     if (rc != SQLITE_DONE) {
@@ -399,146 +742,1378 @@ inline static nlohmann::json::array_t annot2coco(sqlite3 *db,
                   << sqlite3_errmsg(db) << std::endl;
         throw std::runtime_error("SQL error");
     }
-
-    return js_annot;
 }
 
-inline static nlohmann::json::array_t img2coco(sqlite3 *db) {
-    nlohmann::json::array_t js_img;
+// Text of a column; NULL reads as an empty string
+inline static std::string column_str(sqlite3_stmt *stmt, const int col) {
+    const auto *text =
+        reinterpret_cast<const char *>(sqlite3_column_text(stmt, col));
+    return text ? text : "";
+}
 
-    // Prepare the SQL statement to query the annotations table
-    sqlite3_stmt *stmt;
-    int rc = sqlite3_prepare_v2(db, kSqlSelImg, -1, &stmt, nullptr);
-    StmtCtx stmt_ctx(std::move(stmt));
+// Integer of a column; nullopt if NULL
+inline static std::optional<int> column_opt_int(sqlite3_stmt *stmt,
+                                                const int col) {
+    if (sqlite3_column_type(stmt, col) == SQLITE_NULL) {
+        return std::nullopt;
+    }
+    return sqlite3_column_int(stmt, col);
+}
 
-    if (rc != SQLITE_OK) {
-        std::cerr << "Cannot prepare the SELECT statement: "
-                  << sqlite3_errmsg(db) << std::endl;
+// Open a database file, e.g. with SQLITE_OPEN_READONLY
+static DbCtx open_db(const std::string &file, const int flags) {
+    sqlite3 *db = nullptr;
+    if (sqlite3_open_v2(file.c_str(), &db, flags, nullptr) != SQLITE_OK) {
+        std::cerr << "Can't open database: " << sqlite3_errmsg(db)
+                  << std::endl;
+        sqlite3_close(db);
         throw std::runtime_error("SQL error");
     }
+    return DbCtx(db, sqlite3_close);
+}
 
-    // Execute the query and process the results
-    while ((rc = sqlite3_step(stmt_ctx.get())) == SQLITE_ROW) {
-        // Create the annotation object
-        nlohmann::json js;
-
-        const int id = sqlite3_column_int(stmt_ctx.get(), 0);
-        const char *prefix = reinterpret_cast<const char *>(
-            sqlite3_column_text(stmt_ctx.get(), 1));
-        const char *image = reinterpret_cast<const char *>(
-            sqlite3_column_text(stmt_ctx.get(), 2));
-        const int height = sqlite3_column_int(stmt_ctx.get(), 3);
-        const int width = sqlite3_column_int(stmt_ctx.get(), 4);
-        const char *date = reinterpret_cast<const char *>(
-            sqlite3_column_text(stmt_ctx.get(), 5));
-        const char *time = reinterpret_cast<const char *>(
-            sqlite3_column_text(stmt_ctx.get(), 6));
-
-        js["id"] = id;
-        js["width"] = width;
-        js["height"] = height;
-        js["file_name"] = std::string(prefix) + "/" + image;
-        js["date_captured"] = date + std::string(" ") + time;
-
-        // Add the annotation to the JSON array
-        js_img.push_back(js);
+// Scale of box areas in an image of the given resolution to the COCO one, 0
+// if the resolution is unknown (0 or NULL in the tables)
+inline static float coco_scale(const int w_img, const int h_img) {
+    if (w_img <= 0 || h_img <= 0) {
+        return 0.0f;
     }
+    return annot::kCocoWidth * annot::kCocoHeight / w_img / h_img;
+}
 
-    if (rc != SQLITE_DONE) {
-        std::cerr << "Failed to execute the SELECT statement: "
-                  << sqlite3_errmsg(db) << std::endl;
-        throw std::runtime_error("SQL error");
+// COCO records of the rows of `kSqlSelCate`, `kSqlSelImg` and `kSqlSelAnnot`
+inline static CateRec cate_rec(sqlite3_stmt *stmt) {
+    return {sqlite3_column_int(stmt, 0), column_str(stmt, 1)};
+}
+
+inline static ImageRec image_rec(sqlite3_stmt *stmt) {
+    return {
+        sqlite3_column_int(stmt, 0),
+        column_str(stmt, 1),
+        column_str(stmt, 2),
+        sqlite3_column_int(stmt, 3),
+        sqlite3_column_int(stmt, 4),
+        column_str(stmt, 5),
+        column_str(stmt, 6),
+    };
+}
+
+inline static AnnotRec annot_rec(sqlite3_stmt *stmt) {
+    return {
+        sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1),
+        sqlite3_column_int(stmt, 2), sqlite3_column_int(stmt, 3),
+        sqlite3_column_int(stmt, 4), sqlite3_column_int(stmt, 5),
+        sqlite3_column_int(stmt, 6),
+        coco_scale(sqlite3_column_int(stmt, 7), sqlite3_column_int(stmt, 8)),
+    };
+}
+
+// Image rows of an EXIF database written by `exportExifDb`
+static void read_images_db(const std::string &db_exif,
+                           std::vector<ImageRow> &images) {
+    const DbCtx db_ctx = open_db(db_exif, SQLITE_OPEN_READONLY);
+    select_rows(db_ctx.get(), kSqlSelImagesDb, [&images](sqlite3_stmt *stmt) {
+        images.push_back({column_str(stmt, 0), column_str(stmt, 1),
+                          column_opt_int(stmt, 2), column_opt_int(stmt, 3),
+                          column_str(stmt, 4), column_str(stmt, 5)});
+    });
+}
+
+// Image row of an EXIF timestamp "YYYY-MM-DDTHH:MM:SS", split as by
+// `kSqlFillImages`
+inline static ImageRow to_image_row(std::string prefix, std::string image,
+                                    const std::optional<int> height,
+                                    const std::optional<int> width,
+                                    const std::string_view ts) {
+    const auto sub = [ts](const size_t pos, const size_t n) {
+        return pos < ts.size() ? std::string(ts.substr(pos, n)) : "";
+    };
+    return {std::move(prefix), std::move(image), height, width, sub(0, 10),
+            sub(11, 8)};
+}
+
+// Image rows of a columnar EXIF file, as by `bulk_insert_exif_columnar`
+static void read_images_columnar(const std::string &file,
+                                 std::vector<ImageRow> &images) {
+    const fdt::exif::ColumnarReader reader(file);
+    const auto height = reader.Column<int32_t>("height");
+    const auto width = reader.Column<int32_t>("width");
+    const auto timestamp = reader.Column<int64_t>("timestamp");
+    const auto opt_int = [](const int32_t v) -> std::optional<int> {
+        if (v == fdt::exif::fdtc::kNullI32) {
+            return std::nullopt;
+        }
+        return v;
+    };
+
+    for (size_t i = 0; i < reader.Size(); ++i) {
+        images.push_back(to_image_row(
+            std::filesystem::path(reader.Dir(i)).filename().string(),
+            std::string(reader.Name(i)), opt_int(height[i]),
+            opt_int(width[i]),
+            timestamp[i] == fdt::exif::fdtc::kNullI64
+                ? ""
+                : epoch_to_ts(timestamp[i])));
+    }
+}
+
+// Rows of the images without EXIF rows, their size probed from the frame
+// header of "<img_root>/<prefix>/<image>" on worker threads; the timestamp is
+// unknown. Images that cannot be read are left out, with a warning.
+static std::vector<ExifRow> probe_images(const std::string &img_root,
+                                         std::vector<ExifRow> keys) {
+    std::atomic<size_t> next{0};
+    const auto probe = [&]() {
+        for (size_t i = next++; i < keys.size(); i = next++) {
+            auto &row = keys[i];
+            std::ifstream is(std::filesystem::path(img_root) / row.prefix /
+                                 row.image,
+                             std::ios::binary);
+            jpeg::Size size;
+            if (is && jpeg::readSize(is, size)) {
+                row.height = size.height;
+                row.width = size.width;
+            }
+        }
+    };
+    const size_t n_threads = MIN2(size_t{utils::nThreads(0)}, keys.size());
+    std::vector<std::future<void>> futures;
+    for (size_t t = 0; t < n_threads; ++t) {
+        futures.push_back(std::async(std::launch::async, probe));
+    }
+    for (auto &fut : futures) {
+        fut.get();
     }
 
-    return js_img;
+    const size_t n_keys = keys.size();
+    std::erase_if(keys, [](const ExifRow &row) { return row.width == 0; });
+    if (keys.size() < n_keys) {
+        std::cerr << "Unable to probe the size of " << n_keys - keys.size()
+                  << " images under " << img_root << std::endl;
+    }
+    return keys;
 }
 
-inline static nlohmann::json::array_t cate2coco(sqlite3 *db) {
-    nlohmann::json::array_t js_cate;
+// Load `categories`, `images`, and `annotations` tables from flat files, or
+// the images from an EXIF database if `exif` is a file. Annotated images
+// without EXIF rows are probed under `img_root`, unless it is empty.
+static void load_db(sqlite3 *db, const std::string &dir_annot,
+                    const std::string &exif, const std::string &img_root) {
+    const bool kExifDb = std::filesystem::is_regular_file(exif);
+
+    // Load annotation & EXIF TSVs, and columnar EXIF files
+    bulk_insert_tsv(db, fdt::utils::listAllFiles(dir_annot, ".tsv"),
+                    kExifDb ? Paths{}
+                            : fdt::utils::listAllFiles(exif, ".tsv"));
+    if (!kExifDb) {
+        for (const auto &f : fdt::utils::listAllFiles(exif, ".fdtc")) {
+            bulk_insert_exif_columnar(db, f);
+        }
+    }
+    if (kExifDb) {
+        attach_db(db, kSqlAttachExif, exif);
+    }
+    if (!img_root.empty()) {
+        std::vector<ExifRow> keys;
+        select_rows(db, kExifDb ? kSqlSelMissingDb : kSqlSelMissing,
+                    [&keys](sqlite3_stmt *stmt) {
+                        keys.push_back({column_str(stmt, 0),
+                                        column_str(stmt, 1), 0, 0, ""});
+                    });
+        StmtCtx stmt_exif(prepare_stmt(db, kSqlImportExif));
+        exe_stmt(db, kSqlTransStart);
+        for (const auto &row : probe_images(img_root, std::move(keys))) {
+            insert_exif(db, stmt_exif.get(), row);
+        }
+        exe_stmt(db, kSqlCommit);
+    }
 
-    // Prepare the SQL statement to query the annotations table
-    sqlite3_stmt *stmt;
-    int rc = sqlite3_prepare_v2(db, kSqlSelCate, -1, &stmt, nullptr);
-    StmtCtx stmt_ctx(std::move(stmt));
+    // Populate `categories`, `images`, and `annotations` tables
+    exe_stmt(db, kSqlFillCategories);
+    if (kExifDb) {
+        exe_stmt(db, kSqlFillImagesDb);
+        exe_stmt(db, kSqlDetachExif);
+    } else {
+        exe_stmt(db, kSqlFillImages);
+    }
+    exe_stmt(db, kSqlFillAnnot);
+}
 
-    if (rc != SQLITE_OK) {
-        std::cerr << "Cannot prepare the SELECT statement: "
-                  << sqlite3_errmsg(db) << std::endl;
-        throw std::runtime_error("SQL error");
+// Join annotations to images in memory, assigning the ids the SQL statements
+// would: categories are the distinct names in order, images are all EXIF rows
+// in (prefix, image, height, width, date, time) order, and annotations are
+// the (image, category, box) tuples in order, one per matching image. Only
+// images with annotations are kept, as by `kSqlSelImg`.
+static Coco join_native(std::vector<AnnotRow> &annots,
+                        std::vector<ImageRow> &images) {
+    Coco coco;
+
+    // Categories: distinct names in byte order, as by SQLite's BINARY
+    std::vector<std::string_view> names;
+    names.reserve(annots.size());
+    for (const auto &a : annots) {
+        names.push_back(a.cate);
+    }
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    std::unordered_map<std::string_view, int> cate_ids;
+    for (size_t i = 0; i < names.size(); ++i) {
+        const int id = static_cast<int>(i + 1);
+        cate_ids.emplace(names[i], id);
+        coco.cates.push_back({id, std::string(names[i])});
     }
 
-    // Execute the query and process the results
-    while ((rc = sqlite3_step(stmt_ctx.get())) == SQLITE_ROW) {
-        // Create the annotation object
-        nlohmann::json js;
+    // Images: NULL dimensions sort first, as in SQLite
+    const auto key = [](const ImageRow &r) {
+        return std::tie(r.prefix, r.image, r.height, r.width, r.date, r.time);
+    };
+    std::sort(images.begin(), images.end(),
+              [&key](const ImageRow &a, const ImageRow &b) {
+                  return key(a) < key(b);
+              });
+
+    // Index (prefix, image) by interned ids; rows of equal keys are adjacent
+    // after sorting, so each key maps to a range of image ids
+    std::unordered_map<std::string_view, uint32_t> prefix_ids, image_ids;
+    const auto intern = [](auto &ids, const std::string_view sv) {
+        return ids.emplace(sv, static_cast<uint32_t>(ids.size()))
+            .first->second;
+    };
+    const auto pack = [](const uint32_t p, const uint32_t i) {
+        return (static_cast<uint64_t>(p) << 32) | i;
+    };
+    std::unordered_map<uint64_t, std::pair<size_t, size_t>> index;
+    index.reserve(images.size());
+    std::vector<float> scales(images.size()); // area scale by image
+    for (size_t i = 0; i < images.size(); ++i) {
+        scales[i] = coco_scale(images[i].width.value_or(0),
+                               images[i].height.value_or(0));
+        const uint64_t k = pack(intern(prefix_ids, images[i].prefix),
+                                intern(image_ids, images[i].image));
+        auto [it, fresh] = index.try_emplace(k, i, i + 1);
+        if (!fresh) {
+            it->second.second = i + 1;
+        }
+    }
 
-        const int id = sqlite3_column_int(stmt_ctx.get(), 0);
-        const auto cate = reinterpret_cast<const char *>(
-            sqlite3_column_text(stmt_ctx.get(), 1));
+    // Annotations: one per matching image, in (image, category, box) order
+    std::vector<AnnotRec> recs;
+    recs.reserve(annots.size());
+    for (const auto &a : annots) {
+        const auto kPrefix = prefix_ids.find(a.prefix);
+        const auto kImage = image_ids.find(a.image);
+        if (kPrefix == prefix_ids.end() || kImage == image_ids.end()) {
+            continue;
+        }
+        const auto kRange = index.find(pack(kPrefix->second, kImage->second));
+        if (kRange == index.end()) {
+            continue;
+        }
+        const int cate_id = cate_ids.at(a.cate);
+        for (size_t i = kRange->second.first; i < kRange->second.second; ++i) {
+            recs.push_back({0, static_cast<int>(i + 1), cate_id, a.x, a.y, a.w,
+                            a.h, scales[i]});
+        }
+    }
+    const auto rec_key = [](const AnnotRec &r) {
+        return std::tie(r.img_id, r.cate_id, r.x, r.y, r.w, r.h);
+    };
+    std::sort(recs.begin(), recs.end(),
+              [&rec_key](const AnnotRec &a, const AnnotRec &b) {
+                  return rec_key(a) < rec_key(b);
+              });
+    for (size_t i = 0; i < recs.size(); ++i) {
+        recs[i].id = static_cast<int>(i + 1);
+    }
 
-        js["id"] = id;
-        js["name"] = cate;
+    // Images with annotations, in id order
+    std::vector<bool> used(images.size(), false);
+    for (const auto &r : recs) {
+        used[r.img_id - 1] = true;
+    }
+    for (size_t i = 0; i < images.size(); ++i) {
+        if (!used[i]) {
+            continue;
+        }
+        auto &r = images[i];
+        coco.images.push_back({static_cast<int>(i + 1), std::move(r.prefix),
+                               std::move(r.image), r.height.value_or(0),
+                               r.width.value_or(0), std::move(r.date),
+                               std::move(r.time)});
+    }
+    coco.annots = std::move(recs);
+    return coco;
+}
 
-        // Add the categories to the JSON array
-        js_cate.push_back(js);
+// Load the rows of the flat files, or the images of an EXIF database if
+// `exif` is a file, probing annotated images without EXIF rows under
+// `img_root` unless it is empty
+static void load_rows(const std::string &dir_annot, const std::string &exif,
+                      const std::string &img_root,
+                      std::vector<AnnotRow> &annots,
+                      std::vector<ImageRow> &images) {
+    const bool kExifDb = std::filesystem::is_regular_file(exif);
+
+    scan_tsv(fdt::utils::listAllFiles(dir_annot, ".tsv"),
+             kExifDb ? Paths{} : fdt::utils::listAllFiles(exif, ".tsv"),
+             [&](RowBatch &batch) {
+                 std::move(batch.annots.begin(), batch.annots.end(),
+                           std::back_inserter(annots));
+                 for (auto &row : batch.exifs) {
+                     images.push_back(to_image_row(
+                         std::move(row.prefix), std::move(row.image),
+                         row.height, row.width, row.ts));
+                 }
+             });
+    if (kExifDb) {
+        read_images_db(exif, images);
+    } else {
+        for (const auto &f : fdt::utils::listAllFiles(exif, ".fdtc")) {
+            read_images_columnar(f, images);
+        }
+    }
+    if (img_root.empty()) {
+        return;
     }
 
-    if (rc != SQLITE_DONE) {
-        std::cerr << "Failed to execute the SELECT statement: "
-                  << sqlite3_errmsg(db) << std::endl;
-        throw std::runtime_error("SQL error");
+    std::unordered_set<std::string> known; // "<prefix>\t<image>"
+    for (const auto &img : images) {
+        known.insert(img.prefix + '\t' + img.image);
+    }
+    std::vector<ExifRow> keys;
+    for (const auto &a : annots) {
+        if (known.insert(a.prefix + '\t' + a.image).second) {
+            keys.push_back({a.prefix, a.image, 0, 0, ""});
+        }
+    }
+    for (auto &row : probe_images(img_root, std::move(keys))) {
+        images.push_back(to_image_row(std::move(row.prefix),
+                                      std::move(row.image), row.height,
+                                      row.width, row.ts));
     }
+}
 
-    return js_cate;
+// Load the flat files as by `load_rows` and join them without SQLite
+static Coco load_native(const std::string &dir_annot, const std::string &exif,
+                        const std::string &img_root) {
+    std::vector<AnnotRow> annots;
+    std::vector<ImageRow> images;
+    load_rows(dir_annot, exif, img_root, annots, images);
+    return join_native(annots, images);
 }
 
-static void db2coco(sqlite3 *db, std::ostream &output_stream) {
-    nlohmann::json coco_json;
+// Append a JSON string literal, escaped as by nlohmann::json: quotes,
+// backslashes and control characters; other bytes are copied as they are
+static void append_json_str(std::string &buf, const std::string_view sv) {
+    static constexpr char kHex[] = "0123456789abcdef";
+    buf += '"';
+    for (const char c : sv) {
+        switch (c) {
+        case '"':
+            buf += "\\\"";
+            break;
+        case '\\':
+            buf += "\\\\";
+            break;
+        case '\b':
+            buf += "\\b";
+            break;
+        case '\f':
+            buf += "\\f";
+            break;
+        case '\n':
+            buf += "\\n";
+            break;
+        case '\r':
+            buf += "\\r";
+            break;
+        case '\t':
+            buf += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                buf += "\\u00";
+                buf += kHex[(c >> 4) & 0xF];
+                buf += kHex[c & 0xF];
+            } else {
+                buf += c;
+            }
+        }
+    }
+    buf += '"';
+}
 
-    coco_json["categories"] = cate2coco(db);
-    coco_json["images"] = img2coco(db);
-    const int w_img = coco_json["images"][0]["width"].get<int>();
-    const int h_img = coco_json["images"][0]["height"].get<int>();
-    const float scale = kCoCoWidth * kCoCoHeight / w_img / h_img;
-    coco_json["annotations"] = annot2coco(db, scale);
+namespace {
+
+    // Writer of a JSON document straight to a stream, laid out as by
+    // nlohmann::json's `dump(4)`, or `dump()` if compact; members must be
+    // written in key order to match a dumped DOM. Output is buffered in blocks,
+    // so memory does not depend on the document size.
+    class JsonWriter {
+      public:
+        JsonWriter(std::ostream &out, const bool compact)
+            : out_(out), indent_(compact ? -1 : 4), after_key_(false) {}
 
-    // Write the JSON object to the output file
-    output_stream << coco_json.dump(4) << std::endl;
+        void BeginObject() { open('{'); }
+
+        void EndObject() { close('}'); }
+
+        void BeginArray() { open('['); }
+
+        void EndArray() { close(']'); }
+
+        void Key(const std::string_view key) {
+            element();
+            append_json_str(buf_, key);
+            buf_ += indent_ < 0 ? ":" : ": ";
+            after_key_ = true;
+        }
+
+        void Int(const int64_t v) {
+            element();
+            char str[24];
+            const auto kRes = std::to_chars(str, str + sizeof(str), v);
+            buf_.append(str, kRes.ptr);
+        }
+
+        // Floating-point numbers are rare enough to be formatted by nlohmann,
+        // which guarantees the digits of a dumped DOM
+        void Float(const double v) {
+            element();
+            buf_ += nlohmann::json(v).dump();
+        }
+
+        void Str(const std::string_view sv) {
+            element();
+            append_json_str(buf_, sv);
+        }
+
+        // End the document with a newline and flush it
+        void Finish() {
+            buf_ += '\n';
+            out_ << buf_;
+            out_.flush();
+            buf_.clear();
+        }
+
+      private:
+        static constexpr size_t kFlushSize = 1 << 16;
+
+        // Separator and indentation in front of a value or key
+        void element() {
+            if (after_key_) {
+                after_key_ = false;
+                return;
+            }
+            if (first_.empty()) {
+                return;
+            }
+            if (!first_.back()) {
+                buf_ += ',';
+            }
+            first_.back() = false;
+            newline(first_.size());
+        }
+
+        void newline(const size_t depth) {
+            if (indent_ >= 0) {
+                buf_ += '\n';
+                buf_.append(indent_ * depth, ' ');
+            }
+        }
+
+        void open(const char c) {
+            element();
+            buf_ += c;
+            first_.push_back(true);
+        }
+
+        void close(const char c) {
+            const bool kEmpty = first_.back();
+            first_.pop_back();
+            if (!kEmpty) {
+                newline(first_.size());
+            }
+            buf_ += c;
+            if (buf_.size() >= kFlushSize) {
+                out_ << buf_;
+                buf_.clear();
+            }
+        }
+
+        std::ostream &out_;
+        const int indent_;
+        std::string buf_;
+        std::vector<bool> first_; // per open container: no element yet
+        bool after_key_;
+    };
+
+} // namespace
+
+// COCO records, with their members in key order
+static void write_cate(JsonWriter &js, const CateRec &c) {
+    js.BeginObject();
+    js.Key("id");
+    js.Int(c.id);
+    js.Key("name");
+    js.Str(c.name);
+    js.EndObject();
 }
 
-void annot::toCoco(const std::string &dir_annot, const std::string &dir_exif,
-                   std::ostream &output_stream) {
+static void write_image(JsonWriter &js, const ImageRec &img) {
+    js.BeginObject();
+    js.Key("date_captured");
+    js.Str(img.date + " " + img.time);
+    js.Key("file_name");
+    js.Str(img.prefix + "/" + img.image);
+    js.Key("height");
+    js.Int(img.height);
+    js.Key("id");
+    js.Int(img.id);
+    js.Key("width");
+    js.Int(img.width);
+    js.EndObject();
+}
+
+static void write_annot(JsonWriter &js, const AnnotRec &a) {
+    // during evaluation, mmdet will determine small / medium / large
+    // based on the area of the bounding box; according to the definition
+    // of COCO dataset (resolution 640x480), the small and medium areas in
+    // an image are less than 1024 (32*32), 9216 (96*96), respectively
+    // Here we scale the area to the COCO dataset resolution to simulate the
+    // same behavior; scale = 640*480/(resolution of the image)
+    const float area = a.w * a.h * a.scale;
+
+    js.BeginObject();
+    js.Key("area");
+    js.Float(area);
+    js.Key("bbox");
+    js.BeginArray();
+    js.Int(a.x);
+    js.Int(a.y);
+    js.Int(a.w);
+    js.Int(a.h);
+    js.EndArray();
+    js.Key("category_id");
+    js.Int(a.cate_id);
+    js.Key("id");
+    js.Int(a.id);
+    js.Key("image_id");
+    js.Int(a.img_id);
+    js.Key("iscrowd");
+    js.Int(0);
+    js.EndObject();
+}
+
+namespace {
+
+    // COCO document written record by record. Records must arrive section by
+    // section in key order: annotations, categories, then images.
+    class CocoStream {
+      public:
+        CocoStream(std::ostream &out, const bool compact)
+            : js_(out, compact), section_(-1) {
+            js_.BeginObject();
+        }
+
+        void Annot(const AnnotRec &a) {
+            section(0);
+            write_annot(js_, a);
+        }
+
+        void Cate(const CateRec &c) {
+            section(1);
+            write_cate(js_, c);
+        }
+
+        void Image(const ImageRec &img) {
+            section(2);
+            write_image(js_, img);
+        }
+
+        // Close the document; sections without records are written empty
+        void Finish() {
+            section(2);
+            js_.EndArray();
+            js_.EndObject();
+            js_.Finish();
+        }
+
+      private:
+        static constexpr std::array<const char *, 3> kSections = {
+            "annotations", "categories", "images"};
+
+        // Close the current section and open the following ones up to `s`
+        void section(const int s) {
+            while (section_ < s) {
+                if (section_ >= 0) {
+                    js_.EndArray();
+                }
+                ++section_;
+                js_.Key(kSections[section_]);
+                js_.BeginArray();
+            }
+        }
+
+        JsonWriter js_;
+        int section_;
+    };
+
+    // COCO records of the filled tables, read one cursor row at a time
+    struct DbRecords {
+        sqlite3 *db;
+
+        template <typename Fn> void Annots(Fn fn) const {
+            select_rows(db, kSqlSelAnnot,
+                        [&fn](sqlite3_stmt *stmt) { fn(annot_rec(stmt)); });
+        }
+
+        template <typename Fn> void Cates(Fn fn) const {
+            select_rows(db, kSqlSelCate,
+                        [&fn](sqlite3_stmt *stmt) { fn(cate_rec(stmt)); });
+        }
+
+        template <typename Fn> void Images(Fn fn) const {
+            select_rows(db, kSqlSelImg,
+                        [&fn](sqlite3_stmt *stmt) { fn(image_rec(stmt)); });
+        }
+    };
+
+    // COCO records joined by the native backend
+    struct CocoRecords {
+        const Coco &coco;
+
+        template <typename Fn> void Annots(Fn fn) const {
+            std::for_each(coco.annots.begin(), coco.annots.end(), fn);
+        }
+
+        template <typename Fn> void Cates(Fn fn) const {
+            std::for_each(coco.cates.begin(), coco.cates.end(), fn);
+        }
+
+        template <typename Fn> void Images(Fn fn) const {
+            std::for_each(coco.images.begin(), coco.images.end(), fn);
+        }
+    };
+
+    // Records on their way to the writer of one part file
+    struct CocoBatch {
+        size_t part = 0; // index of the part file
+        std::vector<AnnotRec> annots;
+        std::vector<CateRec> cates;
+        std::vector<ImageRec> images;
+
+        size_t Size() const {
+            return annots.size() + cates.size() + images.size();
+        }
+    };
+
+    static constexpr std::array<const char *, 3> kSplitNames = {
+        "train", "val", "test"};
+
+} // namespace
+
+// Write the COCO document of `recs` (`DbRecords` or `CocoRecords`)
+template <typename Records>
+static void write_coco(std::ostream &out, const bool compact,
+                       const Records &recs) {
+    CocoStream cs(out, compact);
+    recs.Annots([&cs](const AnnotRec &a) { cs.Annot(a); });
+    recs.Cates([&cs](const CateRec &c) { cs.Cate(c); });
+    recs.Images([&cs](const ImageRec &img) { cs.Image(img); });
+    cs.Finish();
+}
+
+// 64-bit FNV-1a hash; unlike std::hash it is the same on every platform
+inline static constexpr uint64_t fnv1a(const std::string_view sv,
+                                       uint64_t h = 0xcbf29ce484222325ULL) {
+    for (const char c : sv) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// Finaliser of splitmix64, decorrelating the shard from the split
+inline static constexpr uint64_t mix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Index of the part file of an image, i.e. split * shards + shard
+static size_t part_of(const std::string &prefix, const std::string &image,
+                      const annot::CocoOpts &opts) {
+    const uint64_t kKey = fnv1a(image, fnv1a("/", fnv1a(prefix)));
+    size_t split = 0;
+    if (opts.split_by != annot::SplitBy::NONE) {
+        const uint64_t kHash =
+            opts.split_by == annot::SplitBy::PREFIX ? fnv1a(prefix) : kKey;
+        uint64_t r = kHash % (opts.split[0] + opts.split[1] + opts.split[2]);
+        while (r >= opts.split[split]) {
+            r -= opts.split[split];
+            ++split;
+        }
+    }
+    return split * opts.shards + mix64(kKey) % opts.shards;
+}
+
+static void check_parts(const annot::CocoOpts &opts) {
+    if (opts.shards == 0) {
+        throw std::invalid_argument("The number of shards must be positive");
+    }
+    if (opts.split_by != annot::SplitBy::NONE &&
+        opts.split[0] + opts.split[1] + opts.split[2] == 0) {
+        throw std::invalid_argument("The split weights must not all be 0");
+    }
+}
+
+// Paths of the part files, "<stem>[.<split>][.<k>-of-<n>]<ext>" in part order,
+// e.g. "coco.train.00001-of-00004.json"
+static Paths part_paths(const std::string &path, const annot::CocoOpts &opts) {
+    check_parts(opts);
+    const std::filesystem::path kPath(path);
+    const std::string kStem = (kPath.parent_path() / kPath.stem()).string();
+    const std::string kExt = kPath.extension().string();
+    const size_t n_splits =
+        opts.split_by == annot::SplitBy::NONE ? 1 : kSplitNames.size();
+
+    Paths paths;
+    for (size_t split = 0; split < n_splits; ++split) {
+        for (unsigned shard = 0; shard < opts.shards; ++shard) {
+            std::string name = kStem;
+            if (n_splits > 1) {
+                name += std::string(".") + kSplitNames[split];
+            }
+            if (opts.shards > 1) {
+                char buf[32];
+                std::snprintf(buf, sizeof(buf), ".%05u-of-%05u", shard,
+                              opts.shards);
+                name += buf;
+            }
+            paths.push_back(name + kExt);
+        }
+    }
+    return paths;
+}
+
+// Write the records into the part files on at most `utils::nThreads` writer
+// threads, part `i` going to writer `i % n_writers` through its bounded queue
+// of record batches. A single pass over the records routes every image and
+// its annotations to the part of its key, and every category to all parts;
+// ids stay those of the whole dataset.
+template <typename Records>
+static void write_parts(const Paths &paths, const annot::CocoOpts &opts,
+                        const Records &recs) {
+    std::vector<uint32_t> img_part; // by image id
+    recs.Images([&img_part, &opts](const ImageRec &img) {
+        if (static_cast<size_t>(img.id) >= img_part.size()) {
+            img_part.resize(img.id + 1, 0);
+        }
+        img_part[img.id] =
+            static_cast<uint32_t>(part_of(img.prefix, img.image, opts));
+    });
+
+    const size_t n_writers = MIN2(size_t{utils::nThreads(0)}, paths.size());
+    std::vector<std::unique_ptr<utils::BoundedQueue<CocoBatch>>> queues;
+    for (size_t w = 0; w < n_writers; ++w) {
+        queues.push_back(std::make_unique<utils::BoundedQueue<CocoBatch>>(
+            kBatchesPerThread));
+    }
+    const auto write = [&](const size_t w) {
+        auto &queue = *queues[w];
+        try {
+            // parts w, w + n_writers, ...; addresses stay put in a deque
+            std::deque<std::ofstream> outs;
+            std::deque<CocoStream> streams;
+            for (size_t i = w; i < paths.size(); i += n_writers) {
+                outs.emplace_back(paths[i]);
+                streams.emplace_back(outs.back(), opts.compact);
+            }
+            while (auto batch = queue.Pop()) {
+                auto &cs = streams[batch->part / n_writers];
+                for (const auto &a : batch->annots) {
+                    cs.Annot(a);
+                }
+                for (const auto &c : batch->cates) {
+                    cs.Cate(c);
+                }
+                for (const auto &img : batch->images) {
+                    cs.Image(img);
+                }
+            }
+            for (size_t k = 0; k < streams.size(); ++k) {
+                streams[k].Finish();
+                if (!outs[k]) {
+                    throw std::runtime_error("Unable to write: " +
+                                             paths[w + k * n_writers]);
+                }
+            }
+        } catch (...) {
+            queue.Close();
+            throw;
+        }
+    };
+
+    std::vector<CocoBatch> pending(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+        pending[i].part = i;
+    }
+    const auto flush = [&](const size_t i, const size_t min_size) {
+        if (pending[i].Size() < std::max(min_size, size_t{1})) {
+            return;
+        }
+        CocoBatch batch = std::exchange(pending[i], {});
+        pending[i].part = i;
+        // a writer closes its queue when it fails
+        if (!queues[i % n_writers]->Push(std::move(batch))) {
+            throw std::runtime_error("Writer of " + paths[i] + " stopped");
+        }
+    };
+
+    // Declared after the queues, so destroyed first: every path out of the
+    // try block closes the queues before the futures wait for the writers.
+    std::vector<std::future<void>> futures;
+    try {
+        for (size_t w = 0; w < n_writers; ++w) {
+            futures.push_back(std::async(std::launch::async, write, w));
+        }
+        recs.Annots([&](const AnnotRec &a) {
+            const size_t i = img_part[a.img_id];
+            pending[i].annots.push_back(a);
+            flush(i, kRowsPerBatch);
+        });
+        recs.Cates([&](const CateRec &c) {
+            for (size_t i = 0; i < paths.size(); ++i) {
+                pending[i].cates.push_back(c);
+                flush(i, kRowsPerBatch);
+            }
+        });
+        recs.Images([&](const ImageRec &img) {
+            const size_t i = img_part[img.id];
+            pending[i].images.push_back(img);
+            flush(i, kRowsPerBatch);
+        });
+        for (size_t i = 0; i < paths.size(); ++i) {
+            flush(i, 0);
+        }
+    } catch (...) {
+        for (auto &queue : queues) {
+            queue->Close();
+        }
+        // the error of a failed writer explains a stopped routing
+        for (auto &fut : futures) {
+            fut.get();
+        }
+        throw;
+    }
+    for (auto &queue : queues) {
+        queue->Close();
+    }
+
+    // Rethrow the first writing error
+    for (auto &fut : futures) {
+        fut.get();
+    }
+}
+
+namespace {
+
+    static constexpr size_t kAreaBins = 32; // log2 bins of box areas
+    // Annotations aggregated by one thread before merging
+    static constexpr size_t kStatRowsPerThread = 1 << 16;
+
+    // Dictionary encoding of a string column
+    class Dict {
+      public:
+        uint32_t Code(const std::string &s) {
+            const auto [it, fresh] =
+                codes_.try_emplace(s, static_cast<uint32_t>(names_.size()));
+            if (fresh) {
+                names_.push_back(s);
+            }
+            return it->second;
+        }
+
+        const std::vector<std::string> &Names() const { return names_; }
+
+        size_t Size() const { return names_.size(); }
+
+      private:
+        std::unordered_map<std::string, uint32_t> codes_;
+        std::vector<std::string> names_;
+    };
+
+    // Annotations joined to their images, one array per field; the string
+    // fields are codes of the dictionaries
+    struct StatCols {
+        Dict cates, levels, prefixes, days;
+        std::vector<uint32_t> cate, level, prefix, day;
+        std::vector<int64_t> area;    // w * h in image pixels
+        std::vector<float> coco_area; // scaled by image as by `toCoco`
+        std::vector<uint64_t> prefix_images, day_images; // annotated images
+        uint64_t images = 0;
+        uint64_t unmatched = 0; // annotations of no image
+    };
+
+    // Counts, area sums and histograms of a group of annotations. Bin k of a
+    // histogram counts the areas in [2^k, 2^(k+1)), bin 0 also those below 1.
+    // Non-finite COCO areas, of images of unknown size, are only counted.
+    struct Tally {
+        uint64_t count = 0;
+        double area = 0.0;
+        double coco_area = 0.0;
+        std::array<uint64_t, kAreaBins> hist{};
+        std::array<uint64_t, kAreaBins> coco_hist{};
+        std::array<uint64_t, 3> coco_size{};
+        uint64_t coco_unknown = 0;
+
+        void Add(const int64_t a, const float coco_a) {
+            ++count;
+            area += static_cast<double>(a);
+            ++hist[a < 1 ? 0 : bin(std::bit_width(static_cast<uint64_t>(a)))];
+            if (!std::isfinite(coco_a)) {
+                ++coco_unknown;
+                return;
+            }
+            coco_area += coco_a;
+            ++coco_hist[coco_a < 1.0f ? 0 : bin(std::ilogb(coco_a) + 1)];
+            ++coco_size[coco_a < annot::kCocoMedium  ? 0
+                        : coco_a < annot::kCocoLarge ? 1
+                                                     : 2];
+        }
+
+        // Bin of an area of `width` significant bits
+        static size_t bin(const int width) {
+            return MIN2(static_cast<size_t>(width - 1), kAreaBins - 1);
+        }
+
+        Tally &operator+=(const Tally &o) {
+            count += o.count;
+            area += o.area;
+            coco_area += o.coco_area;
+            for (size_t k = 0; k < kAreaBins; ++k) {
+                hist[k] += o.hist[k];
+                coco_hist[k] += o.coco_hist[k];
+            }
+            for (size_t k = 0; k < coco_size.size(); ++k) {
+                coco_size[k] += o.coco_size[k];
+            }
+            coco_unknown += o.coco_unknown;
+            return *this;
+        }
+    };
+
+    // Tallies of a range of annotations by every breakdown
+    struct StatAgg {
+        Tally total;
+        std::vector<Tally> cates, levels, prefixes, days;
+        std::vector<uint64_t> cate_levels; // by cate * #levels + level
+
+        explicit StatAgg(const StatCols &c)
+            : cates(c.cates.Size()), levels(c.levels.Size()),
+              prefixes(c.prefixes.Size()), days(c.days.Size()),
+              cate_levels(c.cates.Size() * c.levels.Size(), 0) {}
+
+        void Add(const StatCols &c, const size_t i) {
+            const int64_t kArea = c.area[i];
+            const float kCocoArea = c.coco_area[i];
+            total.Add(kArea, kCocoArea);
+            cates[c.cate[i]].Add(kArea, kCocoArea);
+            levels[c.level[i]].Add(kArea, kCocoArea);
+            prefixes[c.prefix[i]].Add(kArea, kCocoArea);
+            days[c.day[i]].Add(kArea, kCocoArea);
+            ++cate_levels[c.cate[i] * levels.size() + c.level[i]];
+        }
+
+        StatAgg &operator+=(const StatAgg &o) {
+            total += o.total;
+            const auto merge = [](auto &dst, const auto &src) {
+                for (size_t k = 0; k < dst.size(); ++k) {
+                    dst[k] += src[k];
+                }
+            };
+            merge(cates, o.cates);
+            merge(levels, o.levels);
+            merge(prefixes, o.prefixes);
+            merge(days, o.days);
+            merge(cate_levels, o.cate_levels);
+            return *this;
+        }
+    };
+
+} // namespace
+
+// Join annotations to images into columns as the SQL statements would: an
+// annotation counts once per matching image, and its area is scaled by the
+// resolution of that image.
+static StatCols stat_cols(const std::vector<AnnotRow> &annots,
+                          std::vector<ImageRow> &images) {
+    const auto key = [](const ImageRow &r) {
+        return std::tie(r.prefix, r.image, r.height, r.width, r.date, r.time);
+    };
+    std::sort(images.begin(), images.end(),
+              [&key](const ImageRow &a, const ImageRow &b) {
+                  return key(a) < key(b);
+              });
+    // "<prefix>\t<image>" to its range of image ids; fields have no tabs
+    std::unordered_map<std::string, std::pair<size_t, size_t>> index;
+    index.reserve(images.size());
+    // area scale by image, NaN if the size is unknown: not a COCO area of 0
+    std::vector<float> scales(images.size());
+    for (size_t i = 0; i < images.size(); ++i) {
+        const float kScale = coco_scale(images[i].width.value_or(0),
+                                        images[i].height.value_or(0));
+        scales[i] = kScale > 0.0f ? kScale
+                                  : std::numeric_limits<float>::quiet_NaN();
+        auto [it, fresh] = index.try_emplace(
+            images[i].prefix + '\t' + images[i].image, i, i + 1);
+        if (!fresh) {
+            it->second.second = i + 1;
+        }
+    }
+
+    StatCols c;
+    std::vector<std::pair<size_t, size_t>> ranges(annots.size(), {0, 0});
+    for (size_t k = 0; k < annots.size(); ++k) {
+        const auto kRange = index.find(annots[k].prefix + '\t' +
+                                       annots[k].image);
+        if (kRange == index.end()) {
+            ++c.unmatched;
+            continue;
+        }
+        ranges[k] = kRange->second;
+    }
+
+    // Only joined rows are encoded, so that every name has annotations
+    std::vector<uint32_t> day_of(images.size());
+    std::vector<bool> used(images.size(), false);
+    for (size_t k = 0; k < annots.size(); ++k) {
+        const auto &a = annots[k];
+        if (ranges[k].first == ranges[k].second) {
+            continue;
+        }
+        const uint32_t kCate = c.cates.Code(a.cate);
+        const uint32_t kLevel = c.levels.Code(a.level);
+        const uint32_t kPrefix = c.prefixes.Code(a.prefix);
+        const int64_t kArea = static_cast<int64_t>(a.w) * a.h;
+        for (size_t i = ranges[k].first; i < ranges[k].second; ++i) {
+            c.cate.push_back(kCate);
+            c.level.push_back(kLevel);
+            c.prefix.push_back(kPrefix);
+            c.area.push_back(kArea);
+            c.coco_area.push_back(static_cast<float>(kArea) * scales[i]);
+            if (!used[i]) {
+                used[i] = true;
+                day_of[i] = c.days.Code(images[i].date);
+            }
+            c.day.push_back(day_of[i]);
+        }
+    }
+
+    c.prefix_images.assign(c.prefixes.Size(), 0);
+    c.day_images.assign(c.days.Size(), 0);
+    for (size_t i = 0; i < images.size(); ++i) {
+        if (!used[i]) {
+            continue;
+        }
+        ++c.images;
+        ++c.prefix_images[c.prefixes.Code(images[i].prefix)];
+        ++c.day_images[day_of[i]];
+    }
+    return c;
+}
+
+// Aggregate the columns in ranges of rows on worker threads, then merge
+static StatAgg aggregate(const StatCols &c) {
+    const size_t kRows = c.area.size();
+    const size_t kThreads =
+        MAX2(MIN2(size_t{utils::nThreads(0)}, kRows / kStatRowsPerThread),
+             size_t{1});
+    const size_t kChunk = (kRows + kThreads - 1) / kThreads;
+    std::vector<std::future<StatAgg>> futures;
+    for (size_t t = 0; t < kThreads; ++t) {
+        futures.push_back(std::async(std::launch::async, [&c, t, kChunk]() {
+            StatAgg agg(c);
+            const size_t kEnd = MIN2((t + 1) * kChunk, c.area.size());
+            for (size_t i = t * kChunk; i < kEnd; ++i) {
+                agg.Add(c, i);
+            }
+            return agg;
+        }));
+    }
+    StatAgg agg(c);
+    for (auto &fut : futures) {
+        agg += fut.get();
+    }
+    return agg;
+}
+
+// Histogram without its trailing empty bins
+static nlohmann::json hist_json(const std::array<uint64_t, kAreaBins> &hist) {
+    size_t n = kAreaBins;
+    while (n > 0 && hist[n - 1] == 0) {
+        --n;
+    }
+    return std::vector<uint64_t>(hist.begin(), hist.begin() + n);
+}
+
+static nlohmann::json tally_json(const Tally &t) {
+    return {
+        {"count", t.count},
+        {"area", t.area},
+        {"coco_area", t.coco_area},
+        {"histogram", hist_json(t.hist)},
+        {"coco_histogram", hist_json(t.coco_hist)},
+        {"coco_size",
+         {{"small", t.coco_size[0]},
+          {"medium", t.coco_size[1]},
+          {"large", t.coco_size[2]},
+          {"unknown", t.coco_unknown}}},
+    };
+}
+
+// Key of a name in the output, e.g. the date of an image without timestamp
+inline static std::string stat_key(const std::string &name) {
+    return name.empty() ? "unknown" : name;
+}
+
+// Tallies of a breakdown by name, with the number of annotated images of each
+// name if given
+static nlohmann::json group_json(const Dict &dict,
+                                 const std::vector<Tally> &tallies,
+                                 const std::vector<uint64_t> *images) {
+    nlohmann::json group = nlohmann::json::object();
+    for (size_t k = 0; k < tallies.size(); ++k) {
+        auto &entry = group[stat_key(dict.Names()[k])];
+        entry = tally_json(tallies[k]);
+        if (images) {
+            entry["images"] = (*images)[k];
+        }
+    }
+    return group;
+}
+
+// Schema version of an annotation database; 0 if it is a new file
+static int annot_db_version(sqlite3 *db, const char *sql_version) {
+    int version = 0;
+    select_rows(db, sql_version, [&version](sqlite3_stmt *stmt) {
+        version = sqlite3_column_int(stmt, 0);
+    });
+    if (version != 0 && version != kAnnotDbVersion) {
+        throw std::runtime_error("Unsupported annotation database version " +
+                                 std::to_string(version));
+    }
+    return version;
+}
+
+// Read the raw tables of an annotation database and join them natively
+static Coco load_native_db(const std::string &db_file) {
+    const DbCtx db_ctx = open_db(db_file, SQLITE_OPEN_READONLY);
+    sqlite3 *db = db_ctx.get();
+    if (annot_db_version(db, "PRAGMA user_version;") == 0) {
+        throw std::runtime_error("Not an annotation database: " + db_file);
+    }
+
+    std::vector<AnnotRow> annots;
+    std::vector<ImageRow> images;
+    select_rows(db, kSqlSelRawAnnot, [&annots](sqlite3_stmt *stmt) {
+        annots.push_back({
+            column_str(stmt, 0),
+            column_str(stmt, 1),
+            column_str(stmt, 2),
+            column_str(stmt, 3),
+            sqlite3_column_int(stmt, 4),
+            sqlite3_column_int(stmt, 5),
+            sqlite3_column_int(stmt, 6),
+            sqlite3_column_int(stmt, 7),
+        });
+    });
+    select_rows(db, kSqlSelRawExif, [&images](sqlite3_stmt *stmt) {
+        images.push_back(to_image_row(
+            column_str(stmt, 0), column_str(stmt, 1), column_opt_int(stmt, 2),
+            column_opt_int(stmt, 3), column_str(stmt, 4)));
+    });
+    return join_native(annots, images);
+}
+
+void annot::updateDb(const std::string &db_file, const std::string &dir_annot,
+                     const std::string &dir_exif, const bool append) {
+    const DbCtx db_ctx =
+        open_db(db_file, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+    sqlite3 *db = db_ctx.get();
+    // Create the schema and set its version atomically, so that an
+    // interrupted run leaves either a new database or a complete one
+    exe_stmt(db, kSqlTransStart);
+    if (annot_db_version(db, "PRAGMA user_version;") == 0) {
+        exe_stmt(db, kSqlNewRaw);
+        exe_stmt(db, kSqlNewRawIndexes);
+        exe_stmt(db, "PRAGMA user_version = " +
+                         std::to_string(kAnnotDbVersion) + ";");
+    }
+    exe_stmt(db, kSqlCommit);
+
+    // Stage the new rows, so that the database is only locked for the merge
+    const auto files = [](const std::string &dir, const std::string &ext) {
+        return dir.empty() ? Paths{} : fdt::utils::listAllFiles(dir, ext);
+    };
+    exe_stmt(db, kSqlNewStage);
+    bulk_insert_tsv(db, files(dir_annot, ".tsv"), files(dir_exif, ".tsv"),
+                    kSqlStageAnnot, kSqlStageExif);
+    for (const auto &f : files(dir_exif, ".fdtc")) {
+        bulk_insert_exif_columnar(db, f, kSqlStageExif);
+    }
+
+    exe_stmt(db, kSqlTransStart);
+    if (!append) {
+        exe_stmt(db, kSqlDelStaged);
+    }
+    exe_stmt(db, kSqlMergeStage);
+    exe_stmt(db, kSqlCommit);
+}
+
+// In-memory database with the COCO tables filled from the flat files as by
+// `load_db`
+static DbCtx filled_db(const std::string &dir_annot, const std::string &exif,
+                       const std::string &img_root) {
     sqlite3 *db = nullptr;
     init_db(&db);
     DbCtx db_ctx(std::move(db), sqlite3_close);
+    exe_stmt(db_ctx.get(), kSqlPragmas);
 
     // Create tables
+    exe_stmt(db_ctx.get(), kSqlNewRaw);
     exe_stmt(db_ctx.get(), kSqlNew);
+    exe_stmt(db_ctx.get(), kSqlNewImages);
 
     // Load data
-    load_db(db_ctx.get(), dir_annot, dir_exif);
+    load_db(db_ctx.get(), dir_annot, exif, img_root);
 
     // Drop raw tables
     exe_stmt(db_ctx.get(), kSqlDropRaw);
-
-    // Convert to COCO
-    db2coco(db_ctx.get(), output_stream);
+    return db_ctx;
 }
 
-void annot::print(const std::string &dir_annot, const std::string &dir_exif) {
-
+// In-memory database with the COCO tables filled from an annotation
+// database. The raw tables of the attached file are found by the unqualified
+// names of the fill statements, as the in-memory database has none of its
+// own.
+static DbCtx filled_db_from(const std::string &db_file) {
+    if (!std::filesystem::is_regular_file(db_file)) {
+        throw std::runtime_error("No such annotation database: " + db_file);
+    }
     sqlite3 *db = nullptr;
     init_db(&db);
     DbCtx db_ctx(std::move(db), sqlite3_close);
-
-    // Create tables
+    exe_stmt(db_ctx.get(), kSqlPragmas);
     exe_stmt(db_ctx.get(), kSqlNew);
+    exe_stmt(db_ctx.get(), kSqlNewImages);
 
-    // Load data
-    load_db(db_ctx.get(), dir_annot, dir_exif);
+    attach_db(db_ctx.get(), kSqlAttachAnnot, db_file);
+    if (annot_db_version(db_ctx.get(), "PRAGMA annot_db.user_version;") ==
+        0) {
+        throw std::runtime_error("Not an annotation database: " + db_file);
+    }
+    exe_stmt(db_ctx.get(), kSqlFillCategories);
+    exe_stmt(db_ctx.get(), kSqlFillImages);
+    exe_stmt(db_ctx.get(), kSqlFillAnnot);
+    exe_stmt(db_ctx.get(), kSqlDetachAnnot);
+    return db_ctx;
+}
 
-    // Drop raw tables
-    exe_stmt(db_ctx.get(), kSqlDropRaw);
+// A stream takes a single document
+static void check_single(const annot::CocoOpts &opts) {
+    if (opts.split_by != annot::SplitBy::NONE || opts.shards != 1) {
+        throw std::invalid_argument("Splits and shards need an output path");
+    }
+}
+
+void annot::dbToCoco(const std::string &db_file, std::ostream &output_stream,
+                     const CocoOpts &opts) {
+    check_single(opts);
+    if (opts.backend == Backend::NATIVE) {
+        const Coco kCoco = load_native_db(db_file);
+        write_coco(output_stream, opts.compact, CocoRecords{kCoco});
+        return;
+    }
+    const DbCtx db_ctx = filled_db_from(db_file);
+    write_coco(output_stream, opts.compact, DbRecords{db_ctx.get()});
+}
+
+Paths annot::dbToCocoFiles(const std::string &db_file, const std::string &path,
+                           const CocoOpts &opts) {
+    const Paths paths = part_paths(path, opts);
+    if (opts.backend == Backend::NATIVE) {
+        const Coco kCoco = load_native_db(db_file);
+        write_parts(paths, opts, CocoRecords{kCoco});
+    } else {
+        const DbCtx db_ctx = filled_db_from(db_file);
+        write_parts(paths, opts, DbRecords{db_ctx.get()});
+    }
+    return paths;
+}
+
+void annot::toCoco(const std::string &dir_annot, const std::string &dir_exif,
+                   std::ostream &output_stream, const CocoOpts &opts) {
+    check_single(opts);
+    if (opts.backend == Backend::NATIVE) {
+        const Coco kCoco = load_native(dir_annot, dir_exif, opts.img_root);
+        write_coco(output_stream, opts.compact, CocoRecords{kCoco});
+        return;
+    }
+    const DbCtx db_ctx = filled_db(dir_annot, dir_exif, opts.img_root);
+    write_coco(output_stream, opts.compact, DbRecords{db_ctx.get()});
+}
+
+Paths annot::toCocoFiles(const std::string &dir_annot,
+                         const std::string &dir_exif, const std::string &path,
+                         const CocoOpts &opts) {
+    const Paths paths = part_paths(path, opts);
+    if (opts.backend == Backend::NATIVE) {
+        const Coco kCoco = load_native(dir_annot, dir_exif, opts.img_root);
+        write_parts(paths, opts, CocoRecords{kCoco});
+    } else {
+        const DbCtx db_ctx = filled_db(dir_annot, dir_exif, opts.img_root);
+        write_parts(paths, opts, DbRecords{db_ctx.get()});
+    }
+    return paths;
+}
+
+void annot::stats(const std::string &dir_annot, const std::string &dir_exif,
+                  std::ostream &output_stream) {
+    std::vector<AnnotRow> annots;
+    std::vector<ImageRow> images;
+    load_rows(dir_annot, dir_exif, "", annots, images);
+    const StatCols kCols = stat_cols(annots, images);
+    const StatAgg kAgg = aggregate(kCols);
+
+    nlohmann::json out = {
+        {"images", kCols.images},
+        {"unmatched", kCols.unmatched},
+        {"total", tally_json(kAgg.total)},
+        {"categories", group_json(kCols.cates, kAgg.cates, nullptr)},
+        {"levels", group_json(kCols.levels, kAgg.levels, nullptr)},
+        {"prefixes",
+         group_json(kCols.prefixes, kAgg.prefixes, &kCols.prefix_images)},
+        {"days", group_json(kCols.days, kAgg.days, &kCols.day_images)},
+    };
+    const auto &kCates = kCols.cates.Names();
+    const auto &kLevels = kCols.levels.Names();
+    for (size_t i = 0; i < kCates.size(); ++i) {
+        auto &levels = out["categories"][stat_key(kCates[i])]["levels"];
+        levels = nlohmann::json::object();
+        for (size_t j = 0; j < kLevels.size(); ++j) {
+            const uint64_t kCount = kAgg.cate_levels[i * kLevels.size() + j];
+            if (kCount > 0) {
+                levels[stat_key(kLevels[j])] = kCount;
+            }
+        }
+    }
+    output_stream << out.dump(4) << std::endl;
+}
+
+void annot::print(const std::string &dir_annot, const std::string &dir_exif) {
+    const DbCtx db_ctx = filled_db(dir_annot, dir_exif, "");
 
     // Count the #annotations
     process(db_ctx.get(), "SELECT count(1) FROM annotations;", cb_print_int);
@@ -550,3 +2125,75 @@ void annot::print(const std::string &dir_annot, const std::string &dir_exif) {
     // Print the EXIF data
     process(db_ctx.get(), kSqlSelImg, cb_print_exif);
 }
+
+void annot::exportExifDb(const std::string &dir, const std::string &db_file,
+                         const exif::ExportOpts &opts) {
+    // Start from an empty database
+    std::filesystem::remove(db_file);
+    sqlite3 *db = nullptr;
+    if (sqlite3_open(db_file.c_str(), &db) != SQLITE_OK) {
+        std::cerr << "Can't open database: " << sqlite3_errmsg(db)
+                  << std::endl;
+        sqlite3_close(db);
+        throw std::runtime_error("SQL error");
+    }
+    DbCtx db_ctx(std::move(db), sqlite3_close);
+    exe_stmt(db_ctx.get(), kSqlNewImages);
+
+    sqlite3_stmt *stmt = nullptr;
+    int rc =
+        sqlite3_prepare_v2(db_ctx.get(), kSqlImportImage, -1, &stmt, nullptr);
+    StmtCtx stmt_ctx(std::move(stmt));
+    if (rc != SQLITE_OK) {
+        std::cerr << "Cannot prepare the INSERTION: "
+                  << sqlite3_errmsg(db_ctx.get()) << std::endl;
+        throw std::runtime_error("SQL error");
+    }
+
+    exe_stmt(db_ctx.get(), kSqlTransStart);
+
+    exif::ExportOpts scan_opts = opts;
+    scan_opts.fields = exif::Field::PATH | exif::Field::HEIGHT |
+                       exif::Field::WIDTH | exif::Field::TS_GPS;
+    exif::scan(dir, scan_opts, [&](std::span<const exif::Attrs> rows) {
+        for (const auto &attrs : rows) {
+            const std::filesystem::path kPath(attrs.path);
+            const std::string prefix =
+                kPath.parent_path().filename().string();
+            const std::string image = kPath.filename().string();
+            // same as `substr` of a TSV timestamp; empty if missing
+            char date[16] = "";
+            char time[16] = "";
+            if (attrs.ts_gps) {
+                strftime(date, sizeof(date), "%Y-%m-%d", &(*attrs.ts_gps));
+                strftime(time, sizeof(time), "%H:%M:%S", &(*attrs.ts_gps));
+            }
+
+            sqlite3_reset(stmt_ctx.get());
+            sqlite3_bind_text(stmt_ctx.get(), 1, prefix.data(), prefix.size(),
+                              SQLITE_STATIC);
+            sqlite3_bind_text(stmt_ctx.get(), 2, image.data(), image.size(),
+                              SQLITE_STATIC);
+            if (attrs.height) {
+                sqlite3_bind_int(stmt_ctx.get(), 3, *attrs.height);
+            } else {
+                sqlite3_bind_null(stmt_ctx.get(), 3);
+            }
+            if (attrs.width) {
+                sqlite3_bind_int(stmt_ctx.get(), 4, *attrs.width);
+            } else {
+                sqlite3_bind_null(stmt_ctx.get(), 4);
+            }
+            sqlite3_bind_text(stmt_ctx.get(), 5, date, -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt_ctx.get(), 6, time, -1, SQLITE_STATIC);
+
+            if (sqlite3_step(stmt_ctx.get()) != SQLITE_DONE) {
+                std::cerr << "Failed to execute the INSERTION: "
+                          << sqlite3_errmsg(db_ctx.get()) << std::endl;
+                throw std::runtime_error("SQL error");
+            }
+        }
+    });
+
+    exe_stmt(db_ctx.get(), kSqlCommit);
+}
@@ -0,0 +1,458 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <future>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <optional>
+
+#include "annot.hpp"
+#include "ibox.hpp"
+#include "utils.hpp"
+
+using namespace fdt;
+
+namespace {
+
+    // Fault types of `ibox::Fault`
+    static constexpr size_t kNCate = ibox::kNFaultType;
+
+    // Parameters of COCOeval for bounding boxes
+    static constexpr size_t kNIou = 10;  // IoU thresholds .50:.05:.95
+    static constexpr size_t kNRec = 101; // recall thresholds 0:.01:1
+    static constexpr size_t kNArea = 4;  // all, small, medium, large
+    static constexpr size_t kNMaxDet = 3;
+    static constexpr std::array<size_t, kNMaxDet> kMaxDets = {1, 10, 100};
+    static constexpr double kAreaMax = 1e5 * 1e5;
+
+    // Boxes of one category in one image, one array per field so that the
+    // IoU kernel vectorises
+    struct BoxCols {
+        std::vector<double> x, y, w, h;
+        std::vector<double> area; // scaled to the COCO resolution
+        std::vector<float> score;
+
+        size_t Size() const { return x.size(); }
+
+        void Push(const ibox::Box &b, const double scale) {
+            x.push_back(b.x);
+            y.push_back(b.y);
+            w.push_back(b.w);
+            h.push_back(b.h);
+            area.push_back(static_cast<double>(b.w) * b.h * scale);
+            score.push_back(b.score);
+        }
+    };
+
+    // Matches of the detections of one image, category and area range, as by
+    // `COCOeval.evaluateImg`
+    struct ImgEval {
+        bool valid = false; // false without ground truth and detections
+        std::vector<float> scores;     // descending, at most 100
+        std::vector<uint8_t> matched;  // by IoU threshold, then detection
+        std::vector<uint8_t> ignored;  // by IoU threshold, then detection
+        size_t n_gt = 0;               // ground truth not ignored
+    };
+
+    // Precision by IoU threshold and recall threshold, and recall by IoU
+    // threshold, of a category, area range and number of detections; -1
+    // without ground truth
+    struct Curve {
+        std::array<double, kNIou * kNRec> precision;
+        std::array<double, kNIou> recall;
+    };
+
+} // namespace
+
+// Thresholds spaced as by numpy's `linspace`, i.e. `start + i * step` with
+// the last one exactly `stop`
+template <size_t N>
+static std::array<double, N> linspace(const double start, const double stop) {
+    std::array<double, N> thrs;
+    const double kStep = (stop - start) / (N - 1);
+    for (size_t i = 0; i < N; ++i) {
+        thrs[i] = i * kStep + start;
+    }
+    thrs[N - 1] = stop;
+    return thrs;
+}
+
+static const auto kIouThrs = linspace<kNIou>(0.5, 0.95);
+static const auto kRecThrs = linspace<kNRec>(0.0, 1.0);
+static const std::array<std::pair<double, double>, kNArea> kAreaRngs = {{
+    {0.0, kAreaMax},
+    {0.0, annot::kCocoMedium},
+    {annot::kCocoMedium, annot::kCocoLarge},
+    {annot::kCocoLarge, kAreaMax},
+}};
+
+// Whether a box has the fault type `cate`
+inline static bool has_cate(const ibox::Box &b, const size_t cate) {
+    return ibox::faultLevel(b.fault, cate) != 0;
+}
+
+// IoU of every detection with every ground truth box, by detection then
+// ground truth, as by pycocotools' `bbIou`: 0 for disjoint boxes
+static void iou_matrix(const BoxCols &dt, const BoxCols &gt,
+                       std::vector<double> &ious) {
+    const size_t kG = gt.Size();
+    ious.resize(dt.Size() * kG);
+    for (size_t d = 0; d < dt.Size(); ++d) {
+        const double kX = dt.x[d], kY = dt.y[d];
+        const double kX2 = kX + dt.w[d], kY2 = kY + dt.h[d];
+        const double kArea = dt.w[d] * dt.h[d];
+        double *row = ious.data() + d * kG;
+        // branch-free over contiguous columns
+        for (size_t g = 0; g < kG; ++g) {
+            const double kW =
+                std::min(kX2, gt.x[g] + gt.w[g]) - std::max(kX, gt.x[g]);
+            const double kH =
+                std::min(kY2, gt.y[g] + gt.h[g]) - std::max(kY, gt.y[g]);
+            const double kInter = kW > 0 && kH > 0 ? kW * kH : 0.0;
+            const double kUnion = kArea + gt.w[g] * gt.h[g] - kInter;
+            row[g] = kInter > 0 ? kInter / kUnion : 0.0;
+        }
+    }
+}
+
+// Match the detections, sorted by descending score, to the ground truth in
+// an area range
+static ImgEval match_img(const BoxCols &dt, const BoxCols &gt,
+                         const std::vector<double> &ious,
+                         const std::pair<double, double> &rng) {
+    ImgEval e;
+    const size_t kD = dt.Size(), kG = gt.Size();
+    if (kD == 0 && kG == 0) {
+        return e;
+    }
+    e.valid = true;
+    e.scores = dt.score;
+
+    // Ground truth outside the range is ignored, and tried last
+    std::vector<uint8_t> gt_ig(kG);
+    std::vector<size_t> order(kG);
+    for (size_t g = 0; g < kG; ++g) {
+        gt_ig[g] = gt.area[g] < rng.first || gt.area[g] > rng.second;
+        e.n_gt += !gt_ig[g];
+    }
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_partition(order.begin(), order.end(),
+                          [&gt_ig](const size_t g) { return !gt_ig[g]; });
+
+    e.matched.assign(kNIou * kD, 0);
+    e.ignored.assign(kNIou * kD, 0);
+    std::vector<uint8_t> gt_matched(kG);
+    for (size_t t = 0; t < kNIou; ++t) {
+        std::fill(gt_matched.begin(), gt_matched.end(), 0);
+        for (size_t d = 0; d < kD; ++d) {
+            double iou = std::min(kIouThrs[t], 1 - 1e-10);
+            size_t m = kG; // none
+            for (const size_t g : order) {
+                if (gt_matched[g]) {
+                    continue;
+                }
+                // stop at the ignored boxes once a regular one matched
+                if (m < kG && !gt_ig[m] && gt_ig[g]) {
+                    break;
+                }
+                if (ious[d * kG + g] < iou) {
+                    continue;
+                }
+                iou = ious[d * kG + g];
+                m = g;
+            }
+            if (m == kG) {
+                // unmatched detections outside the range are ignored
+                e.ignored[t * kD + d] =
+                    dt.area[d] < rng.first || dt.area[d] > rng.second;
+                continue;
+            }
+            e.matched[t * kD + d] = 1;
+            e.ignored[t * kD + d] = gt_ig[m];
+            gt_matched[m] = 1;
+        }
+    }
+    return e;
+}
+
+// Evaluate one image for every category and area range
+static void eval_img(const std::vector<const ibox::Box *> &gt_boxes,
+                     const std::vector<const ibox::Box *> &dt_boxes,
+                     const double scale, ImgEval *out) {
+    std::vector<double> ious;
+    for (size_t k = 0; k < kNCate; ++k) {
+        BoxCols gt, dt;
+        for (const auto *b : gt_boxes) {
+            if (has_cate(*b, k)) {
+                gt.Push(*b, scale);
+            }
+        }
+        // detections by descending score, stable, at most the last maxDets
+        std::vector<const ibox::Box *> dts;
+        for (const auto *b : dt_boxes) {
+            if (has_cate(*b, k)) {
+                dts.push_back(b);
+            }
+        }
+        std::stable_sort(dts.begin(), dts.end(),
+                         [](const ibox::Box *a, const ibox::Box *b) {
+                             return a->score > b->score;
+                         });
+        dts.resize(MIN2(dts.size(), kMaxDets.back()));
+        for (const auto *b : dts) {
+            dt.Push(*b, scale);
+        }
+
+        iou_matrix(dt, gt, ious);
+        for (size_t a = 0; a < kNArea; ++a) {
+            out[k * kNArea + a] = match_img(dt, gt, ious, kAreaRngs[a]);
+        }
+    }
+}
+
+// Precision and recall of the matches of all images, as by
+// `COCOeval.accumulate`
+static Curve accumulate(const std::vector<const ImgEval *> &evals,
+                        const size_t max_det) {
+    Curve c;
+    c.precision.fill(-1.0);
+    c.recall.fill(-1.0);
+    if (evals.empty()) {
+        return c;
+    }
+
+    // Detections of all images by descending score, stable in image order
+    struct Det {
+        float score;
+        const ImgEval *e;
+        size_t d;
+    };
+    std::vector<Det> dets;
+    size_t n_gt = 0;
+    for (const auto *e : evals) {
+        for (size_t d = 0; d < MIN2(e->scores.size(), max_det); ++d) {
+            dets.push_back({e->scores[d], e, d});
+        }
+        n_gt += e->n_gt;
+    }
+    if (n_gt == 0) {
+        return c;
+    }
+    std::stable_sort(dets.begin(), dets.end(),
+                     [](const Det &a, const Det &b) {
+                         return a.score > b.score;
+                     });
+
+    const double kEps = std::numeric_limits<double>::epsilon();
+    std::vector<double> rc(dets.size()), pr(dets.size());
+    for (size_t t = 0; t < kNIou; ++t) {
+        double tp = 0.0, fp = 0.0;
+        for (size_t i = 0; i < dets.size(); ++i) {
+            const size_t kIdx = t * dets[i].e->scores.size() + dets[i].d;
+            if (!dets[i].e->ignored[kIdx]) {
+                (dets[i].e->matched[kIdx] ? tp : fp) += 1.0;
+            }
+            rc[i] = tp / n_gt;
+            pr[i] = tp / (fp + tp + kEps);
+        }
+        c.recall[t] = dets.empty() ? 0.0 : rc.back();
+
+        // Precision envelope, sampled at the recall thresholds
+        for (size_t i = pr.size(); i-- > 1;) {
+            pr[i - 1] = std::max(pr[i - 1], pr[i]);
+        }
+        for (size_t r = 0; r < kNRec; ++r) {
+            const size_t kPos =
+                std::lower_bound(rc.begin(), rc.end(), kRecThrs[r]) -
+                rc.begin();
+            c.precision[t * kNRec + r] = kPos < pr.size() ? pr[kPos] : 0.0;
+        }
+    }
+    return c;
+}
+
+// Mean of the defined values, or -1 if there is none
+static double mean_defined(const std::vector<double> &vals) {
+    double sum = 0.0;
+    size_t n = 0;
+    for (const double v : vals) {
+        if (v > -1) {
+            sum += v;
+            ++n;
+        }
+    }
+    return n == 0 ? -1.0 : sum / n;
+}
+
+// Metrics of the curves of some categories, as by `COCOeval.summarize`
+//
+// @param curves: by category, area range and number of detections
+static annot::EvalStats
+summarize(const std::vector<Curve> &curves,
+          const std::vector<size_t> &cates) {
+    const auto curve = [&curves](const size_t k, const size_t a,
+                                 const size_t m) -> const Curve & {
+        return curves[(k * kNArea + a) * kNMaxDet + m];
+    };
+    // AP over all IoU thresholds, or the one of index `iou` if given
+    const auto ap = [&](const size_t a, const std::optional<size_t> iou) {
+        std::vector<double> vals;
+        for (const size_t k : cates) {
+            const auto &p = curve(k, a, kNMaxDet - 1).precision;
+            for (size_t t = 0; t < kNIou; ++t) {
+                if (iou && t != *iou) {
+                    continue;
+                }
+                vals.insert(vals.end(), p.begin() + t * kNRec,
+                            p.begin() + (t + 1) * kNRec);
+            }
+        }
+        return mean_defined(vals);
+    };
+    const auto ar = [&](const size_t a, const size_t m) {
+        std::vector<double> vals;
+        for (const size_t k : cates) {
+            const auto &r = curve(k, a, m).recall;
+            vals.insert(vals.end(), r.begin(), r.end());
+        }
+        return mean_defined(vals);
+    };
+    return {
+        ap(0, std::nullopt), ap(0, 0),  ap(0, 5),  ap(1, std::nullopt),
+        ap(2, std::nullopt), ap(3, std::nullopt),  ar(0, 0),
+        ar(0, 1),            ar(0, 2),  ar(1, 2),  ar(2, 2),
+        ar(3, 2),
+    };
+}
+
+annot::EvalResult annot::evaluate(const std::vector<ibox::ImgBox> &gt,
+                                  const std::vector<ibox::ImgBox> &dt,
+                                  const EvalOpts &opts) {
+    // Boxes by image name, in name order; detections of images without
+    // ground truth are not evaluated
+    EvalResult res;
+    std::map<std::string, std::pair<std::vector<const ibox::Box *>,
+                                    std::vector<const ibox::Box *>>>
+        imgs;
+    std::array<bool, kNCate> has_gt{};
+    for (const auto &ibx : gt) {
+        auto &boxes = imgs[ibx.image].first;
+        for (const auto &b : ibx.boxes) {
+            boxes.push_back(&b);
+            for (size_t k = 0; k < kNCate; ++k) {
+                has_gt[k] = has_gt[k] || has_cate(b, k);
+            }
+        }
+    }
+    for (const auto &ibx : dt) {
+        const auto kIt = imgs.find(ibx.image);
+        if (kIt == imgs.end()) {
+            res.skipped += ibx.boxes.size();
+            continue;
+        }
+        for (const auto &b : ibx.boxes) {
+            kIt->second.second.push_back(&b);
+        }
+    }
+    if (res.skipped > 0) {
+        std::cerr << "Skipped " << res.skipped
+                  << " detections of images without ground truth" << std::endl;
+    }
+    std::vector<const decltype(imgs)::value_type *> img_list;
+    for (const auto &img : imgs) {
+        img_list.push_back(&img);
+    }
+
+    // Evaluate images on worker threads claiming one image at a time
+    const double kScale = static_cast<double>(kCocoWidth) * kCocoHeight /
+                          (static_cast<double>(opts.img_width) *
+                           opts.img_height);
+    std::vector<ImgEval> evals(img_list.size() * kNCate * kNArea);
+    std::atomic<size_t> next{0};
+    const auto work = [&]() {
+        for (size_t i = next++; i < img_list.size(); i = next++) {
+            eval_img(img_list[i]->second.first, img_list[i]->second.second,
+                     kScale, evals.data() + i * kNCate * kNArea);
+        }
+    };
+    const size_t kThreads =
+        MIN2(size_t{utils::nThreads(opts.threads)}, img_list.size());
+    std::vector<std::future<void>> futures;
+    for (size_t t = 0; t < kThreads; ++t) {
+        futures.push_back(std::async(std::launch::async, work));
+    }
+    for (auto &fut : futures) {
+        fut.get();
+    }
+
+    // Curves by category, area range and number of detections
+    std::vector<Curve> curves;
+    std::vector<const ImgEval *> valid;
+    for (size_t k = 0; k < kNCate; ++k) {
+        for (size_t a = 0; a < kNArea; ++a) {
+            valid.clear();
+            for (size_t i = 0; i < img_list.size(); ++i) {
+                const auto &e = evals[(i * kNCate + k) * kNArea + a];
+                if (e.valid) {
+                    valid.push_back(&e);
+                }
+            }
+            for (const size_t max_det : kMaxDets) {
+                curves.push_back(accumulate(valid, max_det));
+            }
+        }
+    }
+
+    std::vector<size_t> all(kNCate);
+    std::iota(all.begin(), all.end(), 0);
+    res.all = summarize(curves, all);
+    for (size_t k = 0; k < kNCate; ++k) {
+        if (has_gt[k]) {
+            res.categories.emplace_back(ibox::faultTypeStr(k),
+                                        summarize(curves, {k}));
+        }
+    }
+    return res;
+}
+
+void annot::printEval(const EvalResult &res, std::ostream &os) {
+    static constexpr std::array<const char *, 12> kLines = {
+        " Average Precision  (AP) @[ IoU=0.50:0.95 | area=   all | "
+        "maxDets=100 ]",
+        " Average Precision  (AP) @[ IoU=0.50      | area=   all | "
+        "maxDets=100 ]",
+        " Average Precision  (AP) @[ IoU=0.75      | area=   all | "
+        "maxDets=100 ]",
+        " Average Precision  (AP) @[ IoU=0.50:0.95 | area= small | "
+        "maxDets=100 ]",
+        " Average Precision  (AP) @[ IoU=0.50:0.95 | area=medium | "
+        "maxDets=100 ]",
+        " Average Precision  (AP) @[ IoU=0.50:0.95 | area= large | "
+        "maxDets=100 ]",
+        " Average Recall     (AR) @[ IoU=0.50:0.95 | area=   all | "
+        "maxDets=  1 ]",
+        " Average Recall     (AR) @[ IoU=0.50:0.95 | area=   all | "
+        "maxDets= 10 ]",
+        " Average Recall     (AR) @[ IoU=0.50:0.95 | area=   all | "
+        "maxDets=100 ]",
+        " Average Recall     (AR) @[ IoU=0.50:0.95 | area= small | "
+        "maxDets=100 ]",
+        " Average Recall     (AR) @[ IoU=0.50:0.95 | area=medium | "
+        "maxDets=100 ]",
+        " Average Recall     (AR) @[ IoU=0.50:0.95 | area= large | "
+        "maxDets=100 ]",
+    };
+    char buf[32];
+    for (size_t i = 0; i < kLines.size(); ++i) {
+        std::snprintf(buf, sizeof(buf), " = %0.3f", res.all[i]);
+        os << kLines[i] << buf << "\n";
+    }
+    for (const auto &[name, stats] : res.categories) {
+        std::snprintf(buf, sizeof(buf), "AP %0.3f  AR %0.3f", stats[0],
+                      stats[8]);
+        os << name << "\t" << buf << "\n";
+    }
+    os << std::flush;
+}
@@ -1,5 +1,6 @@
 #include "crs.hpp"
 
+#include <limits>
 #include <stdexcept>
 
 namespace {
@@ -146,6 +147,42 @@ static inline constexpr double ee_2nd_adj(const double cos_lat) {
     return (kEE1st / (1 - kEE1st)) * cos_lat * cos_lat;
 }
 
+// Projection kernel of `ToNzgd2000`, without validation; free of branches
+// and exceptions so that batch loops over it can be vectorised.
+static inline void to_nzgd2000(const double lat, const double lon,
+                               double &easting, double &northing) {
+    // Convert latitude / longitude to radians
+    const double lat_ = DEG2RAD(lat);
+    const double lon_ = DEG2RAD(lon);
+
+    // trigonometric constants used later
+    const double sin_lat = sin(lat_);
+    const double cos_lat = cos(lat_);
+    const double t = tan(lat_);
+
+    // Key terms
+    const double m = arc_meridian(lat_);
+    const double n = radius_curvature(sin_lat);
+    const double a = delta_long_adj(lon_, cos_lat);
+    const double c = ee_2nd_adj(cos_lat);
+
+    // Calculate easting and northing
+    const double x =
+        n * (a + (1 - t * t + c) * a * a * a / 6 +
+             (5 - 18 * t * t + t * t * t * t + 72 * c - 58 * kEE1st) * a * a *
+                 a * a * a / 120);
+    const double y =
+        m +
+        n * t *
+            (a * a / 2 + (5 - t * t + 9 * c + 4 * c * c) * a * a * a * a / 24 +
+             (61 - 58 * t * t + t * t * t * t + 600 * c - 330 * kEE1st) * a *
+                 a * a * a * a * a / 720);
+
+    // Apply the scale factor and the false easting/northing
+    easting = x * kK + kFalseEasting;
+    northing = y * kK + kFalseNorthing;
+}
+
 // Convert geographic coordinates from WGS84 to NZGD2000, using the Transverse
 // Mercator projection.
 //
@@ -204,38 +241,34 @@ std::tuple<double, double> fdt::crs::ToNzgd2000(const double lat,
     validate_latitude(lat);
     validate_longitude(lon);
 
-    // Convert latitude / longitude to radians
-    const double lat_ = DEG2RAD(lat);
-    const double lon_ = DEG2RAD(lon);
-
-    // trigonometric constants used later
-    const double sin_lat = sin(lat_);
-    const double cos_lat = cos(lat_);
-    const double t = tan(lat_);
-
-    // Key terms
-    const double m = arc_meridian(lat_);
-    const double n = radius_curvature(sin_lat);
-    const double a = delta_long_adj(lon_, cos_lat);
-    const double c = ee_2nd_adj(cos_lat);
-
-    // Calculate easting and northing
-    const double x =
-        n * (a + (1 - t * t + c) * a * a * a / 6 +
-             (5 - 18 * t * t + t * t * t * t + 72 * c - 58 * kEE1st) * a * a *
-                 a * a * a / 120);
-    const double y =
-        m +
-        n * t *
-            (a * a / 2 + (5 - t * t + 9 * c + 4 * c * c) * a * a * a * a / 24 +
-             (61 - 58 * t * t + t * t * t * t + 600 * c - 330 * kEE1st) * a *
-                 a * a * a * a * a / 720);
+    double easting, northing;
+    to_nzgd2000(lat, lon, easting, northing);
+    return std::make_tuple(easting, northing);
+}
 
-    // Apply the scale factor and the false easting/northing
-    const double easting = x * kK + kFalseEasting;
-    const double northing = y * kK + kFalseNorthing;
+// Batch version of `ToNzgd2000` over structure-of-arrays input. Invalid
+// positions are replaced by (0, 173) before the projection and their results
+// masked to NaN afterwards, so the loop body has no data-dependent branches.
+//
+// @throws: std::invalid_argument if the spans differ in size.
+void fdt::crs::ToNzgd2000(std::span<const double> lat,
+                          std::span<const double> lon, std::span<double> east,
+                          std::span<double> north) {
+    const size_t n = lat.size();
+    if (lon.size() != n || east.size() != n || north.size() != n) {
+        throw std::invalid_argument("Spans must be of the same size.");
+    }
+    constexpr double kNaN = std::numeric_limits<double>::quiet_NaN();
 
-    return std::make_tuple(easting, northing);
+    for (size_t i = 0; i < n; ++i) {
+        // false for NaN as well
+        const bool ok = lat[i] >= -90 && lat[i] <= 90 && lon[i] >= -180 &&
+                        lon[i] <= 180;
+        double e, no;
+        to_nzgd2000(ok ? lat[i] : 0, ok ? lon[i] : 173, e, no);
+        east[i] = ok ? e : kNaN;
+        north[i] = ok ? no : kNaN;
+    }
 }
 
 // Convert geographic coordinates from NZGD2000 to WGS84, using the Transverse
@@ -1,136 +1,354 @@
+#include <bit>
+#include <charconv>
+#include <chrono>
 #include <cstring>
+#include <future>
 #include <iostream>
+#include <unordered_map>
 
 #include "crs.hpp"
 #include "exif.hpp"
+#include "jpeg.hpp"
 #include "utils.hpp"
 
 using namespace fdt;
 
-// Contains the keys of the desired Exiv2 EXIF attributes.
+// Contains the tags of the desired EXIF attributes.
 namespace {
 
-    static constexpr char kK_EXIFVER[] = "Exif.Photo.ExifVersion";
-    static constexpr char kK_MAKE[] = "Exif.Image.Make";
-    static constexpr char kK_MODEL[] = "Exif.Image.Model";
-    static constexpr char kK_DESC[] = "Exif.Image.ImageDescription";
-    static constexpr char kK_HEIGHT[] = "Exif.Photo.PixelYDimension";
-    static constexpr char kK_WIDTH[] = "Exif.Photo.PixelXDimension";
-    static constexpr char kK_LAT[] = "Exif.GPSInfo.GPSLatitude";
-    static constexpr char kK_LON[] = "Exif.GPSInfo.GPSLongitude";
-    static constexpr char kK_LAT_REF[] = "Exif.GPSInfo.GPSLatitudeRef";
-    static constexpr char kK_LON_REF[] = "Exif.GPSInfo.GPSLongitudeRef";
-    static constexpr char kK_ALTITUDE[] = "Exif.GPSInfo.GPSAltitude";
-    static constexpr char kK_GPS_DT[] = "Exif.GPSInfo.GPSDateStamp";
-    static constexpr char kK_GPS_TM[] = "Exif.GPSInfo.GPSTimeStamp";
-    static constexpr char kK_SUBJ_DIST[] = "Exif.Photo.SubjectDistance";
-    static constexpr char kK_ISO[] = "Exif.Photo.ISOSpeedRatings";
-    static constexpr char kK_APERTURE[] = "Exif.Photo.ApertureValue";
-    static constexpr char kK_SHUTTER_SPEED[] = "Exif.Photo.ShutterSpeedValue";
-    static constexpr char kK_EXPOSURE_TM[] = "Exif.Photo.ExposureTime";
-    static constexpr char kK_FOCAL_LENGTH[] = "Exif.Photo.FocalLength";
+    // Attributes decoded from EXIF; one slot per desired tag
+    enum class Slot : uint8_t {
+        EXIFVER,
+        MAKE,
+        MODEL,
+        DESC,
+        HEIGHT,
+        WIDTH,
+        LAT,
+        LON,
+        LAT_REF,
+        LON_REF,
+        ALTITUDE,
+        GPS_DT,
+        GPS_TM,
+        SUBJ_DIST,
+        ISO,
+        APERTURE,
+        SHUTTER_SPEED,
+        EXPOSURE_TM,
+        FOCAL_LENGTH,
+        N_SLOT,
+    };
+
+    inline constexpr uint32_t route_key(const jpeg::Ifd ifd,
+                                        const uint16_t tag) {
+        return (static_cast<uint32_t>(ifd) << 16) | tag;
+    }
+
+    struct Route {
+        uint32_t key; // see `route_key`
+        Slot slot;
+    };
+
+    // (IFD, tag) of each desired attribute, sorted by `route_key`
+    static constexpr std::array<Route, static_cast<size_t>(Slot::N_SLOT)>
+        kRoutes = {{
+            // Exif.Image.ImageDescription
+            {route_key(jpeg::Ifd::IMAGE, 0x010E), Slot::DESC},
+            // Exif.Image.Make
+            {route_key(jpeg::Ifd::IMAGE, 0x010F), Slot::MAKE},
+            // Exif.Image.Model
+            {route_key(jpeg::Ifd::IMAGE, 0x0110), Slot::MODEL},
+            // Exif.Photo.ExposureTime
+            {route_key(jpeg::Ifd::PHOTO, 0x829A), Slot::EXPOSURE_TM},
+            // Exif.Photo.ISOSpeedRatings
+            {route_key(jpeg::Ifd::PHOTO, 0x8827), Slot::ISO},
+            // Exif.Photo.ExifVersion
+            {route_key(jpeg::Ifd::PHOTO, 0x9000), Slot::EXIFVER},
+            // Exif.Photo.ShutterSpeedValue
+            {route_key(jpeg::Ifd::PHOTO, 0x9201), Slot::SHUTTER_SPEED},
+            // Exif.Photo.ApertureValue
+            {route_key(jpeg::Ifd::PHOTO, 0x9202), Slot::APERTURE},
+            // Exif.Photo.SubjectDistance
+            {route_key(jpeg::Ifd::PHOTO, 0x9206), Slot::SUBJ_DIST},
+            // Exif.Photo.FocalLength
+            {route_key(jpeg::Ifd::PHOTO, 0x920A), Slot::FOCAL_LENGTH},
+            // Exif.Photo.PixelXDimension
+            {route_key(jpeg::Ifd::PHOTO, 0xA002), Slot::WIDTH},
+            // Exif.Photo.PixelYDimension
+            {route_key(jpeg::Ifd::PHOTO, 0xA003), Slot::HEIGHT},
+            // Exif.GPSInfo.GPSLatitudeRef
+            {route_key(jpeg::Ifd::GPS, 0x0001), Slot::LAT_REF},
+            // Exif.GPSInfo.GPSLatitude
+            {route_key(jpeg::Ifd::GPS, 0x0002), Slot::LAT},
+            // Exif.GPSInfo.GPSLongitudeRef
+            {route_key(jpeg::Ifd::GPS, 0x0003), Slot::LON_REF},
+            // Exif.GPSInfo.GPSLongitude
+            {route_key(jpeg::Ifd::GPS, 0x0004), Slot::LON},
+            // Exif.GPSInfo.GPSAltitude
+            {route_key(jpeg::Ifd::GPS, 0x0006), Slot::ALTITUDE},
+            // Exif.GPSInfo.GPSTimeStamp
+            {route_key(jpeg::Ifd::GPS, 0x0007), Slot::GPS_TM},
+            // Exif.GPSInfo.GPSDateStamp
+            {route_key(jpeg::Ifd::GPS, 0x001D), Slot::GPS_DT},
+        }};
+    static_assert(std::is_sorted(kRoutes.begin(), kRoutes.end(),
+                                 [](const Route &a, const Route &b) {
+                                     return a.key < b.key;
+                                 }));
+
+    // Typed view of an Exiv2 datum with the accessors of `jpeg::Entry`; Exiv2
+    // type ids coincide with the TIFF field types.
+    struct DatumView {
+        const Exiv2::Value *value;
+        jpeg::Type type;
+        uint32_t count;
+
+        bool IsInteger() const {
+            return jpeg::isInteger(type);
+        }
+
+        bool IsRational() const {
+            return jpeg::isRational(type);
+        }
+
+        int64_t Integer(const size_t i = 0) const {
+            return value->toInt64(i);
+        }
+
+        jpeg::Rational Rat(const size_t i = 0) const {
+            const Exiv2::Rational r = value->toRational(i);
+            return {r.first, r.second};
+        }
+
+        // ASCII values only; see `jpeg::Entry::Text`
+        std::string_view Text() const {
+            const auto *str =
+                dynamic_cast<const Exiv2::StringValueBase *>(value);
+            if (!str) {
+                return {};
+            }
+            const std::string_view sv = str->value_;
+            return sv.substr(0, sv.find('\0'));
+        }
+    };
+
+    // Entries of the desired tags of one image, indexed by `Slot`
+    template <typename E>
+    using Slots = std::array<std::optional<E>,
+                             static_cast<size_t>(Slot::N_SLOT)>;
+
+    inline static constexpr char kBlank[] = " \t\n\r\f\v";
+
+    // Number of images each worker decodes per batch; bounds the buffered
+    // output while keeping the workers busy.
+    static constexpr size_t kBatchPerThread = 64;
+
+    // JSON key and CSV column of each field, in column order
+    struct FieldName {
+        exif::Field field;
+        const char *key;
+        const char *column;
+    };
+
+    static constexpr std::array<FieldName, 20> kFieldNames = {{
+        {exif::Field::PATH, "path", "image"},
+        {exif::Field::HEIGHT, "height", "height"},
+        {exif::Field::WIDTH, "width", "width"},
+        {exif::Field::ALTITUDE, "altitude", "altitude"},
+        {exif::Field::TS_GPS, "ts_gps", "timestamp"},
+        {exif::Field::LAT, "lat", "latitude"},
+        {exif::Field::LON, "lon", "longitude"},
+        {exif::Field::EASTING, "easting", "easting"},
+        {exif::Field::NORTHING, "northing", "northing"},
+        {exif::Field::EXIF_VER, "exif_ver", "exif_ver"},
+        {exif::Field::DESC, "desc", "desc"},
+        {exif::Field::MODEL, "model", "model"},
+        {exif::Field::COC, "coc", "coc"},
+        {exif::Field::SUBJ_DIST, "subj_dist", "subj_dist"},
+        {exif::Field::ISO, "iso", "iso"},
+        {exif::Field::APERTURE, "aperture", "aperture"},
+        {exif::Field::SHUTTER_SPEED, "shutter_speed", "shutter_speed"},
+        {exif::Field::EXPOSURE_TIME, "exposure_time", "exposure_time"},
+        {exif::Field::FOCAL_LENGTH, "focal_length", "focal_length"},
+        {exif::Field::HYPERFOCAL_DIST, "hyperfocal_dist", "hyperfocal_dist"},
+    }};
+
+    // Decoding plan of a field selection
+    struct Plan {
+        exif::Field need; // the selection plus the fields it derives from
+        uint32_t slots;   // bitmask of the `Slot`s to decode
+    };
 
 } // namespace
 
-// Get string value from an ExifData::iterator for a given key:
-//
-// - if the key is not found, return std::nullopt
-// - if the key is found, return the string value with leading and trailing
-//   whitespaces removed
-inline exif::OptStr get_attr_str(Exiv2::ExifData &dat, const std::string &key) {
-    Exiv2::ExifData::iterator it = dat.findKey(Exiv2::ExifKey(key));
-    if (it == dat.end()) {
-        return std::nullopt;
+static inline constexpr uint32_t slot_bit(const Slot slot) {
+    return uint32_t{1} << static_cast<uint32_t>(slot);
+}
+
+// Resolve a field selection into the fields and tags to decode
+static inline constexpr Plan make_plan(exif::Field fields) {
+    using exif::Field;
+    if (hasField(fields, Field::EASTING | Field::NORTHING)) {
+        fields = fields | Field::LAT | Field::LON;
     }
-    std::string str = it->value().toString();
-    size_t first = str.find_first_not_of(" \t\n\r\f\v");
-    if (first == std::string::npos) {
-        return std::nullopt;
+    if (hasField(fields, Field::HYPERFOCAL_DIST)) {
+        fields = fields | Field::FOCAL_LENGTH | Field::APERTURE | Field::COC;
     }
-    size_t last = str.find_last_not_of(" \t\n\r\f\v");
-    return str.substr(first, (last - first + 1));
+    if (hasField(fields, Field::COC)) {
+        fields = fields | Field::MODEL;
+    }
+
+    // tags of each decoded field
+    constexpr std::pair<Field, uint32_t> kTags[] = {
+        {Field::HEIGHT, slot_bit(Slot::HEIGHT)},
+        {Field::WIDTH, slot_bit(Slot::WIDTH)},
+        {Field::ALTITUDE, slot_bit(Slot::ALTITUDE)},
+        {Field::TS_GPS, slot_bit(Slot::GPS_DT) | slot_bit(Slot::GPS_TM)},
+        {Field::LAT, slot_bit(Slot::LAT) | slot_bit(Slot::LAT_REF)},
+        {Field::LON, slot_bit(Slot::LON) | slot_bit(Slot::LON_REF)},
+        {Field::EXIF_VER, slot_bit(Slot::EXIFVER)},
+        {Field::DESC, slot_bit(Slot::DESC)},
+        {Field::MODEL, slot_bit(Slot::MAKE) | slot_bit(Slot::MODEL)},
+        {Field::SUBJ_DIST, slot_bit(Slot::SUBJ_DIST)},
+        {Field::ISO, slot_bit(Slot::ISO)},
+        {Field::APERTURE, slot_bit(Slot::APERTURE)},
+        {Field::SHUTTER_SPEED, slot_bit(Slot::SHUTTER_SPEED)},
+        {Field::EXPOSURE_TIME, slot_bit(Slot::EXPOSURE_TM)},
+        {Field::FOCAL_LENGTH, slot_bit(Slot::FOCAL_LENGTH)},
+    };
+    uint32_t slots = 0;
+    for (const auto &[field, tags] : kTags) {
+        if (hasField(fields, field)) {
+            slots |= tags;
+        }
+    }
+    return {fields, slots};
 }
 
-// Get the numerator from a string of the form "num/den"
-// @param str: the string to convert
-// @return: the numerator
-inline double frac_num(const std::string &str) {
-    return std::stod(str.substr(0, str.find('/')));
+// Slot of an (IFD, tag) pair, or `Slot::N_SLOT` if the tag is not wanted
+static inline constexpr Slot find_slot(const jpeg::Ifd ifd,
+                                       const uint16_t tag) {
+    const uint32_t key = route_key(ifd, tag);
+    const auto it = std::lower_bound(
+        kRoutes.begin(), kRoutes.end(), key,
+        [](const Route &r, const uint32_t k) { return r.key < k; });
+    return (it != kRoutes.end() && it->key == key) ? it->slot : Slot::N_SLOT;
 }
 
-// Get the denominator from a string of the form "num/den"
-// @param str: the string to convert
-// @return: the denominator
-inline double frac_den(const std::string &str) {
-    return std::stod(str.substr(str.find('/') + 1));
+// Route an entry to its slot if the plan decodes it; the first entry of a tag
+// wins.
+template <typename E>
+static inline void route(Slots<E> &slots, const uint32_t plan,
+                         const jpeg::Ifd ifd, const uint16_t tag, const E &e) {
+    const Slot slot = find_slot(ifd, tag);
+    if (slot != Slot::N_SLOT && (plan & slot_bit(slot)) &&
+        !slots[static_cast<size_t>(slot)]) {
+        slots[static_cast<size_t>(slot)] = e;
+    }
 }
 
-// Compute a fraction from a string of the form "num/den"
-// @param str: the string to convert
-// @return: the double value
-inline double frac(exif::OptStr str) {
-    if (!str || str->empty()) {
-        return 0;
+// Remove leading and trailing whitespaces
+static inline std::string_view trim(std::string_view sv) {
+    const size_t first = sv.find_first_not_of(kBlank);
+    if (first == std::string_view::npos) {
+        return {};
+    }
+    return sv.substr(first, sv.find_last_not_of(kBlank) - first + 1);
+}
+
+// String value of an entry, formatted as Exiv2's `toString` does (ASCII up to
+// the first NUL, bytes as space-separated decimals):
+//
+// - if the entry is missing or blank, return std::nullopt
+// - otherwise, return the string with leading and trailing whitespaces removed
+template <typename E> static exif::OptStr get_str(const std::optional<E> &e) {
+    if (!e) {
+        return std::nullopt;
+    }
+    if (e->type == jpeg::Type::BYTE || e->type == jpeg::Type::UNDEFINED) {
+        // e.g. ExifVersion "0220" -> "48 50 50 48"
+        std::string str;
+        str.reserve(e->count * 4);
+        char buf[4];
+        for (uint32_t i = 0; i < e->count; ++i) {
+            if (i) {
+                str += ' ';
+            }
+            const auto res =
+                std::to_chars(buf, buf + sizeof(buf), e->Integer(i) & 0xFF);
+            str.append(buf, res.ptr);
+        }
+        return str.empty() ? exif::OptStr() : exif::OptStr(std::move(str));
+    }
+    const std::string_view sv = trim(e->Text());
+    if (sv.empty()) {
+        return std::nullopt;
     }
+    return std::string(sv);
+}
 
-    const double kNum = frac_num(*str);
-    const double kDen = frac_den(*str);
+// First component of an integer entry, e.g. ISOSpeedRatings
+template <typename E> static exif::OptInt get_int(const std::optional<E> &e) {
+    if (e && e->IsInteger()) {
+        return static_cast<int>(e->Integer());
+    }
+    return std::nullopt;
+}
 
-    return kNum / kDen;
+// Value of the first component of a rational entry; 0 if it is missing
+template <typename E> static double get_frac(const std::optional<E> &e) {
+    if (e && e->IsRational()) {
+        return e->Rat().value();
+    }
+    return 0;
 }
 
-// Convert to a double coordinate (i.e. latitude or longitude) from a string
-// of the form:
-//
-// - degrees/1 minutes/1 seconds/10000000
-//
-// then negate the result if the direction is South or West.
-//
-// The string is obtained from the following EXIF attributes:
+// Convert to a double coordinate (i.e. latitude or longitude) from the three
+// rationals degrees, minutes and seconds of
 //
 // - Exif.GPSInfo.GPSLatitude
 // - Exif.GPSInfo.GPSLongitude
 //
-// @param str: the optinal string to convert
-// @return: the double value
-// @throws std::runtime_error if the input is a null optional
-inline exif::OptDbl get_coor(const exif::OptStr &str, const exif::OptStr &ref) {
-    if (!str) {
+// then negate the result if the direction is South or West.
+//
+// @param e: the optional coordinate entry
+// @param ref: the optional reference entry, i.e. "N", "S", "E" or "W"
+// @return: the double value, or std::nullopt if the entry is missing
+template <typename E>
+static exif::OptDbl get_coor(const std::optional<E> &e,
+                             const std::optional<E> &ref) {
+    if (!e || !e->IsRational() || e->count < 3) {
         return std::nullopt;
     }
-
-    std::vector<std::string> parts;
-    std::istringstream iss(*str);
-    std::string part;
-
-    while (std::getline(iss, part, ' ')) {
-        parts.push_back(part);
-    }
-
-    const double kDeg = frac_num(parts[0]); // no need to divide by 1
-    const double kMin = frac_num(parts[1]); // no need to divide by 1
-    const double kSec = frac(parts[2]);
+    const double kDeg = e->Rat(0).value();
+    const double kMin = e->Rat(1).value();
+    const double kSec = e->Rat(2).value();
     const double kCoor = kDeg + (kMin / 60) + (kSec / 3600);
 
-    if (ref && (*ref == "S" || *ref == "W")) {
+    const std::string_view kRef = ref ? trim(ref->Text()) : "";
+    if (kRef == "S" || kRef == "W") {
         return -kCoor;
     }
     return kCoor;
 }
 
-inline exif::OptInt to_int(const exif::OptStr &str) {
-    if (!str || str->empty()) {
+// Join make and model with a space; std::nullopt if either is missing
+template <typename E>
+static exif::OptStr get_model(const std::optional<E> &make,
+                              const std::optional<E> &model) {
+    if (!make || !model) {
         return std::nullopt;
     }
-    return std::stoi(*str);
-}
-
-inline exif::OptStr get_model(const exif::OptStr &make,
-                              const exif::OptStr &model) {
-    if (!make || !model) {
+    const std::string_view kMake = trim(make->Text());
+    const std::string_view kModel = trim(model->Text());
+    if (kMake.empty() || kModel.empty()) {
         return std::nullopt;
     }
-    return *make + " " + *model;
+    std::string str;
+    str.reserve(kMake.size() + 1 + kModel.size());
+    str.append(kMake).append(" ").append(kModel);
+    return str;
 }
 
 // Get the circle of confusion from the camera model.
@@ -162,42 +380,106 @@ inline double get_hyperfocal_dist(exif::OptDbl f, exif::OptDbl n,
     return ((std::pow(*f, 2) / (*n * *c)) + *f) / 1000;
 }
 
-// Convert a date and time string to a std::tm object; return std::nullopt
-// if either the date or time string is null.
-// @param ymd: the date string of the form "YYYY:MM:DD"
-// @param hms: the time string of the form "HH/1 MM/1 SS/1"
+// Convert a GPS date and time stamp to a std::tm object; return std::nullopt
+// if either of them is missing or malformed.
+// @param ymd: the date stamp of the form "YYYY:MM:DD"
+// @param hms: the time stamp of three rationals; only the numerators are
+//             used, i.e. "HH/1 MM/1 SS/1"
 // @return: the std::tm object
-inline exif::OptTm get_gps_ts(const exif::OptStr &ymd,
-                              const exif::OptStr &hms) {
-    if (!ymd || !hms) {
+template <typename E>
+static exif::OptTm get_gps_ts(const std::optional<E> &ymd,
+                              const std::optional<E> &hms) {
+    if (!ymd || !hms || !hms->IsRational() || hms->count < 3) {
         return std::nullopt;
     }
+    const std::string_view kYmd = trim(ymd->Text());
     std::tm ts = {};
-    std::istringstream iss(*ymd + " " + *hms);
-    int int_hh, int_mm, int_ss;
-    char ignore;
-    iss >> std::get_time(&ts, "%Y:%m:%d");
-    iss >> int_hh >> ignore >> ignore >> int_mm >> ignore >> ignore >> int_ss;
-    ts.tm_hour = int_hh;
-    ts.tm_min = int_mm;
+    int *fields[] = {&ts.tm_year, &ts.tm_mon, &ts.tm_mday};
+    const char *p = kYmd.data();
+    const char *end = kYmd.data() + kYmd.size();
+    for (size_t i = 0; i < 3; ++i) {
+        const auto res = std::from_chars(p, end, *fields[i]);
+        const bool kSep = i == 2 || (res.ptr != end && *res.ptr == ':');
+        if (res.ec != std::errc() || !kSep) {
+            return std::nullopt;
+        }
+        p = res.ptr + 1;
+    }
+    ts.tm_year -= 1900;
+    ts.tm_mon -= 1;
+    ts.tm_hour = static_cast<int>(hms->Rat(0).num);
+    ts.tm_min = static_cast<int>(hms->Rat(1).num);
     // int_ss can be
     // 1. [0, 59]
     // 2. [60, +inf]
     // TODO: exiftool parses 789 as 7.89s; need to handle this case
-    if (int_ss <= 59) {
-        ts.tm_sec = int_ss;
-    } else {
-        ts.tm_sec = 0;
-    }
+    const auto kSec = hms->Rat(2).num;
+    ts.tm_sec = kSec <= 59 ? static_cast<int>(kSec) : 0;
     return ts;
 }
 
-// Open an image and return the ExifData object
+// Fill the planned attributes from the routed entries of one image.
+template <typename E>
+static void fill_attrs(exif::Attrs &attrs, const Slots<E> &slots,
+                       const exif::Field need) {
+    using exif::Field;
+    const auto at = [&slots](const Slot s) -> const std::optional<E> & {
+        return slots[static_cast<size_t>(s)];
+    };
+
+    if (hasField(need, Field::EXIF_VER)) {
+        attrs.exif_ver = get_str(at(Slot::EXIFVER));
+    }
+    if (hasField(need, Field::MODEL)) {
+        attrs.model = get_model(at(Slot::MAKE), at(Slot::MODEL));
+    }
+    if (hasField(need, Field::DESC)) {
+        attrs.desc = get_str(at(Slot::DESC));
+    }
+    if (hasField(need, Field::HEIGHT)) {
+        attrs.height = get_int(at(Slot::HEIGHT));
+    }
+    if (hasField(need, Field::WIDTH)) {
+        attrs.width = get_int(at(Slot::WIDTH));
+    }
+    if (hasField(need, Field::LAT)) {
+        attrs.lat = get_coor(at(Slot::LAT), at(Slot::LAT_REF));
+    }
+    if (hasField(need, Field::LON)) {
+        attrs.lon = get_coor(at(Slot::LON), at(Slot::LON_REF));
+    }
+    if (hasField(need, Field::ALTITUDE)) {
+        attrs.altitude = get_frac(at(Slot::ALTITUDE));
+    }
+    if (hasField(need, Field::TS_GPS)) {
+        attrs.ts_gps = get_gps_ts(at(Slot::GPS_DT), at(Slot::GPS_TM));
+    }
+    if (hasField(need, Field::EXPOSURE_TIME)) {
+        attrs.exposure_time = get_frac(at(Slot::EXPOSURE_TM));
+    }
+    if (hasField(need, Field::ISO)) {
+        attrs.iso = get_int(at(Slot::ISO));
+    }
+    if (hasField(need, Field::SHUTTER_SPEED)) {
+        attrs.shutter_speed = get_frac(at(Slot::SHUTTER_SPEED));
+    }
+    if (hasField(need, Field::APERTURE)) {
+        attrs.aperture = get_frac(at(Slot::APERTURE));
+    }
+    if (hasField(need, Field::SUBJ_DIST)) {
+        attrs.subj_dist = get_frac(at(Slot::SUBJ_DIST));
+    }
+    if (hasField(need, Field::FOCAL_LENGTH)) {
+        attrs.focal_length = get_frac(at(Slot::FOCAL_LENGTH));
+    }
+}
+
+// Open an image and read its metadata; the returned image owns the ExifData
 // @param path: the path to the image
-// @return: the ExifData object
+// @return: the image with its metadata read
 // @throws std::runtime_error if the image cannot be opened or if no EXIF
 // data is found
-inline Exiv2::ExifData get_exif(const std::string &path) {
+inline Exiv2::Image::UniquePtr get_exif(const std::string &path) {
     Exiv2::Image::UniquePtr ptr_img;
 
     try {
@@ -211,16 +493,76 @@ inline Exiv2::ExifData get_exif(const std::string &path) {
     }
 
     ptr_img->readMetadata();
-    const Exiv2::ExifData &dat = ptr_img->exifData();
-    if (dat.empty()) {
+    if (ptr_img->exifData().empty()) {
         throw std::runtime_error("No Exif data found in image: " + path);
     }
 
-    return dat;
+    return ptr_img;
+}
+
+// Fill the attributes from the metadata parsed by Exiv2, routing every datum
+// in a single pass over the ExifData.
+static void decode_exiv2(exif::Attrs &attrs, const Plan &plan) {
+    const Exiv2::Image::UniquePtr kImg = get_exif(attrs.path);
+
+    Slots<DatumView> slots;
+    for (const auto &datum : kImg->exifData()) {
+        jpeg::Ifd ifd;
+        switch (datum.ifdId()) {
+        case Exiv2::IfdId::ifd0Id:
+            ifd = jpeg::Ifd::IMAGE;
+            break;
+        case Exiv2::IfdId::exifId:
+            ifd = jpeg::Ifd::PHOTO;
+            break;
+        case Exiv2::IfdId::gpsId:
+            ifd = jpeg::Ifd::GPS;
+            break;
+        default:
+            continue;
+        }
+        const Exiv2::Value &value = datum.value();
+        route(slots, plan.slots, ifd, datum.tag(),
+              DatumView{&value, static_cast<jpeg::Type>(value.typeId()),
+                        static_cast<uint32_t>(value.count())});
+    }
+    fill_attrs(attrs, slots, plan.need);
+}
+
+// Fill the attributes by reading only the EXIF APP1 segment of a JPEG file and
+// walking its IFD0 / Exif / GPS directories.
+//
+// @return: false if the file cannot be read or is not a JPEG file with a
+//          well-formed EXIF segment
+static bool decode_native(exif::Attrs &attrs, const Plan &plan) {
+    std::ifstream is(attrs.path, std::ios::binary);
+    if (!is) {
+        return false;
+    }
+    thread_local std::vector<uint8_t> tiff;
+    if (!jpeg::readExif(is, tiff)) {
+        return false;
+    }
+
+    Slots<jpeg::Entry> slots;
+    const bool ok =
+        jpeg::walkTiff(tiff.data(), tiff.size(), [&](const jpeg::Entry &e) {
+            route(slots, plan.slots, e.ifd, e.tag, e);
+        });
+    if (!ok) {
+        return false;
+    }
+    fill_attrs(attrs, slots, plan.need);
+    return true;
 }
 
 // Returns the ExifAttributes structure containing the desired EXIF attributes.
 //
+// With the default backend the native decoder reads the EXIF segment directly
+// and Exiv2 is only used for files it cannot handle. Either way the tags are
+// routed in a single pass and no memory is allocated beyond the attributes.
+// Tags not needed by `fields` are skipped and their attributes left empty.
+//
 // Throws a runtime_error if:
 // - the image can't be opened
 // - the image doesn't contain Exif data
@@ -228,13 +570,16 @@ inline Exiv2::ExifData get_exif(const std::string &path) {
 //
 // Args:
 //   path: The path to the image.
+//   backend: The decoder(s) to use.
+//   fields: The attributes to decode.
 //
 // Returns:
 //   ExifAttributes containing the desired EXIF attributes.
 //
 // Throws:
 //   std::runtime_error if any error occurs.
-exif::Attrs::Attrs(const std::string &path)
+exif::Attrs::Attrs(const std::string &path, const Backend backend,
+                   const Field fields)
     : path(path), exif_ver(std::nullopt), desc(std::nullopt),
       model(std::nullopt), height(std::nullopt), width(std::nullopt),
       lat(std::nullopt), lon(std::nullopt), altitude(std::nullopt),
@@ -243,27 +588,37 @@ exif::Attrs::Attrs(const std::string &path)
       exposure_time(std::nullopt), focal_length(std::nullopt),
       hyperfocal_dist(std::nullopt) {
 
-    Exiv2::ExifData dat = get_exif(path);
-
-    exif_ver = get_attr_str(dat, kK_EXIFVER);
-    model = get_model(get_attr_str(dat, kK_MAKE), get_attr_str(dat, kK_MODEL));
-    desc = get_attr_str(dat, kK_DESC);
-    height = to_int(get_attr_str(dat, kK_HEIGHT));
-    width = to_int(get_attr_str(dat, kK_WIDTH));
-    lat = get_coor(get_attr_str(dat, kK_LAT), get_attr_str(dat, kK_LAT_REF));
-    lon = get_coor(get_attr_str(dat, kK_LON), get_attr_str(dat, kK_LON_REF));
-
-    altitude = frac(get_attr_str(dat, kK_ALTITUDE));
-    ts_gps =
-        get_gps_ts(get_attr_str(dat, kK_GPS_DT), get_attr_str(dat, kK_GPS_TM));
-    coc = get_coc_from_model(model);
-    exposure_time = frac(get_attr_str(dat, kK_EXPOSURE_TM));
-    iso = to_int(get_attr_str(dat, kK_ISO));
-    shutter_speed = frac(get_attr_str(dat, kK_SHUTTER_SPEED));
-    aperture = frac(get_attr_str(dat, kK_APERTURE));
-    subj_dist = frac(get_attr_str(dat, kK_SUBJ_DIST));
-    focal_length = frac(get_attr_str(dat, kK_FOCAL_LENGTH));
-    hyperfocal_dist = get_hyperfocal_dist(focal_length, aperture, coc);
+    const Plan kPlan = make_plan(fields);
+    if (backend == Backend::EXIV2 || !decode_native(*this, kPlan)) {
+        if (backend == Backend::NATIVE) {
+            throw std::runtime_error("No Exif data found in image: " + path);
+        }
+        decode_exiv2(*this, kPlan);
+    }
+
+    if (hasField(kPlan.need, Field::COC)) {
+        coc = get_coc_from_model(model);
+    }
+    if (hasField(kPlan.need, Field::HYPERFOCAL_DIST)) {
+        hyperfocal_dist = get_hyperfocal_dist(focal_length, aperture, coc);
+    }
+}
+
+exif::Field exif::parseFields(const std::string &names) {
+    Field fields = Field::NONE;
+    std::stringstream ss(names);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        const auto it = std::find_if(
+            kFieldNames.begin(), kFieldNames.end(), [&name](const auto &f) {
+                return name == f.key || name == f.column;
+            });
+        if (it == kFieldNames.end()) {
+            throw std::runtime_error("Unknown field: " + name);
+        }
+        fields = fields | it->field;
+    }
+    return fields;
 }
 
 void exif::Attrs::Print() const {
@@ -288,7 +643,8 @@ void exif::Attrs::Print() const {
 }
 
 void exif::Attrs::ListAll(const std::string &path) {
-    Exiv2::ExifData dat = get_exif(path);
+    const Exiv2::Image::UniquePtr kImg = get_exif(path);
+    const Exiv2::ExifData &dat = kImg->exifData();
 
     Exiv2::ExifData::const_iterator it = dat.begin();
     for (; it != dat.end(); ++it) {
@@ -328,30 +684,143 @@ static inline void assign_to_json(nlohmann::json &j, const std::string &key,
     }
 }
 
-nlohmann::json exif::Attrs::ToJson() const {
-    nlohmann::json out;
+// Easting and northing of the position, if requested and known
+static inline std::pair<exif::OptDbl, exif::OptDbl>
+project(const exif::Attrs &attrs, const exif::Field fields) {
+    if (!hasField(fields, exif::Field::EASTING | exif::Field::NORTHING) ||
+        !attrs.lat || !attrs.lon) {
+        return {std::nullopt, std::nullopt};
+    }
+    const auto [east, north] = crs::ToNzgd2000(*attrs.lat, *attrs.lon);
+    return {east, north};
+}
+
+namespace {
+    // Easting and northing of a chunk of images, projected in one batched call
+    // from contiguous latitude / longitude arrays; NaN where unknown.
+    struct Projection {
+        std::vector<double> east;
+        std::vector<double> north;
 
-    // Define a list of serialization actions
-    std::vector<std::function<void()>> serActions = {
-        [&]() { assign_to_json(out, "path", path); },
-        [&]() { assign_to_json(out, "exif_ver", exif_ver); },
-        [&]() { assign_to_json(out, "desc", desc); },
-        [&]() { assign_to_json(out, "model", model); },
-        [&]() { assign_to_json(out, "height", height); },
-        [&]() { assign_to_json(out, "width", width); },
-        [&]() { assign_to_json(out, "lat", lat); },
-        [&]() { assign_to_json(out, "lon", lon); },
-        [&]() { assign_to_json(out, "altitude", altitude); },
-        [&]() { assign_to_json(out, "ts_gps", ts_gps); },
+        Projection(std::span<const exif::Attrs> rows,
+                   const exif::Field fields) {
+            using exif::Field;
+            if (!hasField(fields, Field::EASTING | Field::NORTHING)) {
+                return;
+            }
+            constexpr double kNaN = std::numeric_limits<double>::quiet_NaN();
+            std::vector<double> lat(rows.size()), lon(rows.size());
+            for (size_t i = 0; i < rows.size(); ++i) {
+                const bool kKnown = rows[i].lat && rows[i].lon;
+                lat[i] = kKnown ? *rows[i].lat : kNaN;
+                lon[i] = kKnown ? *rows[i].lon : kNaN;
+            }
+            east.resize(rows.size());
+            north.resize(rows.size());
+            crs::ToNzgd2000(lat, lon, east, north);
+        }
+
+        exif::OptDbl East(const size_t i) const { return at(east, i); }
+
+        exif::OptDbl North(const size_t i) const { return at(north, i); }
+
+      private:
+        static exif::OptDbl at(const std::vector<double> &v, const size_t i) {
+            if (i >= v.size() || std::isnan(v[i])) {
+                return std::nullopt;
+            }
+            return v[i];
+        }
     };
 
-    for (const auto &action : serActions) {
-        action(); // Execute the serialization action
+} // namespace
+
+// JSON object of `fields`, given the projected position
+static nlohmann::json to_json(const exif::Attrs &attrs,
+                              const exif::Field fields,
+                              const exif::OptDbl &east,
+                              const exif::OptDbl &north) {
+    using exif::Field;
+    nlohmann::json out;
+
+    for (const auto &f : kFieldNames) {
+        if (!hasField(fields, f.field)) {
+            continue;
+        }
+        switch (f.field) {
+        case Field::PATH:
+            assign_to_json(out, f.key, attrs.path);
+            break;
+        case Field::HEIGHT:
+            assign_to_json(out, f.key, attrs.height);
+            break;
+        case Field::WIDTH:
+            assign_to_json(out, f.key, attrs.width);
+            break;
+        case Field::ALTITUDE:
+            assign_to_json(out, f.key, attrs.altitude);
+            break;
+        case Field::TS_GPS:
+            assign_to_json(out, f.key, attrs.ts_gps);
+            break;
+        case Field::LAT:
+            assign_to_json(out, f.key, attrs.lat);
+            break;
+        case Field::LON:
+            assign_to_json(out, f.key, attrs.lon);
+            break;
+        case Field::EASTING:
+            assign_to_json(out, f.key, east);
+            break;
+        case Field::NORTHING:
+            assign_to_json(out, f.key, north);
+            break;
+        case Field::EXIF_VER:
+            assign_to_json(out, f.key, attrs.exif_ver);
+            break;
+        case Field::DESC:
+            assign_to_json(out, f.key, attrs.desc);
+            break;
+        case Field::MODEL:
+            assign_to_json(out, f.key, attrs.model);
+            break;
+        case Field::COC:
+            assign_to_json(out, f.key, attrs.coc);
+            break;
+        case Field::SUBJ_DIST:
+            assign_to_json(out, f.key, attrs.subj_dist);
+            break;
+        case Field::ISO:
+            assign_to_json(out, f.key, attrs.iso);
+            break;
+        case Field::APERTURE:
+            assign_to_json(out, f.key, attrs.aperture);
+            break;
+        case Field::SHUTTER_SPEED:
+            assign_to_json(out, f.key, attrs.shutter_speed);
+            break;
+        case Field::EXPOSURE_TIME:
+            assign_to_json(out, f.key, attrs.exposure_time);
+            break;
+        case Field::FOCAL_LENGTH:
+            assign_to_json(out, f.key, attrs.focal_length);
+            break;
+        case Field::HYPERFOCAL_DIST:
+            assign_to_json(out, f.key, attrs.hyperfocal_dist);
+            break;
+        default:
+            break;
+        }
     }
 
     return out;
 }
 
+nlohmann::json exif::Attrs::ToJson(const Field fields) const {
+    const auto [kEast, kNorth] = project(*this, fields);
+    return to_json(*this, fields, kEast, kNorth);
+}
+
 // NOTE: only for path (no other string attributes)
 static inline void to_ostream(std::ostream &ostream, const exif::OptStr &path,
                               const std::string &sep = "") {
@@ -389,53 +858,670 @@ static inline void to_ostream(std::ostream &ostream, const exif::OptTm &value,
     ostream << std::string(buf) << sep;
 }
 
-static inline void to_ostream(std::ostream &ostream, const exif::OptDbl &lat,
-                              const exif::OptDbl &lon,
-                              const std::string &sep = "") {
-    if (!lat || !lon) {
-        ostream << sep << sep << sep;
-        return;
+// Tab-separated row of `fields`, given the projected position
+static void to_csv(std::ostream &ostream, const exif::Attrs &attrs,
+                   const exif::Field fields, const exif::OptDbl &east,
+                   const exif::OptDbl &north) {
+    using exif::Field;
+
+    bool first = true;
+    for (const auto &f : kFieldNames) {
+        if (!hasField(fields, f.field)) {
+            continue;
+        }
+        if (!first) {
+            ostream << '\t';
+        }
+        first = false;
+        switch (f.field) {
+        case Field::PATH:
+            to_ostream(ostream, exif::OptStr(attrs.path));
+            break;
+        case Field::HEIGHT:
+            to_ostream(ostream, attrs.height);
+            break;
+        case Field::WIDTH:
+            to_ostream(ostream, attrs.width);
+            break;
+        case Field::ALTITUDE:
+            to_ostream(ostream, attrs.altitude);
+            break;
+        case Field::TS_GPS:
+            to_ostream(ostream, attrs.ts_gps);
+            break;
+        case Field::LAT:
+            to_ostream(ostream, attrs.lat);
+            break;
+        case Field::LON:
+            to_ostream(ostream, attrs.lon);
+            break;
+        case Field::EASTING:
+            to_ostream(ostream, east);
+            break;
+        case Field::NORTHING:
+            to_ostream(ostream, north);
+            break;
+        case Field::EXIF_VER:
+            ostream << attrs.exif_ver.value_or("");
+            break;
+        case Field::DESC:
+            ostream << attrs.desc.value_or("");
+            break;
+        case Field::MODEL:
+            ostream << attrs.model.value_or("");
+            break;
+        case Field::COC:
+            to_ostream(ostream, attrs.coc);
+            break;
+        case Field::SUBJ_DIST:
+            to_ostream(ostream, attrs.subj_dist);
+            break;
+        case Field::ISO:
+            to_ostream(ostream, attrs.iso);
+            break;
+        case Field::APERTURE:
+            to_ostream(ostream, attrs.aperture);
+            break;
+        case Field::SHUTTER_SPEED:
+            to_ostream(ostream, attrs.shutter_speed);
+            break;
+        case Field::EXPOSURE_TIME:
+            to_ostream(ostream, attrs.exposure_time);
+            break;
+        case Field::FOCAL_LENGTH:
+            to_ostream(ostream, attrs.focal_length);
+            break;
+        case Field::HYPERFOCAL_DIST:
+            to_ostream(ostream, attrs.hyperfocal_dist);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void exif::Attrs::ToCsv(std::ostream &ostream, const Field fields) const {
+    const auto [kEast, kNorth] = project(*this, fields);
+    to_csv(ostream, *this, fields, kEast, kNorth);
+}
+
+// Header row of the CSV export of `fields`
+static inline std::string csv_header(const exif::Field fields) {
+    std::string header;
+    for (const auto &f : kFieldNames) {
+        if (hasField(fields, f.field)) {
+            if (!header.empty()) {
+                header += '\t';
+            }
+            header += f.column;
+        }
+    }
+    return header;
+}
+
+// Run `fn(begin, end)` over contiguous chunks of the index range [0, n), one
+// chunk per worker, and hand the chunk results to `sink` in index order. The
+// range is processed in batches of `kBatchPerThread` items per worker, so the
+// output is identical to a serial run and only one batch is buffered at a
+// time.
+template <typename Fn, typename Sink>
+static void ordered_map(const size_t n, const unsigned n_threads, Fn fn,
+                        Sink sink) {
+    using Res = decltype(fn(size_t{0}, size_t{0}));
+    const size_t batch = n_threads * kBatchPerThread;
+
+    for (size_t lo = 0; lo < n; lo += batch) {
+        const size_t hi = MIN2(n, lo + batch);
+        const size_t csize = (hi - lo + n_threads - 1) / n_threads;
+
+        std::vector<std::future<Res>> futures;
+        for (size_t b = lo; b < hi; b += csize) {
+            futures.push_back(
+                std::async(std::launch::async, fn, b, MIN2(hi, b + csize)));
+        }
+
+        // Stitch the per-worker buffers together in order
+        for (auto &fut : futures) {
+            sink(fut.get());
+        }
+    }
+}
+
+// List all images under a directory in sorted path order
+static inline Paths sorted_images(const std::string &dir) {
+    Paths paths = utils::listAllImages(dir);
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+// Initialise the XMP toolkit of Exiv2 once, as it requires before images are
+// opened from several threads
+static inline void init_exiv2() {
+    static const bool kInit = Exiv2::XmpParser::initialize();
+    (void)kInit;
+}
+
+// Decode `fields` of the images of a directory in parallel, passing each
+// chunk's `write(Buf &, std::span<const Attrs>)` output to `sink` in path
+// order. With a cache only new or changed images are decoded, in full so that
+// the cache serves any selection; they are added to the cache and images
+// deleted from the directory are pruned from it.
+template <typename Buf, typename Write, typename Sink>
+static void map_attrs(const std::string &dir, const Paths &paths,
+                      const exif::ExportOpts &opts, const exif::Field fields,
+                      Write write, Sink sink) {
+    // Output of a chunk, and its images decoded afresh (by index into
+    // `rows`), to be added to the cache by the sink
+    struct Chunk {
+        Buf buf;
+        std::vector<exif::Attrs> rows;
+        std::vector<std::pair<size_t, exif::FileStamp>> fresh;
+    };
+
+    std::optional<exif::Cache> cache;
+    if (!opts.cache.empty()) {
+        cache.emplace(opts.cache);
+        cache->Load(dir);
+    }
+    const exif::Cache *kCache = cache ? &*cache : nullptr;
+    const exif::Field kDecode = kCache ? exif::Field::ALL : fields;
+
+    init_exiv2();
+    ordered_map(
+        paths.size(), utils::nThreads(opts.threads),
+        [&paths, &write, kCache, kDecode](size_t begin, size_t end) {
+            Chunk res;
+            res.rows.reserve(end - begin);
+            for (size_t i = begin; i < end; ++i) {
+                const auto kStamp =
+                    kCache ? exif::FileStamp::Of(paths[i]) : exif::FileStamp{};
+                const exif::Attrs *hit =
+                    kCache ? kCache->Find(paths[i], kStamp) : nullptr;
+                if (hit) {
+                    res.rows.push_back(*hit);
+                    res.rows.back().path = paths[i];
+                    continue;
+                }
+                if (kCache) {
+                    res.fresh.emplace_back(res.rows.size(), kStamp);
+                }
+                res.rows.emplace_back(paths[i], exif::Backend::AUTO, kDecode);
+            }
+            write(res.buf, std::span<const exif::Attrs>(res.rows));
+            return res;
+        },
+        [&sink, &cache](Chunk res) {
+            sink(std::move(res.buf));
+            for (const auto &[idx, stamp] : res.fresh) {
+                cache->Put(res.rows[idx], stamp);
+            }
+        });
+
+    if (cache) {
+        cache->Commit(paths);
+    }
+}
+
+// Append a record to an array written as by `dump(4)`: the record is dumped
+// with the same indent and shifted one level to the right.
+static inline void append_indented(std::string &buf, const std::string &rec) {
+    buf += "    ";
+    for (const char c : rec) {
+        buf += c;
+        if (c == '\n') {
+            buf += "    ";
+        }
+    }
+}
+
+// Records are written as soon as their chunk is decoded, so memory stays
+// bounded by one batch. The array form is byte-identical to dumping the whole
+// array with `dump(4)`; with `ndjson` each line is one complete record, so a
+// partially written file remains usable.
+void exif::exportJson(const std::string &dir, std::ostream &out,
+                      const ExportOpts &opts) {
+    const Paths paths = sorted_images(dir);
+    const Field kFields =
+        opts.fields == Field::NONE ? kJsonFields : opts.fields;
+    bool first = true;
+
+    map_attrs<std::string>(
+        dir, paths, opts, kFields,
+        [&opts, kFields](std::string &buf,
+                         std::span<const exif::Attrs> rows) {
+            const Projection kProj(rows, kFields);
+            for (size_t i = 0; i < rows.size(); ++i) {
+                const nlohmann::json kRec =
+                    to_json(rows[i], kFields, kProj.East(i), kProj.North(i));
+                if (opts.ndjson) {
+                    buf += kRec.dump();
+                    buf += '\n';
+                    continue;
+                }
+                if (!buf.empty()) {
+                    buf += ",\n";
+                }
+                append_indented(buf, kRec.dump(4));
+            }
+        },
+        [&out, &opts, &first](const std::string &buf) {
+            if (buf.empty()) {
+                return;
+            }
+            if (!opts.ndjson) {
+                out << (first ? "[\n" : ",\n");
+            }
+            first = false;
+            out << buf;
+            out.flush();
+        });
+
+    if (!opts.ndjson) {
+        out << (first ? "[]" : "\n]") << std::endl;
+    }
+}
+
+void exif::exportCsv(const std::string &dir, std::ostream &out,
+                     const ExportOpts &opts) {
+    const Paths paths = sorted_images(dir);
+    const Field kFields = opts.fields == Field::NONE ? kCsvFields : opts.fields;
+
+    out << csv_header(kFields) << std::endl;
+    map_attrs<std::ostringstream>(
+        dir, paths, opts, kFields,
+        [kFields](std::ostringstream &buf,
+                  std::span<const exif::Attrs> rows) {
+            const Projection kProj(rows, kFields);
+            for (size_t i = 0; i < rows.size(); ++i) {
+                to_csv(buf, rows[i], kFields, kProj.East(i), kProj.North(i));
+                buf << '\n';
+            }
+        },
+        [&out](std::ostringstream buf) { out << buf.view(); });
+    out.flush();
+}
+
+void exif::scan(const std::string &dir, const ExportOpts &opts,
+                const std::function<void(std::span<const Attrs>)> &sink) {
+    const Paths paths = sorted_images(dir);
+    const Field kFields = opts.fields == Field::NONE ? Field::ALL : opts.fields;
+
+    map_attrs<std::vector<Attrs>>(
+        dir, paths, opts, kFields,
+        [](std::vector<Attrs> &buf, std::span<const Attrs> rows) {
+            buf.assign(rows.begin(), rows.end());
+        },
+        [&sink](const std::vector<Attrs> &buf) { sink(buf); });
+}
+
+std::vector<uint8_t> exif::readThumb(const std::string &path) {
+    std::ifstream is(path, std::ios::binary);
+    thread_local std::vector<uint8_t> tiff;
+    if (!is || !jpeg::readExif(is, tiff)) {
+        return {};
     }
-    auto [east, north] = crs::ToNzgd2000(*lat, *lon);
-    ostream << std::fixed << std::setprecision(6) << *lat << sep << *lon << sep
-            << east << sep << north;
+    const auto kThumb = jpeg::findThumbnail(tiff.data(), tiff.size());
+    return {kThumb.begin(), kThumb.end()};
 }
 
-void exif::Attrs::ToCsv(std::ostream &ostream) const {
-    // Define a list of serialization actions
-    std::vector<std::function<void()>> serActions = {
-        [&]() { to_ostream(ostream, path, "\t"); },
-        [&]() { to_ostream(ostream, height, "\t"); },
-        [&]() { to_ostream(ostream, width, "\t"); },
-        [&]() { to_ostream(ostream, altitude, "\t"); },
-        [&]() { to_ostream(ostream, ts_gps, "\t"); },
-        [&]() { to_ostream(ostream, lat, lon, "\t"); },
+void exif::scanThumbs(const std::string &dir, const ExportOpts &opts,
+                      const std::function<void(std::span<const Thumb>)> &sink) {
+    const Paths paths = sorted_images(dir);
+    ordered_map(
+        paths.size(), utils::nThreads(opts.threads),
+        [&paths](size_t begin, size_t end) {
+            std::vector<Thumb> res;
+            res.reserve(end - begin);
+            for (size_t i = begin; i < end; ++i) {
+                res.push_back({paths[i], readThumb(paths[i])});
+            }
+            return res;
+        },
+        [&sink](const std::vector<Thumb> &res) { sink(res); });
+}
+
+size_t exif::exportThumbs(const std::string &dir, const std::string &out_dir,
+                          const ExportOpts &opts) {
+    size_t n = 0;
+    scanThumbs(dir, opts, [&](std::span<const Thumb> thumbs) {
+        for (const auto &t : thumbs) {
+            if (t.jpeg.empty()) {
+                continue;
+            }
+            const auto kOut = std::filesystem::path(out_dir) /
+                              std::filesystem::relative(t.path, dir);
+            std::filesystem::create_directories(kOut.parent_path());
+            std::ofstream out(kOut, std::ios::binary);
+            out.write(reinterpret_cast<const char *>(t.jpeg.data()),
+                      t.jpeg.size());
+            if (!out) {
+                throw std::runtime_error("Cannot write " + kOut.string());
+            }
+            ++n;
+        }
+    });
+    return n;
+}
+
+// The columnar format is little-endian and written from native values
+static_assert(std::endian::native == std::endian::little);
+
+// Columns of the columnar export, in file order
+namespace {
+
+    enum class Col : uint8_t {
+        DIR,
+        DIR_DICT,
+        NAME,
+        HEIGHT,
+        WIDTH,
+        TIMESTAMP,
+        ALTITUDE,
+        LAT,
+        LON,
+        EASTING,
+        NORTHING,
+        N_COL,
+    };
+
+    static constexpr std::array<std::pair<const char *, exif::fdtc::Type>,
+                                static_cast<size_t>(Col::N_COL)>
+        kColumns = {{
+            {"dir", exif::fdtc::Type::U32},
+            {"dir_dict", exif::fdtc::Type::STR},
+            {"name", exif::fdtc::Type::STR},
+            {"height", exif::fdtc::Type::I32},
+            {"width", exif::fdtc::Type::I32},
+            {"timestamp", exif::fdtc::Type::I64},
+            {"altitude", exif::fdtc::Type::F64},
+            {"lat", exif::fdtc::Type::F64},
+            {"lon", exif::fdtc::Type::F64},
+            {"easting", exif::fdtc::Type::F64},
+            {"northing", exif::fdtc::Type::F64},
+        }};
+
+    // Values of the fixed-width columns of one chunk of images
+    struct ColChunk {
+        std::vector<int32_t> height;
+        std::vector<int32_t> width;
+        std::vector<int64_t> timestamp;
+        std::vector<double> altitude;
+        std::vector<double> lat;
+        std::vector<double> lon;
+        std::vector<double> easting;
+        std::vector<double> northing;
+    };
+
+} // namespace
+
+static inline constexpr uint64_t align8(const uint64_t n) {
+    return (n + 7) & ~uint64_t{7};
+}
+
+// Seconds since the epoch of a GPS time stamp, which is in UTC
+static inline int64_t to_epoch(const std::tm &ts) {
+    using namespace std::chrono;
+    const sys_days kDays = year{ts.tm_year + 1900} /
+                           month{static_cast<unsigned>(ts.tm_mon + 1)} /
+                           day{static_cast<unsigned>(ts.tm_mday)};
+    return static_cast<int64_t>(kDays.time_since_epoch().count()) * 86400 +
+           ts.tm_hour * 3600 + ts.tm_min * 60 + ts.tm_sec;
+}
+
+static inline double or_nan(const exif::OptDbl &v) {
+    return v ? *v : std::numeric_limits<double>::quiet_NaN();
+}
+
+template <typename T>
+static inline void write_at(std::ofstream &out, const uint64_t offset,
+                            const std::vector<T> &values) {
+    out.seekp(static_cast<std::streamoff>(offset));
+    out.write(reinterpret_cast<const char *>(values.data()),
+              values.size() * sizeof(T));
+}
+
+// Write a STR column of `strs` at the current position
+template <typename Strs>
+static inline void write_strs(std::ofstream &out, const Strs &strs) {
+    uint64_t off = 0;
+    for (const auto &str : strs) {
+        out.write(reinterpret_cast<const char *>(&off), sizeof(off));
+        off += str.size();
+    }
+    out.write(reinterpret_cast<const char *>(&off), sizeof(off));
+    for (const auto &str : strs) {
+        out.write(str.data(), str.size());
+    }
+}
+
+void exif::exportColumnar(const std::string &dir, const std::string &path,
+                          const ExportOpts &opts) {
+    const Paths paths = sorted_images(dir);
+    const uint64_t kN = paths.size();
+
+    // Dictionary-encode the directories; the file names are stored as is
+    std::vector<uint32_t> dir_ids(kN);
+    std::vector<std::string> dirs;
+    std::vector<std::string> names(kN);
+    std::unordered_map<std::string, uint32_t> dir_index;
+    for (size_t i = 0; i < kN; ++i) {
+        const std::filesystem::path kPath(paths[i]);
+        const auto [it, added] = dir_index.try_emplace(
+            kPath.parent_path().string(), static_cast<uint32_t>(dirs.size()));
+        if (added) {
+            dirs.push_back(it->first);
+        }
+        dir_ids[i] = it->second;
+        names[i] = kPath.filename().string();
+    }
+
+    // Lay out the columns after the header and the descriptors
+    std::array<fdtc::ColumnDesc, static_cast<size_t>(Col::N_COL)> descs{};
+    uint64_t off = align8(sizeof(fdtc::Header) + sizeof(descs));
+    const auto str_size = [](const auto &strs) {
+        uint64_t n = 8 * (strs.size() + 1);
+        for (const auto &str : strs) {
+            n += str.size();
+        }
+        return n;
+    };
+    for (size_t c = 0; c < descs.size(); ++c) {
+        auto &desc = descs[c];
+        const auto &[name, type] = kColumns[c];
+        std::strncpy(desc.name.data(), name, desc.name.size() - 1);
+        desc.type = type;
+        desc.count = kN;
+        switch (static_cast<Col>(c)) {
+        case Col::DIR:
+        case Col::HEIGHT:
+        case Col::WIDTH:
+            desc.size = 4 * kN;
+            break;
+        case Col::DIR_DICT:
+            desc.count = dirs.size();
+            desc.size = str_size(dirs);
+            break;
+        case Col::NAME:
+            desc.size = str_size(names);
+            break;
+        default:
+            desc.size = 8 * kN;
+            break;
+        }
+        desc.offset = off;
+        off = align8(off + desc.size);
+    }
+    const auto at = [&descs](const Col c) -> const fdtc::ColumnDesc & {
+        return descs[static_cast<size_t>(c)];
     };
 
-    for (const auto &action : serActions) {
-        action(); // Execute the serialization action
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Unable to open for writing: " + path);
     }
+    const fdtc::Header kHeader = {fdtc::kMagic, fdtc::kVersion, kN,
+                                  static_cast<uint32_t>(descs.size()), 0};
+    out.write(reinterpret_cast<const char *>(&kHeader), sizeof(kHeader));
+    out.write(reinterpret_cast<const char *>(descs.data()), sizeof(descs));
+    write_at(out, at(Col::DIR).offset, dir_ids);
+    out.seekp(static_cast<std::streamoff>(at(Col::DIR_DICT).offset));
+    write_strs(out, dirs);
+    out.seekp(static_cast<std::streamoff>(at(Col::NAME).offset));
+    write_strs(out, names);
+
+    // Fill the fixed-width columns chunk by chunk, in path order
+    uint64_t row = 0;
+    map_attrs<ColChunk>(
+        dir, paths, opts, kCsvFields,
+        [](ColChunk &buf, std::span<const Attrs> rows) {
+            for (const auto &attrs : rows) {
+                buf.height.push_back(attrs.height.value_or(fdtc::kNullI32));
+                buf.width.push_back(attrs.width.value_or(fdtc::kNullI32));
+                buf.timestamp.push_back(attrs.ts_gps ? to_epoch(*attrs.ts_gps)
+                                                     : fdtc::kNullI64);
+                buf.altitude.push_back(or_nan(attrs.altitude));
+                buf.lat.push_back(or_nan(attrs.lat));
+                buf.lon.push_back(or_nan(attrs.lon));
+            }
+            // the columns are already SoA; project them in place
+            buf.easting.resize(rows.size());
+            buf.northing.resize(rows.size());
+            crs::ToNzgd2000(buf.lat, buf.lon, buf.easting, buf.northing);
+        },
+        [&](const ColChunk &buf) {
+            write_at(out, at(Col::HEIGHT).offset + 4 * row, buf.height);
+            write_at(out, at(Col::WIDTH).offset + 4 * row, buf.width);
+            write_at(out, at(Col::TIMESTAMP).offset + 8 * row, buf.timestamp);
+            write_at(out, at(Col::ALTITUDE).offset + 8 * row, buf.altitude);
+            write_at(out, at(Col::LAT).offset + 8 * row, buf.lat);
+            write_at(out, at(Col::LON).offset + 8 * row, buf.lon);
+            write_at(out, at(Col::EASTING).offset + 8 * row, buf.easting);
+            write_at(out, at(Col::NORTHING).offset + 8 * row, buf.northing);
+            row += buf.height.size();
+        });
+
+    // Pad to the end of the last column, which is empty without images
+    out.seekp(0, std::ios::end);
+    for (auto pos = static_cast<uint64_t>(out.tellp()); pos < off; ++pos) {
+        out.put('\0');
+    }
+    if (!out) {
+        throw std::runtime_error("Failed to write: " + path);
+    }
+}
+
+// Name of a column, without its NUL padding
+static inline std::string_view col_name(const exif::fdtc::ColumnDesc &desc) {
+    return {desc.name.data(), strnlen(desc.name.data(), desc.name.size())};
 }
 
-void exif::exportJson(const std::string &dir, std::ostream &out) {
-    nlohmann::json js;
+exif::ColumnarReader::ColumnarReader(const std::string &path)
+    : file_(path), n_rows_(0), dir_dict_(nullptr), name_(nullptr) {
+    const uint8_t *kData = file_.data();
+    const uint64_t kSize = file_.size();
+    const auto invalid = [&path](const std::string &why) {
+        return std::runtime_error("Invalid columnar file " + path + ": " +
+                                  why);
+    };
+
+    if (kSize < sizeof(fdtc::Header)) {
+        throw invalid("truncated header");
+    }
+    const auto *header = reinterpret_cast<const fdtc::Header *>(kData);
+    if (header->magic != fdtc::kMagic) {
+        throw invalid("bad magic");
+    }
+    if (header->version != fdtc::kVersion) {
+        throw invalid("unsupported version " +
+                      std::to_string(header->version));
+    }
+    if (sizeof(fdtc::Header) + header->n_cols * sizeof(fdtc::ColumnDesc) >
+        kSize) {
+        throw invalid("truncated column table");
+    }
+    n_rows_ = header->n_rows;
+    cols_ = {reinterpret_cast<const fdtc::ColumnDesc *>(header + 1),
+             header->n_cols};
 
-    for (const auto &path : utils::listAllImages(dir)) {
-        exif::Attrs exif = exif::Attrs(path);
-        nlohmann::json j = exif.ToJson();
-        js.push_back(j);
+    for (const auto &desc : cols_) {
+        if (desc.offset % 8 != 0 || desc.offset > kSize ||
+            desc.size > kSize - desc.offset) {
+            throw invalid("column out of bounds");
+        }
+        // every column has a value per row but the directory dictionary
+        if (desc.count != n_rows_ && col_name(desc) != "dir_dict") {
+            throw invalid("column " + std::string(col_name(desc)) + " of " +
+                          std::to_string(desc.count) + " values for " +
+                          std::to_string(n_rows_) + " rows");
+        }
+        uint64_t width = 0;
+        switch (desc.type) {
+        case fdtc::Type::I32:
+        case fdtc::Type::U32:
+            width = 4;
+            break;
+        case fdtc::Type::I64:
+        case fdtc::Type::F64:
+            width = 8;
+            break;
+        case fdtc::Type::STR: {
+            // offsets must fit and end within the column
+            if (desc.count >= desc.size / 8) {
+                throw invalid("bad string column");
+            }
+            const auto *offs =
+                reinterpret_cast<const uint64_t *>(kData + desc.offset);
+            if (offs[0] != 0 ||
+                offs[desc.count] > desc.size - 8 * (desc.count + 1) ||
+                !std::is_sorted(offs, offs + desc.count + 1)) {
+                throw invalid("bad string column");
+            }
+            break;
+        }
+        default:
+            throw invalid("unknown column type");
+        }
+        if (width != 0 && desc.count > desc.size / width) {
+            throw invalid("column too short");
+        }
+    }
+
+    dir_ = Column<uint32_t>("dir");
+    dir_dict_ = &find("dir_dict", fdtc::Type::STR);
+    name_ = &find("name", fdtc::Type::STR);
+    if (dir_.size() != n_rows_ || name_->count != n_rows_) {
+        throw invalid("row count mismatch");
+    }
+    for (const uint32_t id : dir_) {
+        if (id >= dir_dict_->count) {
+            throw invalid("bad directory index");
+        }
     }
-    out << js.dump(4) << std::endl;
 }
 
-void exif::exportCsv(const std::string &dir, std::ostream &out) {
-    out << "image\theight\twidth\taltitude\ttimestamp\tlatitude\tlongitude\teas"
-           "t"
-           "ing\tnorthing"
-        << std::endl;
-    for (const auto &img_path : utils::listAllImages(dir)) {
-        exif::Attrs exif = exif::Attrs(img_path);
-        exif.ToCsv(out);
-        out << std::endl;
+const exif::fdtc::ColumnDesc &
+exif::ColumnarReader::find(std::string_view name, fdtc::Type type) const {
+    for (const auto &desc : cols_) {
+        if (col_name(desc) == name && desc.type == type) {
+            return desc;
+        }
     }
+    throw std::runtime_error("No column " + std::string(name) +
+                             " of the requested type");
+}
+
+std::string_view exif::ColumnarReader::str(const fdtc::ColumnDesc &desc,
+                                           const size_t i) const {
+    const auto *offs =
+        reinterpret_cast<const uint64_t *>(file_.data() + desc.offset);
+    const auto *chars = reinterpret_cast<const char *>(offs + desc.count + 1);
+    return {chars + offs[i], offs[i + 1] - offs[i]};
+}
+
+std::string_view exif::ColumnarReader::Dir(const size_t i) const {
+    return str(*dir_dict_, dir_[i]);
+}
+
+std::string_view exif::ColumnarReader::Name(const size_t i) const {
+    return str(*name_, i);
 }
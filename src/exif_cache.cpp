@@ -0,0 +1,332 @@
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <sqlite3.h>
+#include <unordered_set>
+
+#include "exif.hpp"
+
+using namespace fdt;
+
+namespace {
+
+    // Bump whenever the decoded attributes change, e.g. a decoder fix; a
+    // cache of another version is discarded.
+    static constexpr int kSchemaVersion = 1;
+
+    static constexpr const char *kSqlNew = R"(
+        DROP TABLE IF EXISTS exif_cache;
+        CREATE TABLE exif_cache (
+            path            TEXT PRIMARY KEY,
+            size            INTEGER NOT NULL,
+            mtime           INTEGER NOT NULL,
+            exif_ver        TEXT,
+            desc            TEXT,
+            model           TEXT,
+            height          INTEGER,
+            width           INTEGER,
+            lat             REAL,
+            lon             REAL,
+            altitude        REAL,
+            ts_gps          TEXT,
+            coc             REAL,
+            subj_dist       REAL,
+            iso             INTEGER,
+            aperture        REAL,
+            shutter_speed   REAL,
+            exposure_time   REAL,
+            focal_length    REAL,
+            hyperfocal_dist REAL
+        ) WITHOUT ROWID;
+    )";
+
+    // Entries under a directory: path in [?1, ?2)
+    static constexpr const char *kSqlSelect = R"(
+        SELECT path, size, mtime, exif_ver, desc, model, height, width, lat,
+               lon, altitude, ts_gps, coc, subj_dist, iso, aperture,
+               shutter_speed, exposure_time, focal_length, hyperfocal_dist
+          FROM exif_cache
+         WHERE path >= ?1 AND path < ?2;
+    )";
+
+    static constexpr const char *kSqlPut = R"(
+        INSERT OR REPLACE INTO exif_cache VALUES (
+            ?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10,
+            ?11, ?12, ?13, ?14, ?15, ?16, ?17, ?18, ?19, ?20
+        );
+    )";
+
+    static constexpr const char *kSqlDelete =
+        "DELETE FROM exif_cache WHERE path = ?1;";
+
+    static constexpr const char *kTsFmt = "%Y-%m-%dT%H:%M:%S";
+
+} // namespace
+
+// Key of an image in the cache, independent of the working directory
+static inline std::string abs_key(const std::string &path) {
+    return std::filesystem::absolute(path).lexically_normal().string();
+}
+
+inline static void exe_sql(sqlite3 *db, const char *sql) {
+    char *err_msg = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &err_msg) != SQLITE_OK) {
+        const std::string msg = err_msg ? err_msg : "unknown error";
+        sqlite3_free(err_msg);
+        throw std::runtime_error("Cache SQL error: " + msg);
+    }
+}
+
+inline static sqlite3_stmt *prepare(sqlite3 *db, const char *sql) {
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        throw std::runtime_error(std::string("Cache SQL error: ") +
+                                 sqlite3_errmsg(db));
+    }
+    return stmt;
+}
+
+static inline void bind(sqlite3_stmt *stmt, int idx, const exif::OptStr &v) {
+    if (v) {
+        sqlite3_bind_text(stmt, idx, v->data(), v->size(), SQLITE_TRANSIENT);
+    } else {
+        sqlite3_bind_null(stmt, idx);
+    }
+}
+
+static inline void bind(sqlite3_stmt *stmt, int idx, const exif::OptInt &v) {
+    if (v) {
+        sqlite3_bind_int(stmt, idx, *v);
+    } else {
+        sqlite3_bind_null(stmt, idx);
+    }
+}
+
+static inline void bind(sqlite3_stmt *stmt, int idx, const exif::OptDbl &v) {
+    if (v) {
+        sqlite3_bind_double(stmt, idx, *v);
+    } else {
+        sqlite3_bind_null(stmt, idx);
+    }
+}
+
+static inline void bind(sqlite3_stmt *stmt, int idx, const exif::OptTm &v) {
+    if (v) {
+        char buf[32];
+        const size_t n = strftime(buf, sizeof(buf), kTsFmt, &(*v));
+        sqlite3_bind_text(stmt, idx, buf, n, SQLITE_TRANSIENT);
+    } else {
+        sqlite3_bind_null(stmt, idx);
+    }
+}
+
+static inline bool is_null(sqlite3_stmt *stmt, int col) {
+    return sqlite3_column_type(stmt, col) == SQLITE_NULL;
+}
+
+static inline exif::OptStr col_str(sqlite3_stmt *stmt, int col) {
+    if (is_null(stmt, col)) {
+        return std::nullopt;
+    }
+    const auto *text =
+        reinterpret_cast<const char *>(sqlite3_column_text(stmt, col));
+    return std::string(text, sqlite3_column_bytes(stmt, col));
+}
+
+static inline exif::OptInt col_int(sqlite3_stmt *stmt, int col) {
+    if (is_null(stmt, col)) {
+        return std::nullopt;
+    }
+    return sqlite3_column_int(stmt, col);
+}
+
+static inline exif::OptDbl col_dbl(sqlite3_stmt *stmt, int col) {
+    if (is_null(stmt, col)) {
+        return std::nullopt;
+    }
+    return sqlite3_column_double(stmt, col);
+}
+
+// Inverse of the `kTsFmt` formatting; the other fields are left zero as in
+// the decoder.
+static inline exif::OptTm col_tm(sqlite3_stmt *stmt, int col) {
+    if (is_null(stmt, col)) {
+        return std::nullopt;
+    }
+    std::tm ts = {};
+    const auto *text =
+        reinterpret_cast<const char *>(sqlite3_column_text(stmt, col));
+    if (std::sscanf(text, "%d-%d-%dT%d:%d:%d", &ts.tm_year, &ts.tm_mon,
+                    &ts.tm_mday, &ts.tm_hour, &ts.tm_min, &ts.tm_sec) != 6) {
+        return std::nullopt;
+    }
+    ts.tm_year -= 1900;
+    ts.tm_mon -= 1;
+    return ts;
+}
+
+exif::FileStamp exif::FileStamp::Of(const std::string &path) {
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(path, ec);
+    if (ec) {
+        return {};
+    }
+    const auto mtime = std::filesystem::last_write_time(path, ec);
+    if (ec) {
+        return {};
+    }
+    return {static_cast<int64_t>(size),
+            static_cast<int64_t>(mtime.time_since_epoch().count())};
+}
+
+exif::Cache::Cache(const std::string &path)
+    : db_(nullptr), stmt_put_(nullptr) {
+    if (sqlite3_open(path.c_str(), &db_) != SQLITE_OK) {
+        const std::string msg = sqlite3_errmsg(db_);
+        sqlite3_close(db_);
+        throw std::runtime_error("Can't open cache " + path + ": " + msg);
+    }
+
+    try {
+        int version = 0;
+        sqlite3_stmt *stmt = prepare(db_, "PRAGMA user_version;");
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            version = sqlite3_column_int(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+
+        if (version != kSchemaVersion) {
+            exe_sql(db_, kSqlNew);
+            exe_sql(db_, ("PRAGMA user_version = " +
+                          std::to_string(kSchemaVersion) + ";")
+                             .c_str());
+        }
+        stmt_put_ = prepare(db_, kSqlPut);
+    } catch (...) {
+        sqlite3_close(db_);
+        throw;
+    }
+}
+
+// An uncommitted transaction is rolled back on close.
+exif::Cache::~Cache() {
+    sqlite3_finalize(stmt_put_);
+    sqlite3_close(db_);
+}
+
+void exif::Cache::Load(const std::string &dir) {
+    // [dir/, dir0): '0' follows '/' in ASCII
+    std::string lo = (std::filesystem::absolute(dir).lexically_normal() / "")
+                         .string();
+    std::string hi = lo;
+    hi.back() += 1;
+
+    entries_.clear();
+    sqlite3_stmt *stmt = prepare(db_, kSqlSelect);
+    sqlite3_bind_text(stmt, 1, lo.data(), lo.size(), SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, hi.data(), hi.size(), SQLITE_STATIC);
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        Attrs attrs;
+        attrs.exif_ver = col_str(stmt, 3);
+        attrs.desc = col_str(stmt, 4);
+        attrs.model = col_str(stmt, 5);
+        attrs.height = col_int(stmt, 6);
+        attrs.width = col_int(stmt, 7);
+        attrs.lat = col_dbl(stmt, 8);
+        attrs.lon = col_dbl(stmt, 9);
+        attrs.altitude = col_dbl(stmt, 10);
+        attrs.ts_gps = col_tm(stmt, 11);
+        attrs.coc = col_dbl(stmt, 12);
+        attrs.subj_dist = col_dbl(stmt, 13);
+        attrs.iso = col_int(stmt, 14);
+        attrs.aperture = col_dbl(stmt, 15);
+        attrs.shutter_speed = col_dbl(stmt, 16);
+        attrs.exposure_time = col_dbl(stmt, 17);
+        attrs.focal_length = col_dbl(stmt, 18);
+        attrs.hyperfocal_dist = col_dbl(stmt, 19);
+
+        const FileStamp kStamp = {sqlite3_column_int64(stmt, 1),
+                                  sqlite3_column_int64(stmt, 2)};
+        entries_.emplace(*col_str(stmt, 0),
+                         std::make_pair(kStamp, std::move(attrs)));
+    }
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        throw std::runtime_error(std::string("Cache SQL error: ") +
+                                 sqlite3_errmsg(db_));
+    }
+
+    exe_sql(db_, "BEGIN TRANSACTION;");
+}
+
+const exif::Attrs *exif::Cache::Find(const std::string &path,
+                                     const FileStamp &stamp) const {
+    if (stamp.size < 0) {
+        return nullptr;
+    }
+    const auto it = entries_.find(abs_key(path));
+    if (it == entries_.end() || it->second.first != stamp) {
+        return nullptr;
+    }
+    return &it->second.second;
+}
+
+void exif::Cache::Put(const Attrs &attrs, const FileStamp &stamp) {
+    if (stamp.size < 0) {
+        return;
+    }
+    const std::string kKey = abs_key(attrs.path);
+    sqlite3_stmt *stmt = stmt_put_;
+    sqlite3_reset(stmt);
+    sqlite3_bind_text(stmt, 1, kKey.data(), kKey.size(), SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 2, stamp.size);
+    sqlite3_bind_int64(stmt, 3, stamp.mtime);
+    bind(stmt, 4, attrs.exif_ver);
+    bind(stmt, 5, attrs.desc);
+    bind(stmt, 6, attrs.model);
+    bind(stmt, 7, attrs.height);
+    bind(stmt, 8, attrs.width);
+    bind(stmt, 9, attrs.lat);
+    bind(stmt, 10, attrs.lon);
+    bind(stmt, 11, attrs.altitude);
+    bind(stmt, 12, attrs.ts_gps);
+    bind(stmt, 13, attrs.coc);
+    bind(stmt, 14, attrs.subj_dist);
+    bind(stmt, 15, attrs.iso);
+    bind(stmt, 16, attrs.aperture);
+    bind(stmt, 17, attrs.shutter_speed);
+    bind(stmt, 18, attrs.exposure_time);
+    bind(stmt, 19, attrs.focal_length);
+    bind(stmt, 20, attrs.hyperfocal_dist);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        throw std::runtime_error(std::string("Cache SQL error: ") +
+                                 sqlite3_errmsg(db_));
+    }
+}
+
+void exif::Cache::Commit(const std::vector<std::string> &paths) {
+    std::unordered_set<std::string> live;
+    live.reserve(paths.size());
+    for (const auto &path : paths) {
+        live.insert(abs_key(path));
+    }
+
+    sqlite3_stmt *stmt = prepare(db_, kSqlDelete);
+    for (const auto &[key, entry] : entries_) {
+        if (live.count(key)) {
+            continue;
+        }
+        sqlite3_reset(stmt);
+        sqlite3_bind_text(stmt, 1, key.data(), key.size(), SQLITE_STATIC);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            sqlite3_finalize(stmt);
+            throw std::runtime_error(std::string("Cache SQL error: ") +
+                                     sqlite3_errmsg(db_));
+        }
+    }
+    sqlite3_finalize(stmt);
+
+    exe_sql(db_, "COMMIT;");
+    entries_.clear();
+}
@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <iostream>
 #include <nlohmann/json.hpp>
+#include <numeric>
 #include <opencv2/opencv.hpp>
 #include <string>
 #include <vector>
@@ -10,19 +12,6 @@
 using namespace fdt;
 
 namespace {
-    // Output TSV header
-    inline static constexpr const char *kTsvHeader =
-        "prefix\timage\tcate\tlevel\tx\ty\tw\th";
-
-    // Fault-related constants
-    inline static constexpr uint8_t kNFaultLevel = 3;
-    inline static constexpr std::array<const char *, kNFaultLevel + 1>
-        kArrLevelStr = {"", "fair", "poor", "verypoor"};
-    inline static constexpr uint8_t kNFaultType = 7;
-    inline static constexpr std::array<const char *, kNFaultType> kArrTypeStr =
-        {"bump",    "crack",  "depression", "displacement",
-         "pothole", "uneven", "vegetation"};
-
     // Bounding Box-related constants
     static constexpr int kThickBorder = 15;
     static constexpr int kThickTxt = 8;
@@ -38,41 +27,6 @@ namespace {
 
 } // namespace
 
-// Get distress level of a specific fault category
-static inline constexpr uint8_t fault_level(const ibox::Fault &f,
-                                            const uint8_t idx_cate) {
-    return (static_cast<uint16_t>(f) >> (idx_cate * 2)) & 0b11;
-}
-
-// Type-wise MAX operator for Fault enum class to get the maximum level of
-// distress
-static inline void max_fault(ibox::Fault &lhs, ibox::Fault rhs) {
-    uint8_t cond;
-    for (uint8_t i = 0; i < kNFaultType; i++) {
-        cond = MAX2(fault_level(lhs, i), fault_level(rhs, i));
-        lhs = static_cast<ibox::Fault>(
-            (static_cast<uint16_t>(lhs) & ~(0b11 << (i * 2))) |
-            (cond << (i * 2)));
-    }
-}
-
-static inline const std::string faulttype2str(uint8_t type) {
-    try {
-        return kArrTypeStr.at(type);
-    } catch (const std::out_of_range &e) {
-        return "";
-    }
-}
-
-// Convert distress level to string
-static inline const std::string faultlevel2str(uint8_t level) {
-    try {
-        return kArrLevelStr.at(level);
-    } catch (const std::out_of_range &e) {
-        return "";
-    }
-}
-
 // Convert Fault to string
 // One fault type and its severity level are connected by "-", while different
 // fault types are connected by "_"
@@ -80,47 +34,51 @@ static inline std::string fault2str(ibox::Fault fault, const char c = '-',
                                     const char sep = '_') {
     uint8_t idx_level;
     std::string res = "";
-    for (uint8_t idx_type = 0; idx_type < kNFaultType; idx_type++) {
-        idx_level = fault_level(fault, idx_type);
+    for (uint8_t idx_type = 0; idx_type < ibox::kNFaultType; idx_type++) {
+        idx_level = ibox::faultLevel(fault, idx_type);
         if (idx_level != 0) {
             if (!res.empty())
                 res += sep;
-            res += faulttype2str(idx_type) + c + faultlevel2str(idx_level);
+            res += ibox::faultTypeStr(idx_type);
+            res += c;
+            res += ibox::faultLevelStr(idx_level);
         }
     }
     return res;
 }
 
-uint8_t ibox::Box::MaxSeverity() const {
-    uint8_t max_lvl = 0; // Default severity (0 = None)
+uint8_t ibox::Box::MaxSeverity() const { return maxSeverity(fault); }
 
-    // Iterate over the 7 fault categories
-    for (uint8_t idx_cate = 0; idx_cate < kNFaultType; idx_cate++) {
-        // Get the maximum severity level for each category
-        max_lvl = MAX2(max_lvl, fault_level(this->fault, idx_cate));
-    }
-
-    return max_lvl;
-}
-
-// Convert Box to TSV strings. Format:
+// Convert a box of an image, i.e. a `Box` or a `BoxSet::Rec`, to TSV
+// strings, one per fault type. Format:
 //
 //  prefix,image,cate,level,x,y,w,h
-std::string ibox::Box::ToTsv(const std::string &prefix) const {
+template <typename B>
+static std::string box_tsv(const std::string &prefix,
+                           const std::string_view image, const B &bx) {
     std::string res = "";
     uint8_t idx_level;
-    for (uint8_t idx_type = 0; idx_type < kNFaultType; idx_type++) {
-        idx_level = fault_level(this->fault, idx_type);
+    for (uint8_t idx_type = 0; idx_type < ibox::kNFaultType; idx_type++) {
+        idx_level = ibox::faultLevel(bx.fault, idx_type);
         if (idx_level != 0) {
-            res += prefix + "\t" + image + "\t" + faulttype2str(idx_type) +
-                   "\t" + faultlevel2str(idx_level) + "\t" + std::to_string(x) +
-                   "\t" + std::to_string(y) + "\t" + std::to_string(w) + "\t" +
-                   std::to_string(h) + "\n";
+            res += prefix + "\t";
+            res += image;
+            res += "\t";
+            res += ibox::faultTypeStr(idx_type);
+            res += "\t";
+            res += ibox::faultLevelStr(idx_level);
+            res += "\t" + std::to_string(bx.x) + "\t" + std::to_string(bx.y) +
+                   "\t" + std::to_string(bx.w) + "\t" + std::to_string(bx.h) +
+                   "\n";
         }
     }
     return res;
 }
 
+std::string ibox::Box::ToTsv(const std::string &prefix) const {
+    return box_tsv(prefix, image, *this);
+}
+
 std::string ibox::ImgBox::ToTsv(const std::string &prefix) const {
     std::string res = "";
     for (const auto &box : boxes) {
@@ -129,9 +87,13 @@ std::string ibox::ImgBox::ToTsv(const std::string &prefix) const {
     return res;
 }
 
-void ibox::ImgBox::Draw(const std::string &src, const std::string &dst) const {
+// Draw the boxes of an image, i.e. `Box` or `BoxSet::Rec` records, and save
+// the image under `dst` with its fault types as a name prefix
+template <typename Boxes>
+static void draw_boxes(const std::string_view image, const Boxes &boxes,
+                       const std::string &src, const std::string &dst) {
 
-    Fault fault_img = Fault::NONE;
+    ibox::Fault fault_img = ibox::Fault::NONE;
     std::filesystem::path dir_src(src);
     std::filesystem::path dir_dst(dst);
 
@@ -144,14 +106,14 @@ void ibox::ImgBox::Draw(const std::string &src, const std::string &dst) const {
     }
 
     // Step 2: Draw the Bounding Boxes
-    for (const auto &bbx : this->boxes) {
+    for (const auto &bbx : boxes) {
         // get all faults for categorizing
-        max_fault(fault_img, bbx.fault);
+        fault_img = ibox::maxFault(fault_img, bbx.fault);
 
         // Step 2.1: draw the bounding box
         const cv::Rect box(bbx.x, bbx.y, bbx.w, bbx.h);
-        cv::rectangle(img, box, kArrColor.at(bbx.MaxSeverity()), kThickBorder);
-
+        cv::rectangle(img, box, kArrColor[ibox::maxSeverity(bbx.fault)],
+                      kThickBorder);
         // Step 2.2: fault text and size
         const char sep = '|';
         std::string txt = fault2str(bbx.fault, ' ', sep);
@@ -194,12 +156,17 @@ void ibox::ImgBox::Draw(const std::string &src, const std::string &dst) const {
     }
 
     // Step 3. Save the Image
-    if (!cv::imwrite(dir_dst / (fault2str(fault_img, '_', '_') + "_" + image),
-                     img)) {
+    const std::string kName =
+        fault2str(fault_img, '_', '_') + "_" + std::string(image);
+    if (!cv::imwrite(dir_dst / kName, img)) {
         std::cerr << "Failed to save image" << std::endl;
     }
 }
 
+void ibox::ImgBox::Draw(const std::string &src, const std::string &dst) const {
+    draw_boxes(image, boxes, src, dst);
+}
+
 void ibox::drawBBox(const std::vector<ibox::ImgBox> &ibx_arr,
                     const std::string &src, const std::string &dst) {
     for (auto &ibox : ibx_arr) {
@@ -216,3 +183,125 @@ void ibox::toTsv(const std::vector<ibox::ImgBox> &ibx_arr,
         stream_o << ibx.ToTsv(prefix);
     }
 }
+
+void ibox::drawBBox(const BoxSet &boxes, const std::string &src,
+                    const std::string &dst) {
+    for (const auto view : boxes) {
+        draw_boxes(view.image, view.boxes, src, dst);
+    }
+}
+
+void ibox::toTsv(const BoxSet &boxes, const std::string &prefix,
+                 std::ostream &stream_o) {
+    stream_o << kTsvHeader << std::endl;
+    for (const auto view : boxes) {
+        for (const auto &rec : view.boxes) {
+            stream_o << box_tsv(prefix, view.image, rec);
+        }
+    }
+}
+
+void ibox::BoxSet::Part::Add(const std::string_view image, const Rec &rec) {
+    // rows of an image are usually adjacent
+    if (names_.empty() || names_[last_] != image) {
+        const auto it = ids_.find(image);
+        if (it == ids_.end()) {
+            last_ = static_cast<uint32_t>(names_.size());
+            names_.emplace_back(image);
+            ids_.emplace(names_.back(), last_);
+        } else {
+            last_ = it->second;
+        }
+    }
+    recs_.emplace_back(last_, rec);
+}
+
+ibox::BoxSet::BoxSet() : data_(std::make_unique<Data>()) {}
+
+ibox::BoxSet::BoxSet(std::vector<Part> &&parts) : BoxSet() {
+    // Names of all parts, and the index of each part's names among them
+    std::unordered_map<std::string_view, uint32_t> ids;
+    std::vector<std::string_view> names;
+    std::vector<std::vector<uint32_t>> remap(parts.size());
+    for (size_t p = 0; p < parts.size(); ++p) {
+        for (const auto &name : parts[p].names_) {
+            const auto [it, added] =
+                ids.emplace(name, static_cast<uint32_t>(names.size()));
+            if (added) {
+                names.push_back(name);
+            }
+            remap[p].push_back(it->second);
+        }
+    }
+
+    // Rank of each name, and the boxes by rank
+    std::vector<uint32_t> order(names.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [&names](const uint32_t a, const uint32_t b) {
+                  return names[a] < names[b];
+              });
+    std::vector<uint32_t> rank(names.size());
+    for (size_t r = 0; r < order.size(); ++r) {
+        rank[order[r]] = static_cast<uint32_t>(r);
+    }
+    std::vector<uint32_t> count(names.size(), 0);
+    for (size_t p = 0; p < parts.size(); ++p) {
+        for (const auto &[id, rec] : parts[p].recs_) {
+            count[rank[remap[p][id]]] += rec.fault != Fault::NONE;
+        }
+    }
+
+    // Names of the images with boxes, copied into one block of the arena,
+    // and the first slot of the boxes of each rank
+    size_t n_chars = 0;
+    size_t n_images = 0;
+    for (size_t r = 0; r < order.size(); ++r) {
+        n_chars += count[r] > 0 ? names[order[r]].size() : 0;
+        n_images += count[r] > 0;
+    }
+    char *chars = static_cast<char *>(data_->arena.allocate(n_chars + 1, 1));
+    data_->names.reserve(n_images);
+    data_->offsets.reserve(n_images + 1);
+    data_->offsets.push_back(0);
+    std::vector<uint32_t> slot(names.size());
+    uint32_t n_recs = 0;
+    for (size_t r = 0; r < order.size(); ++r) {
+        if (count[r] == 0) {
+            continue;
+        }
+        const std::string_view kName = names[order[r]];
+        std::copy(kName.begin(), kName.end(), chars);
+        data_->names.emplace_back(chars, kName.size());
+        chars += kName.size();
+        slot[r] = n_recs;
+        n_recs += count[r];
+        data_->offsets.push_back(n_recs);
+    }
+
+    // Boxes in place, stable within each image
+    data_->recs.resize(n_recs);
+    for (size_t p = 0; p < parts.size(); ++p) {
+        for (const auto &[id, rec] : parts[p].recs_) {
+            if (rec.fault != Fault::NONE) {
+                data_->recs[slot[rank[remap[p][id]]]++] = rec;
+            }
+        }
+    }
+}
+
+std::vector<ibox::ImgBox> ibox::BoxSet::ToImgBoxes() const {
+    std::vector<ImgBox> ibx_arr;
+    ibx_arr.reserve(Size());
+    for (const auto view : *this) {
+        ImgBox ibx;
+        ibx.image = view.image;
+        ibx.boxes.reserve(view.boxes.size());
+        for (const auto &r : view.boxes) {
+            ibx.boxes.push_back(
+                {r.x, r.y, r.w, r.h, ibx.image, r.fault, r.score});
+        }
+        ibx_arr.push_back(std::move(ibx));
+    }
+    return ibx_arr;
+}
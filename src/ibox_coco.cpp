@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+#include "ibox.hpp"
+#include "utils.hpp"
+
+using namespace fdt;
+
+namespace {
+    // Top-level arrays of a COCO document
+    enum class Section : uint8_t {
+        OTHER = 0,
+        IMAGES,
+        CATEGORIES,
+        ANNOTATIONS,
+    };
+
+    // Index of records by COCO id: a flat array of (id, index) pairs sorted
+    // by id, i.e. 16 bytes per record and no node allocation
+    class IdIndex {
+      public:
+        void Add(const int64_t id, const uint32_t idx) {
+            pairs_.emplace_back(id, idx);
+        }
+
+        void Seal() { std::sort(pairs_.begin(), pairs_.end()); }
+
+        // Index of an id, or -1 if there is none
+        int64_t Find(const int64_t id) const {
+            const auto it = std::lower_bound(
+                pairs_.begin(), pairs_.end(), std::make_pair(id, uint32_t{0}));
+            if (it == pairs_.end() || it->first != id) {
+                return -1;
+            }
+            return it->second;
+        }
+
+      private:
+        std::vector<std::pair<int64_t, uint32_t>> pairs_;
+    };
+
+    struct CocoImage {
+        std::string prefix;
+        std::string image;
+    };
+
+    struct CocoCate {
+        std::string cate;
+        std::string level;
+    };
+
+    // SAX handler walking the records of the top-level arrays. The fields of
+    // a record are its scalar members and the numbers of its `bbox`; nested
+    // values such as segmentations are skipped. A pass either reads images
+    // and categories, or streams the annotations as TSV rows.
+    class CocoSax : public nlohmann::json_sax<nlohmann::json> {
+      public:
+        CocoSax(const std::string &prefix, std::ostream *out)
+            : prefix_(prefix), out_(out), depth_(0),
+              section_(Section::OTHER) {}
+
+        // Images and categories indexed by id, filled by the first pass
+        std::vector<CocoImage> images;
+        std::vector<CocoCate> cates;
+        IdIndex image_ids, cate_ids;
+        size_t skipped = 0; // annotations of unknown images or categories
+
+        bool null() override { return true; }
+
+        bool boolean(bool) override { return true; }
+
+        bool number_integer(number_integer_t val) override {
+            return number(static_cast<double>(val), val);
+        }
+
+        bool number_unsigned(number_unsigned_t val) override {
+            return number(static_cast<double>(val),
+                          static_cast<int64_t>(val));
+        }
+
+        bool number_float(number_float_t val, const string_t &) override {
+            return number(val, static_cast<int64_t>(val));
+        }
+
+        bool string(string_t &val) override {
+            if (depth_ == kDepthField) {
+                if (key_ == "file_name") {
+                    file_name_ = std::move(val);
+                } else if (key_ == "name") {
+                    name_ = std::move(val);
+                }
+            }
+            return true;
+        }
+
+        bool binary(binary_t &) override { return true; }
+
+        bool start_object(std::size_t) override {
+            if (++depth_ == kDepthField) {
+                rec_ = {};
+                file_name_.clear();
+                name_.clear();
+            }
+            return true;
+        }
+
+        bool end_object() override {
+            if (depth_-- == kDepthField) {
+                end_record();
+            }
+            return true;
+        }
+
+        bool start_array(std::size_t) override {
+            ++depth_;
+            return true;
+        }
+
+        bool end_array() override {
+            --depth_;
+            return true;
+        }
+
+        bool key(string_t &val) override {
+            if (depth_ == 1) {
+                section_ = val == "images"        ? Section::IMAGES
+                           : val == "categories"  ? Section::CATEGORIES
+                           : val == "annotations" ? Section::ANNOTATIONS
+                                                  : Section::OTHER;
+            } else if (depth_ == kDepthField) {
+                key_ = std::move(val);
+                n_bbox_ = 0;
+            }
+            return true;
+        }
+
+        bool parse_error(std::size_t pos, const std::string &,
+                         const nlohmann::detail::exception &e) override {
+            throw std::runtime_error("Invalid COCO JSON at byte " +
+                                     std::to_string(pos) + ": " + e.what());
+        }
+
+      private:
+        // Depth of the members of a record: root object, array, record
+        static constexpr int kDepthField = 3;
+
+        // Fields of the record being read
+        struct Record {
+            int64_t id = 0;
+            int64_t image_id = 0;
+            int64_t category_id = 0;
+            std::array<double, 4> bbox{};
+        };
+
+        bool number(const double val, const int64_t ival) {
+            if (depth_ == kDepthField) {
+                if (key_ == "id") {
+                    rec_.id = ival;
+                } else if (key_ == "image_id") {
+                    rec_.image_id = ival;
+                } else if (key_ == "category_id") {
+                    rec_.category_id = ival;
+                }
+            } else if (depth_ == kDepthField + 1 && key_ == "bbox" &&
+                       n_bbox_ < rec_.bbox.size()) {
+                rec_.bbox[n_bbox_++] = val;
+            }
+            return true;
+        }
+
+        void end_record() {
+            if (out_ == nullptr) {
+                if (section_ == Section::IMAGES) {
+                    image_ids.Add(rec_.id, images.size());
+                    images.push_back(split_file_name(file_name_));
+                } else if (section_ == Section::CATEGORIES) {
+                    cate_ids.Add(rec_.id, cates.size());
+                    cates.push_back(split_cate(name_));
+                }
+                return;
+            }
+            if (section_ != Section::ANNOTATIONS) {
+                return;
+            }
+            const int64_t kImg = image_ids.Find(rec_.image_id);
+            const int64_t kCate = cate_ids.Find(rec_.category_id);
+            if (kImg < 0 || kCate < 0) {
+                ++skipped;
+                return;
+            }
+            const auto &img = images[kImg];
+            const auto &cate = cates[kCate];
+            row_.clear();
+            row_ += img.prefix;
+            row_ += '\t';
+            row_ += img.image;
+            row_ += '\t';
+            row_ += cate.cate;
+            row_ += '\t';
+            row_ += cate.level;
+            for (const double v : rec_.bbox) {
+                row_ += '\t';
+                row_ += std::to_string(std::lround(v));
+            }
+            row_ += '\n';
+            out_->write(row_.data(), row_.size());
+        }
+
+        // "<prefix>/<image>", or the default prefix if there is no directory
+        CocoImage split_file_name(const std::string &file_name) const {
+            const size_t kSlash = file_name.find_last_of('/');
+            if (kSlash == std::string::npos) {
+                return {prefix_, file_name};
+            }
+            return {file_name.substr(0, kSlash), file_name.substr(kSlash + 1)};
+        }
+
+        // "<cate>-<level>" or "<cate>_<level>" if the suffix is a level
+        static CocoCate split_cate(const std::string &name) {
+            const size_t kSep = name.find_last_of("-_");
+            if (kSep != std::string::npos) {
+                const std::string kLevel = name.substr(kSep + 1);
+                if (ibox::faultLevelOf(kLevel) != 0) {
+                    return {name.substr(0, kSep), kLevel};
+                }
+            }
+            return {name, ""};
+        }
+
+        const std::string &prefix_;
+        std::ostream *out_; // null in the first pass
+        int depth_;
+        Section section_;
+        std::string key_;
+        Record rec_;
+        size_t n_bbox_ = 0;
+        std::string file_name_;
+        std::string name_;
+        std::string row_;
+    };
+
+} // namespace
+
+// Parse the whole document with the handler from the start of the stream
+static void sax_pass(std::istream &is, CocoSax &sax) {
+    is.clear();
+    is.seekg(0);
+    nlohmann::json::sax_parse(is, &sax);
+}
+
+void ibox::cocoToTsv(const std::string &coco_file, const std::string &prefix,
+                     std::ostream &stream_o) {
+    std::ifstream is(coco_file, std::ios::binary);
+    if (!is) {
+        throw std::runtime_error("Unable to open " + coco_file);
+    }
+
+    // Pass 1: images and categories
+    CocoSax index(prefix, nullptr);
+    sax_pass(is, index);
+    index.image_ids.Seal();
+    index.cate_ids.Seal();
+
+    // Pass 2: annotations, resolved and written as they are read
+    CocoSax rows(prefix, &stream_o);
+    rows.images = std::move(index.images);
+    rows.cates = std::move(index.cates);
+    rows.image_ids = std::move(index.image_ids);
+    rows.cate_ids = std::move(index.cate_ids);
+    stream_o << kTsvHeader << std::endl;
+    sax_pass(is, rows);
+    if (rows.skipped > 0) {
+        std::cerr << "Skipped " << rows.skipped
+                  << " annotations of unknown images or categories"
+                  << std::endl;
+    }
+}
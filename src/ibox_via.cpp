@@ -1,8 +1,15 @@
+#include <algorithm>
+#include <atomic>
+#include <charconv>
 #include <csv.hpp>
+#include <future>
 #include <iostream>
 #include <nlohmann/json.hpp>
 #include <opencv2/opencv.hpp>
+#include <optional>
+#include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "ibox.hpp"
@@ -11,285 +18,540 @@
 using namespace fdt;
 
 namespace {
-    // Define the FaultType enum class
-    enum class FaultType : uint8_t {
-        NONE = 0,
-        BUMP,
-        CRACK,
-        DEPRESSION,
-        DISPLACEMENT,
-        POTHOLE,
-        UNEVEN,
-        VEGETATION,
-    };
+    // Bounding Box-related constants
+    static const cv::Scalar kTxtColor(255, 255, 255); // White
+    static const cv::Scalar kLineColor(0, 255, 0);    // Green
 
-    // Define the FaultLevel enum class
-    enum class FaultLevel : uint8_t {
-        NONE = 0,
-        FAIR = 1,
-        POOR = 2,
-        VPOOR = 3,
-    };
+} // namespace
 
-    static const std::unordered_map<std::string, FaultType> kMapType = {
-        {"bump", FaultType::BUMP},
-        {"crack", FaultType::CRACK},
-        {"depression", FaultType::DEPRESSION},
-        {"displacement", FaultType::DISPLACEMENT},
-        {"pothole", FaultType::POTHOLE},
-        {"uneven", FaultType::UNEVEN},
-        {"vegetation", FaultType::VEGETATION},
+namespace {
+    // Fault of the region attributes of a VIA region. Only keys matter: all
+    // fault types are set, at the level of the first condition. Conditions
+    // used to come out of a JSON DOM in key order, so the first one is the
+    // least key.
+    class RegionFault {
+      public:
+        void AddType(const std::string_view key) {
+            // an unknown type sets bit 7, which `faultOf` ignores
+            types_ |= 1 << ibox::faultTypeOf(key);
+        }
+
+        void AddCondition(const std::string_view key) {
+            if (!has_cond_ || key < cond_) {
+                has_cond_ = true;
+                cond_ = key;
+            }
+        }
+
+        // False without a valid condition or fault type
+        bool Get(ibox::Fault &fault) const {
+            const uint8_t kLevel = has_cond_ ? ibox::faultLevelOf(cond_) : 0;
+            fault = ibox::faultOf(types_, kLevel);
+            return fault != ibox::Fault::NONE;
+        }
+
+        void Clear() {
+            types_ = 0;
+            has_cond_ = false;
+            cond_.clear();
+        }
+
+      private:
+        uint8_t types_ = 0; // bit t for fault type t
+        bool has_cond_ = false;
+        std::string cond_;
     };
 
-    static const std::unordered_map<std::string, FaultLevel> kMapLevel = {
-        {"fair", FaultLevel::FAIR},
-        {"poor", FaultLevel::POOR},
-        {"verypoor", FaultLevel::VPOOR},
+    // Columns of a VIA CSV export that make a box
+    static constexpr const char *kViaColFile = "filename";
+    static constexpr const char *kViaColShape = "region_shape_attributes";
+    static constexpr const char *kViaColRegion = "region_attributes";
+    static constexpr std::string_view kUtf8Bom = "\xEF\xBB\xBF";
+
+    // A field of a CSV record, viewed in place: the content of a quoted field
+    // still has its quotes doubled
+    struct CsvField {
+        std::string_view raw;
+        bool quoted;
     };
 
-    // Bounding Box-related constants
-    static const cv::Scalar kTxtColor(255, 255, 255); // White
-    static const cv::Scalar kLineColor(0, 255, 0);    // Green
+    // Cursor over the JSON object of an attribute column. In a quoted field a
+    // JSON quote is written as two, e.g. {""x"":2744}.
+    class AttrScanner {
+      public:
+        AttrScanner(const CsvField &field)
+            : s_(field.raw), pos_(0), n_quote_(field.quoted ? 2 : 1) {}
+
+        // Call `on_member(key)` on each member of the object at the cursor;
+        // it must consume the value, e.g. by `SkipValue`.
+        template <typename F> void Object(F &&on_member) {
+            expect('{');
+            if (peek() == '}') {
+                ++pos_;
+                return;
+            }
+            for (;;) {
+                const std::string_view key = String();
+                expect(':');
+                on_member(key);
+                const char ch = peek();
+                ++pos_;
+                if (ch == '}') {
+                    return;
+                }
+                if (ch != ',') {
+                    fail();
+                }
+            }
+        }
+
+        bool AtObject() { return peek() == '{'; }
+
+        bool AtNumber() {
+            const char ch = peek();
+            return ch == '-' || (ch >= '0' && ch <= '9');
+        }
+
+        // A number, truncated to int as by `nlohmann::json::value<int>`
+        int Number() {
+            const char *first = s_.data() + pos_;
+            const char *last = s_.data() + s_.size();
+            int val;
+            auto res = std::from_chars(first, last, val);
+            if (res.ec == std::errc() && res.ptr != last &&
+                (*res.ptr == '.' || *res.ptr == 'e' || *res.ptr == 'E')) {
+                double val_f;
+                res = std::from_chars(first, last, val_f);
+                val = static_cast<int>(val_f);
+            }
+            if (res.ec != std::errc()) {
+                fail();
+            }
+            pos_ = res.ptr - s_.data();
+            return val;
+        }
+
+        // Raw content of a string, escapes included
+        std::string_view String() {
+            if (!quote()) {
+                fail();
+            }
+            const size_t kBegin = pos_;
+            while (pos_ < s_.size()) {
+                if (s_[pos_] == '\\') {
+                    // an escaped quote is doubled as well
+                    ++pos_;
+                    pos_ += quote() ? 0 : 1;
+                } else if (s_[pos_] == '"') {
+                    const size_t kEnd = pos_;
+                    if (!quote()) {
+                        fail();
+                    }
+                    return s_.substr(kBegin, kEnd - kBegin);
+                } else {
+                    ++pos_;
+                }
+            }
+            fail();
+        }
+
+        void SkipValue() {
+            const char ch = peek();
+            if (ch == '{') {
+                Object([this](std::string_view) { SkipValue(); });
+            } else if (ch == '[') {
+                ++pos_;
+                if (peek() == ']') {
+                    ++pos_;
+                    return;
+                }
+                for (;;) {
+                    SkipValue();
+                    if (peek() != ',') {
+                        break;
+                    }
+                    ++pos_;
+                }
+                expect(']');
+            } else if (ch == '"') {
+                String();
+            } else {
+                // number, true, false or null
+                const size_t kBegin = pos_;
+                while (pos_ < s_.size() && !is_end(s_[pos_])) {
+                    ++pos_;
+                }
+                if (pos_ == kBegin) {
+                    fail();
+                }
+            }
+        }
+
+        // Nothing but whitespace must follow the object
+        void End() {
+            if (peek() != '\0') {
+                fail();
+            }
+        }
+
+      private:
+        static bool is_end(const char ch) {
+            return ch == ',' || ch == '}' || ch == ']' || ch == ' ' ||
+                   ch == '\t' || ch == '\r' || ch == '\n';
+        }
+
+        // Next non-whitespace character, or '\0' at the end
+        char peek() {
+            while (pos_ < s_.size() &&
+                   (s_[pos_] == ' ' || s_[pos_] == '\t' || s_[pos_] == '\r' ||
+                    s_[pos_] == '\n')) {
+                ++pos_;
+            }
+            return pos_ < s_.size() ? s_[pos_] : '\0';
+        }
+
+        void expect(const char ch) {
+            if (peek() != ch) {
+                fail();
+            }
+            ++pos_;
+        }
+
+        // Consume a JSON quote if there is one
+        bool quote() {
+            if (pos_ + n_quote_ > s_.size() ||
+                s_.compare(pos_, n_quote_, "\"\"", n_quote_) != 0) {
+                return false;
+            }
+            pos_ += n_quote_;
+            return true;
+        }
+
+        [[noreturn]] void fail() const {
+            throw std::runtime_error("Invalid VIA attributes: " +
+                                     std::string(s_));
+        }
+
+        std::string_view s_;
+        size_t pos_;
+        size_t n_quote_;
+    };
 
 } // namespace
 
-// Function to set a Fault based on input type and level
-static inline void set_fault(ibox::Fault &fault, FaultType type,
-                             FaultLevel level) {
-    uint8_t ind_type = static_cast<uint8_t>(type);
-    uint8_t ind_level = static_cast<uint8_t>(level);
-    fault |= static_cast<ibox::Fault>(ind_level << (2 * (ind_type - 1)));
+// Split the CSV record at `pos` into fields in place, and move `pos` to the
+// next record; false at the end of the buffer. Records end at an unquoted
+// LF or CRLF.
+static bool next_record(const std::string_view buf, size_t &pos,
+                        std::vector<CsvField> &fields) {
+    if (pos >= buf.size()) {
+        return false;
+    }
+    fields.clear();
+    for (;;) {
+        CsvField field{{}, pos < buf.size() && buf[pos] == '"'};
+        if (field.quoted) {
+            // a quote ends the field unless it is doubled
+            size_t end = pos + 1;
+            for (; end < buf.size(); ++end) {
+                if (buf[end] == '"') {
+                    if (end + 1 == buf.size() || buf[end + 1] != '"') {
+                        break;
+                    }
+                    ++end;
+                }
+            }
+            field.raw = buf.substr(pos + 1, MIN2(end, buf.size()) - pos - 1);
+            pos = MIN2(end + 1, buf.size());
+        }
+        // unquoted content, or any stray text after the closing quote
+        size_t end = pos;
+        while (end < buf.size() && buf[end] != ',' && buf[end] != '\n' &&
+               buf[end] != '\r') {
+            ++end;
+        }
+        if (!field.quoted) {
+            field.raw = buf.substr(pos, end - pos);
+        }
+        fields.push_back(field);
+        pos = end;
+        if (pos < buf.size() && buf[pos] == ',') {
+            ++pos;
+            continue;
+        }
+        if (pos < buf.size() && buf[pos] == '\r') {
+            ++pos;
+        }
+        if (pos < buf.size() && buf[pos] == '\n') {
+            ++pos;
+        }
+        return true;
+    }
 }
 
-static inline FaultLevel str2faultlevel(const std::string &str) {
-    try {
-        return kMapLevel.at(str);
-    } catch (const std::out_of_range &e) {
-        return FaultLevel::NONE;
+// Unescaped content of a field
+static std::string unquote(const CsvField &field) {
+    if (!field.quoted || field.raw.find('"') == std::string_view::npos) {
+        return std::string(field.raw);
+    }
+    std::string str;
+    for (size_t i = 0; i < field.raw.size(); ++i) {
+        str += field.raw[i];
+        i += field.raw[i] == '"';
     }
+    return str;
 }
 
-static inline FaultType str2faulttype(const std::string &str) {
-    try {
-        return kMapType.at(str);
-    } catch (const std::out_of_range &e) {
-        return FaultType::NONE;
+// Box of the attribute columns of a VIA CSV record; false if the region has
+// no condition or fault type.
+static bool via_csv_box(const CsvField &shape, const CsvField &region,
+                        ibox::BoxSet::Rec &bx) {
+    RegionFault fault;
+    AttrScanner sc_region(region);
+    sc_region.Object([&](const std::string_view key) {
+        const bool kFault = key == "fault";
+        if ((!kFault && key != "condition") || !sc_region.AtObject()) {
+            sc_region.SkipValue();
+            return;
+        }
+        sc_region.Object([&](const std::string_view k) {
+            sc_region.SkipValue();
+            if (kFault) {
+                fault.AddType(k);
+            } else {
+                fault.AddCondition(k);
+            }
+        });
+    });
+    sc_region.End();
+    if (!fault.Get(bx.fault)) {
+        return false;
     }
-}
 
-// Parse CSV line
-//
-// example CSV line:
-//   G0019580.JPG,3117257,"{}",3,2,
-//   "{""name"":""rect"",""x"":2744,""y"":390,""width"":86,""height"":503}",
-//   "{""fault"":{""crack"":true},""condition"":{""fair"":true}}"
-// task:
-//   - skip comma in curly brace
-//   - reduce double double-quote to single double-quote
-static std::vector<std::string> parse_csv_line(const std::string &line) {
-    std::vector<std::string> result;
-    std::string cell;
-
-    uint8_t braces = 0; // skip comma in curly brace
-    bool quote = false; // detect double double-quote
-    for (char ch : line) {
-        // whether push cell to result or not, depends on comma and in_brace
-        if (ch == ',' && braces == 0) {
-            result.push_back(cell);
-            cell.clear();
-        } else if (ch == '{') {
-            braces += 1;
-        } else if (ch == '}') {
-            braces -= 1;
-        }
-
-        // whether add ch to cell or not, depends on quote and double
-        // double-quote
-        if (ch == ',' && braces == 0) {
-            // comma outside of curly brace; do NOT add ch
-            quote = false;
-            continue;
-        } else if (ch == ',' && braces != 0) {
-            // comma inside of curly brace; add ch
-            quote = false;
-            cell += ch;
-        } else if (ch == '"' && !quote) {
-            // do NOT add ch as we do not know if it is a single or double
-            quote = true;
-        } else if (ch != '"' && quote) {
-            // two conditions:
-            // 1. single double-quote (ch != '"' && quote):
-            //    usually ch is '{' or ','
-            quote = false;
-            cell += ch;
-        } else if (ch == '"' && quote) {
-            // double double-quote; used for key or value; add one double-quote
-            quote = false;
-            cell += ch;
+    bx.x = bx.y = bx.w = bx.h = -1;
+    AttrScanner sc_shape(shape);
+    sc_shape.Object([&](const std::string_view key) {
+        int *dst = key == "x"        ? &bx.x
+                   : key == "y"      ? &bx.y
+                   : key == "width"  ? &bx.w
+                   : key == "height" ? &bx.h
+                                     : nullptr;
+        if (dst != nullptr && sc_shape.AtNumber()) {
+            *dst = sc_shape.Number();
         } else {
-            cell += ch;
+            sc_shape.SkipValue();
         }
+    });
+    sc_shape.End();
+    return true;
+}
+
+// Boxes of a VIA CSV export, tokenised in place in one pass: the attribute
+// columns are scanned where they lie instead of being copied out and parsed
+// into JSON documents.
+static ibox::BoxSet::Part via_csv_boxes(std::string_view buf) {
+    ibox::BoxSet::Part boxes;
+    if (buf.substr(0, kUtf8Bom.size()) == kUtf8Bom) {
+        buf.remove_prefix(kUtf8Bom.size());
     }
 
-    if (!cell.empty()) {
-        result.push_back(cell); // Add the last cell
+    size_t pos = 0;
+    std::vector<CsvField> fields;
+    if (!next_record(buf, pos, fields)) {
+        return boxes;
+    }
+    size_t i_file = SIZE_MAX, i_shape = SIZE_MAX, i_region = SIZE_MAX;
+    for (size_t i = 0; i < fields.size(); ++i) {
+        const auto &name = fields[i].raw;
+        i_file = name == kViaColFile ? i : i_file;
+        i_shape = name == kViaColShape ? i : i_shape;
+        i_region = name == kViaColRegion ? i : i_region;
     }
+    if (MAX2(MAX2(i_file, i_shape), i_region) == SIZE_MAX) {
+        return boxes;
+    }
+    const size_t kNCols = MAX2(MAX2(i_file, i_shape), i_region) + 1;
 
-    return result;
+    ibox::BoxSet::Rec bx;
+    while (next_record(buf, pos, fields)) {
+        if (fields.size() < kNCols ||
+            !via_csv_box(fields[i_shape], fields[i_region], bx)) {
+            continue;
+        }
+        boxes.Add(unquote(fields[i_file]), bx);
+    }
+    return boxes;
 }
 
-static nlohmann::json viacsv2json(std::istream &stream) {
-    std::string line;
-    getline(stream, line); // Read the header line
-
-    std::vector<std::string> header = parse_csv_line(line);
+namespace {
+    static constexpr const char *kViaMeta = "_via_img_metadata";
 
-    nlohmann::json jsonArray;
+    // SAX handler collecting the boxes of the images of `_via_img_metadata`.
+    // The regions of an image are held until the image ends, as its file name
+    // may come after them, so memory is bounded by the regions of one image.
+    //
+    // Depths: root 1, `_via_img_metadata` 2, image 3, `regions` 4, region 5,
+    // its `shape_attributes` and `region_attributes` 6, `fault` and
+    // `condition` 7. Other members, and deeper values, are skipped.
+    class ViaSax : public nlohmann::json_sax<nlohmann::json> {
+      public:
+        explicit ViaSax(ibox::BoxSet::Part &boxes) : boxes_(boxes) {}
 
-    while (getline(stream, line)) {
-        std::vector<std::string> values = parse_csv_line(line);
+        bool null() override { return true; }
 
-        nlohmann::json j;
+        bool boolean(bool) override { return true; }
 
-        for (size_t i = 0; i < header.size() && i < values.size(); ++i) {
-            if (header[i] == "region_shape_attributes" ||
-                header[i] == "region_attributes") {
-                j[header[i]] = nlohmann::json::parse(values[i]);
-            } else {
-                j[header[i]] = values[i];
-            }
+        bool number_integer(number_integer_t val) override {
+            return number(static_cast<int>(val));
         }
 
-        jsonArray.push_back(j);
-    }
+        bool number_unsigned(number_unsigned_t val) override {
+            return number(static_cast<int>(val));
+        }
 
-    return jsonArray;
-}
+        bool number_float(number_float_t val, const string_t &) override {
+            return number(static_cast<int>(val));
+        }
 
-static nlohmann::json viajson2json(std::istream &stream) {
-    nlohmann::json json_raw, json_array;
-    try {
-        stream >> json_raw;
-    } catch (const nlohmann::json::parse_error &e) {
-        std::cerr << "Raw JSON Parse Error: " << e.what() << "\n";
-        return 2;
-    }
+        bool string(string_t &val) override {
+            if (depth_ == kDepthImage && in_meta_ && key_image_ == "filename") {
+                filename_ = std::move(val);
+            }
+            return true;
+        }
 
-    // Loop through "_via_img_metadata"
-    for (auto &[key, value] : json_raw["_via_img_metadata"].items()) {
-        nlohmann::json j;
-
-        // skip empty "regions" as no fault is detected
-        if (!value["regions"].empty()) {
-            for (const auto &region : value["regions"]) {
-                j["filename"] = value["filename"];
-                j["region_attributes"] = region["region_attributes"];
-                j["region_shape_attributes"] = region["shape_attributes"];
-                // most fine-grained data; no grouping
-                json_array.push_back(j);
+        bool binary(binary_t &) override { return true; }
+
+        bool start_object(std::size_t) override {
+            ++depth_;
+            if (depth_ == kDepthMeta) {
+                in_meta_ = meta_key_;
+            } else if (depth_ == kDepthImage && in_meta_) {
+                filename_.clear();
+                key_image_.clear();
+                regions_.clear();
+            } else if (depth_ == kDepthRegion && in_regions()) {
+                key_region_.clear();
+                key_attr_.clear();
+                bx_.x = bx_.y = bx_.w = bx_.h = -1;
+                fault_.Clear();
             }
+            return true;
         }
-    }
-    return json_array;
-}
 
-// Convert JSON to std::vector<ibox::Box>
-//
-// Example JSON:
-//
-// - ["region_attributes"]["condition"]: {"fair": true}
-// - ["region_attributes"]["fault"]: {"crack": true}
-// - ["region_shape_attributes"]:
-//   {"x": 2744, "y": 390, "width": 86, "height": 503}
-//
-// NOTE:
-//
-// - Records contain missing keys; without explicit check, the program will
-//   crash.
-// - For each valid record, ["region_attributes"]["condition"], i.e. level, has
-//   at most one key-value pair. We only process the first item and discard the
-//   rest.
-// - ["region_attributes"]["fault"] may contain multiple valid key-value pairs.
-//   Add them all to one fault for one record.
-// - For all key-value pairs of both ["region_attributes"]["condition"] and
-//   ["region_attributes"]["fault"], ONLY KEYS MATTER. Valid values are always
-//   true, and thus they are IGNORED.
-static std::vector<ibox::Box> json2boxarr(const nlohmann::json &json) {
-    std::vector<ibox::Box> boxes;
-    for (auto &j : json) {
-
-        // Skip record if
-        // - any required key is missing
-        // - any required field is empty
-        if (!j.contains("filename") || !j.contains("region_attributes") ||
-            !j.contains("region_shape_attributes")) {
-            continue;
-        } else if (!j["region_attributes"].contains("condition") ||
-                   !j["region_attributes"].contains("fault")) {
-            continue;
-        } else if (j["region_attributes"]["condition"].empty() ||
-                   j["region_attributes"]["fault"].empty()) {
-            continue;
+        bool end_object() override {
+            if (depth_ == kDepthRegion && in_regions() &&
+                fault_.Get(bx_.fault)) {
+                regions_.push_back(bx_);
+            } else if (depth_ == kDepthImage && in_meta_ &&
+                       !filename_.empty()) {
+                for (const auto &bx : regions_) {
+                    boxes_.Add(filename_, bx);
+                }
+                regions_.clear();
+            } else if (depth_ == kDepthMeta) {
+                in_meta_ = false;
+            }
+            --depth_;
+            return true;
         }
 
-        ibox::Fault fault = ibox::Fault::NONE;
-        FaultType type = FaultType::NONE;
+        bool start_array(std::size_t) override {
+            ++depth_;
+            return true;
+        }
 
-        // Process only the first valid item in "condition"
-        auto level_it = j["region_attributes"]["condition"].items().begin();
-        FaultLevel level = str2faultlevel(level_it.key());
-        // Skip if the level is invalid
-        if (level == FaultLevel::NONE) {
-            continue;
+        bool end_array() override {
+            --depth_;
+            return true;
         }
 
-        // Loop to include all valid fault types
-        for (auto &type_it : j["region_attributes"]["fault"].items()) {
-            type = str2faulttype(type_it.key());
-            if (type == FaultType::NONE) {
-                continue;
-            } else {
-                set_fault(fault, type, level);
+        bool key(string_t &val) override {
+            if (depth_ == 1) {
+                meta_key_ = val == kViaMeta;
+            } else if (depth_ == kDepthImage) {
+                key_image_ = std::move(val);
+            } else if (depth_ == kDepthRegion) {
+                key_region_ = std::move(val);
+            } else if (depth_ == kDepthAttr) {
+                key_attr_ = std::move(val);
+            } else if (depth_ == kDepthAttr + 1 && in_regions() &&
+                       key_region_ == "region_attributes") {
+                // only keys matter
+                if (key_attr_ == "fault") {
+                    fault_.AddType(val);
+                } else if (key_attr_ == "condition") {
+                    fault_.AddCondition(val);
+                }
             }
+            return true;
         }
 
-        ibox::Box bx;
-        bx.image = j["filename"];
-        bx.x = j["region_shape_attributes"].value("x", -1);
-        bx.y = j["region_shape_attributes"].value("y", -1);
-        bx.w = j["region_shape_attributes"].value("width", -1);
-        bx.h = j["region_shape_attributes"].value("height", -1);
-        bx.fault = fault;
+        bool parse_error(std::size_t, const std::string &,
+                         const nlohmann::detail::exception &e) override {
+            std::cerr << "Raw JSON Parse Error: " << e.what() << "\n";
+            return false;
+        }
 
-        boxes.push_back(bx);
-    }
-    return boxes;
-}
+      private:
+        static constexpr int kDepthMeta = 2;
+        static constexpr int kDepthImage = 3;
+        static constexpr int kDepthRegion = 5;
+        static constexpr int kDepthAttr = 6;
 
-static std::vector<ibox::ImgBox>
-boxarr2imgboxarr(const std::vector<ibox::Box> &boxes) {
-    std::map<std::string, std::vector<ibox::Box>> img_map;
+        // Whether the cursor is in a region of an image
+        bool in_regions() const {
+            return in_meta_ && depth_ >= kDepthRegion &&
+                   key_image_ == "regions";
+        }
 
-    // Group the boxes by their image
-    for (const auto &b : boxes) {
-        // skip box with no faults and conditions
-        // parse b.fault as uint32_t to check if it is 0
-        if (*(uint32_t *)&b.fault == 0) {
-            continue;
+        bool number(const int val) {
+            if (depth_ != kDepthAttr || !in_regions() ||
+                key_region_ != "shape_attributes") {
+                return true;
+            }
+            if (key_attr_ == "x") {
+                bx_.x = val;
+            } else if (key_attr_ == "y") {
+                bx_.y = val;
+            } else if (key_attr_ == "width") {
+                bx_.w = val;
+            } else if (key_attr_ == "height") {
+                bx_.h = val;
+            }
+            return true;
         }
-        img_map[b.image].push_back(b);
-    }
 
-    // Convert the map to a vector of Boxes
-    std::vector<ibox::ImgBox> iboxes;
-    for (const auto &pair : img_map) {
-        ibox::ImgBox bb;
-        bb.image = pair.first;
-        bb.boxes = pair.second;
-        iboxes.push_back(bb);
+        ibox::BoxSet::Part &boxes_;
+        int depth_ = 0;
+        bool meta_key_ = false; // the last root key is `_via_img_metadata`
+        bool in_meta_ = false;
+        std::string key_image_, key_region_, key_attr_;
+        std::string filename_;
+        std::vector<ibox::BoxSet::Rec> regions_; // of the current image
+        ibox::BoxSet::Rec bx_;
+        RegionFault fault_;
+    };
+
+} // namespace
+
+// Boxes of a VIA project, streamed from any input of `sax_parse`; none if
+// the JSON is invalid
+template <typename Input>
+static ibox::BoxSet::Part via_json_boxes(Input &&input) {
+    ibox::BoxSet::Part boxes;
+    ViaSax sax(boxes);
+    if (!nlohmann::json::sax_parse(std::forward<Input>(input), &sax)) {
+        return {};
     }
+    return boxes;
+}
 
-    return iboxes;
+// Merge the boxes of one source into a set
+static ibox::BoxSet to_set(ibox::BoxSet::Part &&part) {
+    std::vector<ibox::BoxSet::Part> parts;
+    parts.push_back(std::move(part));
+    return ibox::BoxSet(std::move(parts));
 }
 
 // Parse CSV annotation file. Example CSV record (Box):
@@ -303,10 +565,9 @@ std::vector<ibox::ImgBox> ibox::from_via_csv(std::istream &stream_i) {
 #else
 static std::vector<ibox::ImgBox> from_via_csv(std::istream &stream_i) {
 #endif
-    const nlohmann::json json = viacsv2json(stream_i);
-    const std::vector<ibox::Box> bx_arr = json2boxarr(json);
-    const std::vector<ibox::ImgBox> ibx_arr = boxarr2imgboxarr(bx_arr);
-    return ibx_arr;
+    std::ostringstream oss;
+    oss << stream_i.rdbuf();
+    return to_set(via_csv_boxes(oss.view())).ToImgBoxes();
 }
 
 // Parse JSON annotation file. Example JSON of one image (ImgBox):
@@ -341,69 +602,114 @@ std::vector<ibox::ImgBox> ibox::from_via_json(std::istream &stream_i) {
 #else
 static std::vector<ibox::ImgBox> from_via_json(std::istream &stream_i) {
 #endif
-    const nlohmann::json json = viajson2json(stream_i);
-    const std::vector<ibox::Box> bx_arr = json2boxarr(json);
-    const std::vector<ibox::ImgBox> ibx_arr = boxarr2imgboxarr(bx_arr);
-    return ibx_arr;
+    return to_set(via_json_boxes(stream_i)).ToImgBoxes();
 }
 
-std::vector<ibox::ImgBox> ibox::fromVia(const std::string &dir) {
-    std::vector<ibox::ImgBox> iboxes;
-    for (const auto &f : fdt::utils::listAllFiles(dir, ".csv")) {
-        std::ifstream stream(f);
-        if (stream.is_open()) {
-            std::vector<ibox::ImgBox> iboxes_csv = from_via_csv(stream);
-            iboxes.insert(iboxes.end(), iboxes_csv.begin(), iboxes_csv.end());
+// Parse `n_files` files, the boxes of file `i` being `parse(i)`, on worker
+// threads claiming one file at a time, and merge them in file order
+template <typename Parse>
+static ibox::BoxSet parse_files(const size_t n_files, Parse &&parse) {
+    std::vector<ibox::BoxSet::Part> parts(n_files);
+    std::atomic<size_t> next{0};
+    const auto work = [&]() {
+        for (size_t i = next++; i < n_files; i = next++) {
+            parts[i] = parse(i);
         }
+    };
+    const size_t kThreads = MIN2(size_t{utils::nThreads(0)}, n_files);
+    std::vector<std::future<void>> futures;
+    for (size_t t = 0; t < kThreads; ++t) {
+        futures.push_back(std::async(std::launch::async, work));
     }
-    for (const auto &f : fdt::utils::listAllFiles(dir, ".json")) {
-        std::ifstream stream(f);
-        if (stream.is_open()) {
-            std::vector<ibox::ImgBox> iboxes_json = from_via_json(stream);
-            iboxes.insert(iboxes.end(), iboxes_json.begin(), iboxes_json.end());
-        }
+    for (auto &fut : futures) {
+        fut.get();
     }
-    return iboxes;
+    return ibox::BoxSet(std::move(parts));
 }
 
-#ifdef GTEST_ACCESS
-std::vector<ibox::ImgBox> ibox::from_csv_reader(csv::CSVReader &reader) {
-#else
-static std::vector<ibox::ImgBox> from_csv_reader(csv::CSVReader &reader) {
-#endif
-    std::vector<ibox::Box> bx_arr;
-    ibox::Box bx;
+void ibox::fromVia(const std::string &dir, BoxSet &boxes) {
+    // CSV exports first, then JSON projects, each by path
+    Paths files = fdt::utils::listAllFiles(dir, ".csv");
+    const size_t kNCsv = files.size();
+    std::sort(files.begin(), files.end());
+    for (auto &f : fdt::utils::listAllFiles(dir, ".json")) {
+        files.push_back(std::move(f));
+    }
+    std::sort(files.begin() + kNCsv, files.end());
+
+    const auto parse = [&files, kNCsv](const size_t i) -> BoxSet::Part {
+        // an unreadable file is skipped, as an unopened stream used to be
+        std::optional<utils::MappedFile> file;
+        try {
+            file.emplace(files[i]);
+        } catch (const std::runtime_error &e) {
+            std::cerr << "Skipped " << e.what() << std::endl;
+            return {};
+        }
+        const std::string_view buf(
+            reinterpret_cast<const char *>(file->data()), file->size());
+        return i < kNCsv ? via_csv_boxes(buf) : via_json_boxes(buf);
+    };
+    boxes = parse_files(files.size(), parse);
+}
+
+std::vector<ibox::ImgBox> ibox::fromVia(const std::string &dir) {
+    BoxSet boxes;
+    fromVia(dir, boxes);
+    return boxes.ToImgBoxes();
+}
+
+// Boxes of the rows of a TSV of labels or predictions
+static ibox::BoxSet::Part csv_reader_boxes(csv::CSVReader &reader) {
+    ibox::BoxSet::Part bx_arr;
+    ibox::BoxSet::Rec bx;
+
+    // Labels written by `toTsv` have a "cate" column and no score;
+    // predictions have "category" and its score
+    const bool kPred = reader.index_of("category") >= 0;
+    const std::string kColCate = kPred ? "category" : "cate";
+    const bool kScore = reader.index_of("score_cate_top1") >= 0;
 
     for (const auto &row : reader) {
         const auto image = row["image"].get<std::string_view>();
-        const auto level = row["level"].get<std::string>();
-        const auto cate = row["category"].get<std::string>();
+        const auto level = row["level"].get<std::string_view>();
+        const auto cate = row[kColCate].get<std::string_view>();
 
-        bx.image = image;
-        bx.fault = ibox::Fault::NONE;
         bx.x = row["x"].get<int>();
         bx.y = row["y"].get<int>();
         bx.w = row["w"].get<int>();
         bx.h = row["h"].get<int>();
-        FaultType fault_type = str2faulttype(cate);
-        FaultLevel fault_lvl = str2faultlevel(level);
-        set_fault(bx.fault, fault_type, fault_lvl);
-        bx_arr.push_back(bx);
+        bx.score = kScore ? row["score_cate_top1"].get<float>() : 1.0f;
+        bx.fault = ibox::faultOf(1 << ibox::faultTypeOf(cate),
+                                 ibox::faultLevelOf(level));
+        bx_arr.Add(image, bx);
     }
+    return bx_arr;
+}
 
-    std::vector<ibox::ImgBox> ibx_arr = boxarr2imgboxarr(bx_arr);
-    return ibx_arr;
+#ifdef GTEST_ACCESS
+std::vector<ibox::ImgBox> ibox::from_csv_reader(csv::CSVReader &reader) {
+#else
+static std::vector<ibox::ImgBox> from_csv_reader(csv::CSVReader &reader) {
+#endif
+    return to_set(csv_reader_boxes(reader)).ToImgBoxes();
 }
 
-std::vector<ibox::ImgBox> ibox::fromTsv(const std::string &dir) {
+void ibox::fromTsv(const std::string &dir, BoxSet &boxes) {
     csv::CSVFormat format;
     format.delimiter('\t').header_row(0);
 
-    std::vector<ibox::ImgBox> ibx_arr;
-    for (const auto &f : fdt::utils::listAllFiles(dir, ".tsv")) {
-        csv::CSVReader reader(f, format);
-        std::vector<ibox::ImgBox> ibx_arr_tsv = from_csv_reader(reader);
-        ibx_arr.insert(ibx_arr.end(), ibx_arr_tsv.begin(), ibx_arr_tsv.end());
-    }
-    return ibx_arr;
+    Paths files = fdt::utils::listAllFiles(dir, ".tsv");
+    std::sort(files.begin(), files.end());
+    const auto parse = [&files, &format](const size_t i) {
+        csv::CSVReader reader(files[i], format);
+        return csv_reader_boxes(reader);
+    };
+    boxes = parse_files(files.size(), parse);
+}
+
+std::vector<ibox::ImgBox> ibox::fromTsv(const std::string &dir) {
+    BoxSet boxes;
+    fromTsv(dir, boxes);
+    return boxes.ToImgBoxes();
 }
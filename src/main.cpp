@@ -1,4 +1,8 @@
+#include <charconv>
 #include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
 
 #include "annot.hpp"
 #include "config.h"
@@ -10,7 +14,157 @@
 #include "img.hpp"
 #include "utils.hpp"
 
-int parse_args(int argc, char *argv[]) {
+// Named options of the form `--name value`, or `--name` for flags
+using Opts = std::map<std::string, std::string>;
+
+// Options that take no value
+static const std::set<std::string> kFlags = {"--ndjson", "--compact",
+                                              "--append"};
+
+// Options read by each command; any other option is an error
+static const std::map<std::string, std::set<std::string>> kCmdOpts = {
+    {"exif-export-json", {"--threads", "--cache", "--fields", "--ndjson"}},
+    {"exif-export-csv", {"--threads", "--cache", "--fields"}},
+    {"exif-export-columnar", {"--threads", "--cache"}},
+    {"exif-export-db", {"--threads", "--cache"}},
+    {"exif-thumbs", {"--threads"}},
+    {"annot-to-coco",
+     {"--backend", "--compact", "--split", "--split-by", "--shards",
+      "--img-root"}},
+    {"annot-eval", {"--img-size", "--threads"}},
+    {"annot-db-update", {"--append"}},
+    // the images of an annotation database are not probed: no --img-root
+    {"annot-db-to-coco",
+     {"--backend", "--compact", "--split", "--split-by", "--shards"}},
+};
+
+// Move `--name value` pairs and flags from argv into `opts`; the positional
+// arguments are compacted to the front of argv and their count is returned.
+static int extract_opts(int argc, char *argv[], Opts &opts) {
+    int n_pos = 0;
+    for (int i = 0; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0 || arg.size() <= 2) {
+            argv[n_pos++] = argv[i];
+            continue;
+        }
+        if (kFlags.count(arg)) {
+            opts[arg] = "";
+            continue;
+        }
+        if (i + 1 >= argc) {
+            throw std::runtime_error("Missing value for option " + arg);
+        }
+        opts[arg] = argv[++i];
+    }
+    return n_pos;
+}
+
+// Join backend of the annotation commands: `--backend <sqlite|native>`
+static fdt::annot::Backend annot_backend(const Opts &opts) {
+    const auto it = opts.find("--backend");
+    if (it == opts.end() || it->second == "sqlite") {
+        return fdt::annot::Backend::SQLITE;
+    }
+    if (it->second == "native") {
+        return fdt::annot::Backend::NATIVE;
+    }
+    throw std::runtime_error("Unknown backend: " + it->second);
+}
+
+// Reject the options that command `op` does not read
+static void check_opts(const std::string &op, const Opts &opts) {
+    const auto it = kCmdOpts.find(op);
+    for (const auto &[name, value] : opts) {
+        if (it == kCmdOpts.end() || !it->second.count(name)) {
+            throw std::runtime_error("Unknown option " + name + " for " + op);
+        }
+    }
+}
+
+// Unsigned integer value `str` of option `name`: decimal digits only, no
+// sign, in the range of `unsigned`
+static unsigned parse_uint(const std::string &name, const std::string &str) {
+    unsigned val = 0;
+    const char *last = str.data() + str.size();
+    const auto res = std::from_chars(str.data(), last, val);
+    if (res.ec != std::errc() || res.ptr != last) {
+        throw std::runtime_error("Invalid value for option " + name + ": " +
+                                 str);
+    }
+    return val;
+}
+
+// Get an unsigned integer option, or `dft` if it is not given
+static unsigned opt_uint(const Opts &opts, const std::string &name,
+                         const unsigned dft) {
+    const auto it = opts.find(name);
+    if (it == opts.end()) {
+        return dft;
+    }
+    return parse_uint(name, it->second);
+}
+
+// COCO split options: `--split-by <hash|prefix>` and `--split <w,w,w>` for
+// the train / val / test weights
+static void coco_split(const Opts &opts, fdt::annot::CocoOpts &coco_opts) {
+    const auto it = opts.find("--split-by");
+    if (it != opts.end()) {
+        if (it->second == "hash") {
+            coco_opts.split_by = fdt::annot::SplitBy::HASH;
+        } else if (it->second == "prefix") {
+            coco_opts.split_by = fdt::annot::SplitBy::PREFIX;
+        } else {
+            throw std::runtime_error("Unknown split: " + it->second);
+        }
+    } else if (opts.count("--split")) {
+        coco_opts.split_by = fdt::annot::SplitBy::HASH;
+    }
+    if (opts.count("--split")) {
+        std::stringstream ss(opts.at("--split"));
+        std::string weight;
+        for (auto &w : coco_opts.split) {
+            if (!std::getline(ss, weight, ',')) {
+                throw std::runtime_error("Expected 3 split weights");
+            }
+            w = parse_uint("--split", weight);
+        }
+    }
+}
+
+// Print the files written, if there are several
+static void print_parts(const Paths &paths) {
+    if (paths.size() > 1) {
+        for (const auto &path : paths) {
+            std::cout << path << std::endl;
+        }
+    }
+}
+
+// Image resolution of `--img-size <WxH>`
+static void eval_img_size(const std::string &arg,
+                          fdt::annot::EvalOpts &eval_opts) {
+    const size_t kX = arg.find('x');
+    if (kX == std::string::npos) {
+        throw std::runtime_error("Expected <width>x<height>: " + arg);
+    }
+    eval_opts.img_width = std::stoi(arg.substr(0, kX));
+    eval_opts.img_height = std::stoi(arg.substr(kX + 1));
+    if (eval_opts.img_width <= 0 || eval_opts.img_height <= 0) {
+        throw std::runtime_error("Invalid image size: " + arg);
+    }
+}
+
+// Boxes of the VIA CSV and TSV files under a directory
+static std::vector<fdt::ibox::ImgBox> load_boxes(const std::string &dir) {
+    auto boxes = fdt::ibox::fromVia(dir);
+    auto boxes_tsv = fdt::ibox::fromTsv(dir);
+    boxes.insert(boxes.end(), std::make_move_iterator(boxes_tsv.begin()),
+                 std::make_move_iterator(boxes_tsv.end()));
+    return boxes;
+}
+
+int parse_args(int argc, char *argv[], const Opts &opts) {
     if (argc <= 1) {
         std::cout << "Fussweg Datentools" << std::endl;
         std::cout << "Version: " << VERSION_MAJOR << "." << VERSION_MINOR << "."
@@ -18,15 +172,50 @@ int parse_args(int argc, char *argv[]) {
         std::cout << std::endl;
         std::cout << "Usage: " << std::endl;
         std::cout << "  " << argv[0] << " exif-export-json "
-                  << "<directory_path> <output_file_path>" << std::endl;
+                  << "<directory_path> <output_file_path> [--threads <n>] "
+                  << "[--cache <db_file>] [--fields <f1,f2,...>] [--ndjson]"
+                  << std::endl;
         std::cout << "  " << argv[0] << " exif-export-csv "
-                  << "<directory_path> <output_file_path>" << std::endl;
+                  << "<directory_path> <output_file_path> [--threads <n>] "
+                  << "[--cache <db_file>] [--fields <f1,f2,...>]"
+                  << std::endl;
+        std::cout << "  " << argv[0] << " exif-export-columnar "
+                  << "<directory_path> <output_file_path> [--threads <n>] "
+                  << "[--cache <db_file>]" << std::endl;
+        std::cout << "  " << argv[0] << " exif-export-db "
+                  << "<directory_path> <db_file> [--threads <n>] "
+                  << "[--cache <db_file>]" << std::endl;
+        std::cout << "  " << argv[0] << " exif-thumbs "
+                  << "<directory_path> <output_dir> [--threads <n>]"
+                  << std::endl;
         std::cout << "  " << argv[0] << " displacement "
                   << "<directory_path> <output_file_path>" << std::endl;
         std::cout << "  " << argv[0] << " via-to-tsv "
                   << "<label_dir> <group> <out_file_path>" << std::endl;
+        std::cout << "  " << argv[0] << " coco-to-tsv "
+                  << "<coco_file> <group> <out_file_path>" << std::endl;
         std::cout << "  " << argv[0] << " annot-to-coco "
-                  << "<annot_dir> <exif_dir> <output_file>" << std::endl;
+                  << "<annot_dir> <exif_dir|exif_db> <output_file> "
+                  << "[--backend <sqlite|native>] [--compact] "
+                  << "[--split <w,w,w>] [--split-by <hash|prefix>] "
+                  << "[--shards <n>] [--img-root <dir>]" << std::endl;
+        std::cout << "  " << argv[0] << " annot-stats "
+                  << "<annot_dir> <exif_dir|exif_db> <output_file>"
+                  << std::endl;
+        std::cout << "  " << argv[0] << " annot-eval "
+                  << "<label_dir> <pred_dir> [--img-size <WxH>] "
+                  << "[--threads <n>]" << std::endl;
+        std::cout << "    (only images with labelled boxes are evaluated: "
+                  << "detections of others are\n"
+                  << "    skipped, not counted as false positives)"
+                  << std::endl;
+        std::cout << "  " << argv[0] << " annot-db-update "
+                  << "<db_file> <annot_dir|-> <exif_dir|-> [--append]"
+                  << std::endl;
+        std::cout << "  " << argv[0] << " annot-db-to-coco "
+                  << "<db_file> <output_file> [--backend <sqlite|native>] "
+                  << "[--compact] [--split <w,w,w>] "
+                  << "[--split-by <hash|prefix>] [--shards <n>]" << std::endl;
         std::cout << "  " << argv[0] << " crop-bbox "
                   << "<root_dir> <tsv_dir> <output_dir> <width> <height>"
                   << std::endl;
@@ -53,17 +242,28 @@ int parse_args(int argc, char *argv[]) {
 
     std::string op = argv[1];
     if (op != "exif-export-json" && op != "exif-export-csv" &&
-        op != "displacement" && op != "via-to-tsv" && op != "annot-to-coco" &&
-        op != "crop-bbox" && op != "draw-bbox" && op != "pov-roi" &&
-        op != "pov-transform" && op != "crs-to-nzgd2000" &&
+        op != "exif-export-columnar" && op != "exif-export-db" &&
+        op != "exif-thumbs" && op != "displacement" && op != "via-to-tsv" &&
+        op != "coco-to-tsv" && op != "annot-to-coco" && op != "annot-stats" &&
+        op != "annot-eval" && op != "annot-db-update" &&
+        op != "annot-db-to-coco" && op != "crop-bbox" && op != "draw-bbox" &&
+        op != "pov-roi" && op != "pov-transform" && op != "crs-to-nzgd2000" &&
         op != "crs-from-nzgd2000" && op != "geojson-to-tsv") {
         throw std::runtime_error("Unknown operation. ");
     }
     if ((op == "exif-export-json" && argc != 4) ||
         (op == "exif-export-csv" && argc != 4) ||
+        (op == "exif-export-columnar" && argc != 4) ||
+        (op == "exif-export-db" && argc != 4) ||
+        (op == "exif-thumbs" && argc != 4) ||
         (op == "displacement" && argc != 4) ||
         (op == "via-to-tsv" && argc != 5) ||
+        (op == "coco-to-tsv" && argc != 5) ||
         (op == "annot-to-coco" && argc != 5) ||
+        (op == "annot-stats" && argc != 5) ||
+        (op == "annot-eval" && argc != 4) ||
+        (op == "annot-db-update" && argc != 5) ||
+        (op == "annot-db-to-coco" && argc != 4) ||
         (op == "crop-bbox" && argc != 7) || (op == "draw-bbox" && argc != 6) ||
         (op == "geojson-to-tsv" && argc != 4) ||
         (op == "crs-to-nzgd2000" && argc != 4) ||
@@ -72,11 +272,35 @@ int parse_args(int argc, char *argv[]) {
         (op == "pov-transform" && argc != 14)) {
         throw std::runtime_error("Invalid number of arguments.");
     }
+    check_opts(op, opts);
+
+    fdt::exif::ExportOpts exif_opts;
+    exif_opts.threads = opt_uint(opts, "--threads", 0);
+    if (opts.count("--cache")) {
+        exif_opts.cache = opts.at("--cache");
+    }
+    exif_opts.ndjson = opts.count("--ndjson") > 0;
+    if (opts.count("--fields")) {
+        exif_opts.fields = fdt::exif::parseFields(opts.at("--fields"));
+    }
+
+    fdt::annot::CocoOpts coco_opts;
+    coco_opts.backend = annot_backend(opts);
+    coco_opts.compact = opts.count("--compact") > 0;
+    coco_opts.shards = opt_uint(opts, "--shards", 1);
+    if (coco_opts.shards == 0) {
+        throw std::runtime_error("Invalid value for option --shards: 0");
+    }
+    coco_split(opts, coco_opts);
+    if (opts.count("--img-root")) {
+        coco_opts.img_root = opts.at("--img-root");
+    }
+
     if (op == "exif-export-json") {
         std::string dir_path = argv[2];
         std::string out_path = argv[3];
         std::ofstream out_file(out_path);
-        fdt::exif::exportJson(dir_path, out_file);
+        fdt::exif::exportJson(dir_path, out_file, exif_opts);
         out_file.close();
         return 0;
     }
@@ -84,10 +308,23 @@ int parse_args(int argc, char *argv[]) {
         std::string dir_path = argv[2];
         std::string out_path = argv[3];
         std::ofstream out_file(out_path);
-        fdt::exif::exportCsv(dir_path, out_file);
+        fdt::exif::exportCsv(dir_path, out_file, exif_opts);
         out_file.close();
         return 0;
     }
+    if (op == "exif-export-columnar") {
+        fdt::exif::exportColumnar(argv[2], argv[3], exif_opts);
+        return 0;
+    }
+    if (op == "exif-export-db") {
+        fdt::annot::exportExifDb(argv[2], argv[3], exif_opts);
+        return 0;
+    }
+    if (op == "exif-thumbs") {
+        const size_t n = fdt::exif::exportThumbs(argv[2], argv[3], exif_opts);
+        std::cout << n << " thumbnails written" << std::endl;
+        return 0;
+    }
     if (op == "displacement") {
         std::string dir_path = argv[2];
         std::string out_path = argv[3];
@@ -100,27 +337,33 @@ int parse_args(int argc, char *argv[]) {
         std::string dir_src = argv[3];
         std::string dir_dst = argv[4];
         std::string format = argv[5];
-        std::vector<fdt::ibox::ImgBox> ibx_arr;
+        fdt::ibox::BoxSet boxes;
         if (format == "via") {
-            ibx_arr = fdt::ibox::fromVia(dir_lab);
+            fdt::ibox::fromVia(dir_lab, boxes);
         } else if (format == "tsv") {
-            ibx_arr = fdt::ibox::fromTsv(dir_lab);
+            fdt::ibox::fromTsv(dir_lab, boxes);
         } else {
             throw std::runtime_error("Invalid format.");
         }
-        fdt::ibox::drawBBox(ibx_arr, dir_src, dir_dst);
+        fdt::ibox::drawBBox(boxes, dir_src, dir_dst);
         return 0;
     }
     if (op == "via-to-tsv") {
         std::string dir_lab = argv[2];
         std::string group = argv[3];
         std::string tsv_file = argv[4];
-        std::vector<fdt::ibox::ImgBox> ibx_arr = fdt::ibox::fromVia(dir_lab);
+        fdt::ibox::BoxSet boxes;
+        fdt::ibox::fromVia(dir_lab, boxes);
         std::ofstream stream_of(tsv_file);
-        fdt::ibox::toTsv(ibx_arr, group, stream_of);
+        fdt::ibox::toTsv(boxes, group, stream_of);
         stream_of.close();
         return 0;
     }
+    if (op == "coco-to-tsv") {
+        std::ofstream stream_of(argv[4]);
+        fdt::ibox::cocoToTsv(argv[2], argv[3], stream_of);
+        return 0;
+    }
     if (op == "crop-bbox") {
         std::string root_dir = argv[2];
         std::string tsv_dir = argv[3];
@@ -135,8 +378,37 @@ int parse_args(int argc, char *argv[]) {
         std::string dir_annot = argv[2];
         std::string dir_exif = argv[3];
         std::string out_file = argv[4];
-        std::ofstream out(out_file);
-        fdt::annot::toCoco(dir_annot, dir_exif, out);
+        print_parts(fdt::annot::toCocoFiles(dir_annot, dir_exif, out_file,
+                                            coco_opts));
+        return 0;
+    }
+    if (op == "annot-stats") {
+        std::ofstream out(argv[4]);
+        fdt::annot::stats(argv[2], argv[3], out);
+        return 0;
+    }
+    if (op == "annot-eval") {
+        fdt::annot::EvalOpts eval_opts;
+        eval_opts.threads = exif_opts.threads;
+        if (opts.count("--img-size")) {
+            eval_img_size(opts.at("--img-size"), eval_opts);
+        }
+        const auto res = fdt::annot::evaluate(load_boxes(argv[2]),
+                                              load_boxes(argv[3]), eval_opts);
+        fdt::annot::printEval(res, std::cout);
+        return 0;
+    }
+    if (op == "annot-db-update") {
+        // "-" skips a directory
+        const auto dir = [](const std::string &arg) {
+            return arg == "-" ? std::string() : arg;
+        };
+        fdt::annot::updateDb(argv[2], dir(argv[3]), dir(argv[4]),
+                             opts.count("--append") > 0);
+        return 0;
+    }
+    if (op == "annot-db-to-coco") {
+        print_parts(fdt::annot::dbToCocoFiles(argv[2], argv[3], coco_opts));
         return 0;
     }
     if (op == "pov-roi") {
@@ -235,7 +507,9 @@ int parse_args(int argc, char *argv[]) {
 
 int main(int argc, char *argv[]) {
     try {
-        return parse_args(argc, argv);
+        Opts opts;
+        argc = extract_opts(argc, argv, opts);
+        return parse_args(argc, argv, opts);
     } catch (const std::exception &e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
@@ -0,0 +1,586 @@
+#include "annot.hpp"
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <set>
+#include <sqlite3.h>
+#include <sstream>
+
+// `Backend` also names the EXIF decoders
+namespace annot = fdt::annot;
+
+// Annotation and EXIF TSVs under a fresh temporary directory
+class AnnotDirs {
+  public:
+    explicit AnnotDirs(const std::string &name)
+        : root_(std::filesystem::temp_directory_path() / name) {
+        std::filesystem::remove_all(root_);
+        std::filesystem::create_directories(root_ / "annot");
+        std::filesystem::create_directories(root_ / "exif");
+    }
+
+    ~AnnotDirs() { std::filesystem::remove_all(root_); }
+
+    void Annot(const std::string &file, const std::string &rows) const {
+        std::ofstream(root_ / "annot" / file)
+            << "prefix\timage\tcate\tlevel\tx\ty\tw\th\n"
+            << rows;
+    }
+
+    void Exif(const std::string &file, const std::string &rows) const {
+        std::ofstream(root_ / "exif" / file)
+            << "prefix\timage\theight\twidth\ttimestamp\n"
+            << rows;
+    }
+
+    std::string AnnotDir() const { return (root_ / "annot").string(); }
+
+    std::string ExifDir() const { return (root_ / "exif").string(); }
+
+    std::string Root() const { return root_.string(); }
+
+  private:
+    std::filesystem::path root_;
+};
+
+static std::string to_coco(const std::string &dir_annot,
+                           const std::string &exif,
+                           const annot::Backend backend,
+                           const bool compact = false) {
+    std::ostringstream oss;
+    annot::toCoco(dir_annot, exif, oss,
+                  {.backend = backend, .compact = compact});
+    return oss.str();
+}
+
+// The native join must assign the same ids as the SQL statements, including
+// duplicated EXIF rows, unmatched annotations and unordered input files.
+TEST(annot, ToCocoBackends) {
+    const AnnotDirs dirs("fdt_test_annot");
+    dirs.Annot("b.tsv", "r2\tG02.JPG\tpothole\tpoor\t5\t6\t7\t8\n"
+                        "r1\tG01.JPG\tcrack\tfair\t30\t40\t10\t12\n"
+                        "r1\tG01.JPG\tcrack\tfair\t30\t40\t10\t12\n"
+                        "r9\tG99.JPG\tbump\tpoor\t1\t1\t1\t1\n");
+    dirs.Annot("a.tsv", "r1\tG01.JPG\tcrack\tpoor\t3\t4\t5\t6\n"
+                        "r1\tG03.JPG\tpothole\tfair\t9\t9\t9\t9\n"
+                        "r2\tG02.JPG\tbump\tfair\t0\t0\t2\t2\n");
+    dirs.Exif("b.tsv", "r2\tG02.JPG\t4872\t5568\t2023-11-15T01:02:03\n"
+                       "r2\tG04.JPG\t4872\t5568\t2023-11-15T01:02:05\n");
+    dirs.Exif("a.tsv", "r1\tG03.JPG\t4872\t5568\t2023-11-15T01:00:59\n"
+                       "r1\tG01.JPG\t4872\t5568\t2023-11-15T01:00:58\n"
+                       "r1\tG01.JPG\t3000\t4000\t2023-11-15T01:00:58\n");
+
+    const std::string sql =
+        to_coco(dirs.AnnotDir(), dirs.ExifDir(), annot::Backend::SQLITE);
+    EXPECT_EQ(
+        to_coco(dirs.AnnotDir(), dirs.ExifDir(), annot::Backend::NATIVE),
+        sql);
+
+    const auto coco = nlohmann::json::parse(sql);
+    ASSERT_EQ(coco["categories"].size(), 3);
+    EXPECT_EQ(coco["categories"][0]["name"], "bump");
+    // both EXIF rows of r1/G01.JPG are images; r2/G04.JPG has no annotation
+    ASSERT_EQ(coco["images"].size(), 4);
+    EXPECT_EQ(coco["images"][0]["file_name"], "r1/G01.JPG");
+    EXPECT_EQ(coco["images"][0]["height"], 3000);
+    EXPECT_EQ(coco["images"][0]["date_captured"], "2023-11-15 01:00:58");
+    EXPECT_EQ(coco["images"][3]["id"], 4);
+    // r1/G01.JPG annotations go to both its images; r9 matches no image
+    ASSERT_EQ(coco["annotations"].size(), 9);
+    EXPECT_EQ(coco["annotations"][8]["id"], 9);
+    EXPECT_EQ(coco["annotations"][8]["image_id"], 4);
+    // areas are scaled by the resolution of their own image
+    EXPECT_EQ(coco["annotations"][0]["image_id"], 1);
+    EXPECT_EQ(coco["annotations"][3]["image_id"], 2);
+    EXPECT_FLOAT_EQ(coco["annotations"][0]["area"].get<float>(),
+                    5 * 6 * 640 * 480 / 4000.0f / 3000.0f);
+    EXPECT_FLOAT_EQ(coco["annotations"][3]["area"].get<float>(),
+                    5 * 6 * 640 * 480 / 5568.0f / 4872.0f);
+}
+
+// Annotations of an image of unknown size, NULL in an EXIF database, get an
+// area of 0, not inf.
+TEST(annot, ToCocoNoSize) {
+    const AnnotDirs dirs("fdt_test_annot_no_size");
+    dirs.Annot("a.tsv", "img\tgps.jpg\tcrack\tfair\t1\t2\t3\t4\n");
+    const std::string db = dirs.Root() + "/exif.db";
+    annot::exportExifDb("tests/img", db);
+    sqlite3 *conn = nullptr;
+    ASSERT_EQ(sqlite3_open(db.c_str(), &conn), SQLITE_OK);
+    EXPECT_EQ(sqlite3_exec(conn, "UPDATE images SET height = NULL, "
+                                 "width = NULL;",
+                           nullptr, nullptr, nullptr),
+              SQLITE_OK);
+    sqlite3_close(conn);
+
+    const std::string sql =
+        to_coco(dirs.AnnotDir(), db, annot::Backend::SQLITE);
+    EXPECT_EQ(to_coco(dirs.AnnotDir(), db, annot::Backend::NATIVE), sql);
+
+    const auto coco = nlohmann::json::parse(sql);
+    ASSERT_EQ(coco["annotations"].size(), 1);
+    EXPECT_EQ(coco["annotations"][0]["area"], 0.0);
+}
+
+// The streamed document must equal the dumped DOM, indented or compact, with
+// strings escaped the same way.
+TEST(annot, ToCocoStream) {
+    const AnnotDirs dirs("fdt_test_annot_stream");
+    dirs.Annot("a.tsv", "r1\tG01.JPG\tcr\\ack\x01\xC3\xA9\tfair\t1\t2\t3\t4\n"
+                        "r1\tG01.JPG\tbump\tfair\t5\t6\t7\t8\n");
+    dirs.Exif("a.tsv", "r1\tG01.JPG\t4872\t5568\t2023-11-15T01:00:58\n");
+
+    for (const auto backend :
+         {annot::Backend::SQLITE, annot::Backend::NATIVE}) {
+        const std::string pretty =
+            to_coco(dirs.AnnotDir(), dirs.ExifDir(), backend);
+        const std::string compact =
+            to_coco(dirs.AnnotDir(), dirs.ExifDir(), backend, true);
+        const auto coco = nlohmann::json::parse(pretty);
+        EXPECT_EQ(coco.dump(4) + "\n", pretty);
+        EXPECT_EQ(coco.dump() + "\n", compact);
+        EXPECT_EQ(coco["categories"][1]["name"], "cr\\ack\x01\xC3\xA9");
+    }
+}
+
+// Both backends read the images of an EXIF database the same way.
+TEST(annot, ToCocoExifDb) {
+    const AnnotDirs dirs("fdt_test_annot_db");
+    dirs.Annot("a.tsv", "img\tgps.jpg\tcrack\tfair\t1\t2\t3\t4\n");
+    const std::string db = dirs.Root() + "/exif.db";
+    annot::exportExifDb("tests/img", db);
+
+    const std::string sql =
+        to_coco(dirs.AnnotDir(), db, annot::Backend::SQLITE);
+    EXPECT_EQ(to_coco(dirs.AnnotDir(), db, annot::Backend::NATIVE), sql);
+
+    const auto coco = nlohmann::json::parse(sql);
+    ASSERT_EQ(coco["images"].size(), 1);
+    EXPECT_EQ(coco["images"][0]["file_name"], "img/gps.jpg");
+    EXPECT_EQ(coco["images"][0]["width"], 640);
+    EXPECT_EQ(coco["annotations"].size(), 1);
+}
+
+static std::string db_to_coco(const std::string &db,
+                              const annot::Backend backend) {
+    std::ostringstream oss;
+    annot::dbToCoco(db, oss, {.backend = backend});
+    return oss.str();
+}
+
+// An EXIF database holds the rows an EXIF TSV of the same images would,
+// the prefix of an image being its directory.
+TEST(annot, ExportExifDb) {
+    namespace fs = std::filesystem;
+    const AnnotDirs dirs("fdt_test_annot_exif_db");
+    const fs::path kImgs = fs::path(dirs.Root()) / "imgs";
+    for (const char *prefix : {"r1", "r2"}) {
+        fs::create_directories(kImgs / prefix);
+        fs::copy_file("tests/img/gps.jpg", kImgs / prefix / "gps.jpg");
+    }
+    fs::copy_file("tests/img/gps.jpg", kImgs / "r2" / "G01.JPG");
+    dirs.Annot("a.tsv", "r1\tgps.jpg\tcrack\tfair\t1\t2\t3\t4\n"
+                        "r2\tG01.JPG\tbump\tpoor\t5\t6\t7\t8\n"
+                        "r2\tgps.jpg\tcrack\tfair\t1\t2\t3\t4\n");
+    dirs.Exif("a.tsv", "r1\tgps.jpg\t480\t640\t2008-10-23T14:27:07\n"
+                       "r2\tG01.JPG\t480\t640\t2008-10-23T14:27:07\n"
+                       "r2\tgps.jpg\t480\t640\t2008-10-23T14:27:07\n");
+    const std::string db = dirs.Root() + "/exif.db";
+    fdt::exif::ExportOpts opts;
+    opts.threads = 2;
+    annot::exportExifDb(kImgs.string(), db, opts);
+
+    const std::string tsv =
+        to_coco(dirs.AnnotDir(), dirs.ExifDir(), annot::Backend::SQLITE);
+    EXPECT_EQ(to_coco(dirs.AnnotDir(), db, annot::Backend::SQLITE), tsv);
+
+    const auto coco = nlohmann::json::parse(tsv);
+    ASSERT_EQ(coco["images"].size(), 3);
+    EXPECT_EQ(coco["images"][1]["file_name"], "r2/G01.JPG");
+    EXPECT_EQ(coco["images"][1]["height"], 480);
+    EXPECT_EQ(coco["images"][1]["date_captured"], "2008-10-23 14:27:07");
+    EXPECT_EQ(coco["annotations"].size(), 3);
+
+    // a new export replaces the database
+    annot::exportExifDb("tests/img", db);
+    const auto one = nlohmann::json::parse(
+        to_coco(dirs.AnnotDir(), db, annot::Backend::SQLITE));
+    EXPECT_EQ(one["images"].size(), 0);
+}
+
+// Rows tokenised from many files on several threads, in batches that reach
+// the loader in any order, are exported as they are from a single file.
+TEST(annot, ToCocoManyTsvs) {
+    constexpr int kFiles = 8, kRowsPerFile = 5000, kImages = 64;
+    const AnnotDirs many("fdt_test_annot_many"), one("fdt_test_annot_one");
+    std::string all_annots, all_exifs;
+    for (int f = 0; f < kFiles; ++f) {
+        std::string annots, exifs;
+        for (int r = 0; r < kRowsPerFile; ++r) {
+            const int kImg = (f * kRowsPerFile + r) % kImages;
+            annots += "r" + std::to_string(kImg % 3) + "\tG" +
+                      std::to_string(kImg) + ".JPG\t" +
+                      (r % 2 ? "crack" : "bump") + "\tfair\t" +
+                      std::to_string(f) + "\t" + std::to_string(r) +
+                      "\t3\t4\n";
+        }
+        for (int img = f; img < kImages; img += kFiles) {
+            exifs += "r" + std::to_string(img % 3) + "\tG" +
+                     std::to_string(img) +
+                     ".JPG\t4872\t5568\t2023-11-15T01:00:58\n";
+        }
+        many.Annot(std::to_string(f) + ".tsv", annots);
+        many.Exif(std::to_string(f) + ".tsv", exifs);
+        all_annots += annots;
+        all_exifs += exifs;
+    }
+    one.Annot("a.tsv", all_annots);
+    one.Exif("a.tsv", all_exifs);
+
+    for (const auto backend :
+         {annot::Backend::SQLITE, annot::Backend::NATIVE}) {
+        const std::string expected =
+            to_coco(one.AnnotDir(), one.ExifDir(), backend, true);
+        EXPECT_EQ(to_coco(many.AnnotDir(), many.ExifDir(), backend, true),
+                  expected);
+
+        // images and their annotations in (prefix, image) order
+        const auto coco = nlohmann::json::parse(expected);
+        ASSERT_EQ(coco["images"].size(), kImages);
+        ASSERT_EQ(coco["annotations"].size(), kFiles * kRowsPerFile);
+        for (size_t i = 1; i < coco["images"].size(); ++i) {
+            EXPECT_LT(coco["images"][i - 1]["file_name"].get<std::string>(),
+                      coco["images"][i]["file_name"].get<std::string>());
+        }
+        int64_t last_image = 0;
+        for (const auto &ann : coco["annotations"]) {
+            EXPECT_GE(ann["image_id"].get<int64_t>(), last_image);
+            last_image = ann["image_id"];
+        }
+    }
+}
+
+// After each update the database must export as the files it holds would.
+TEST(annot, AnnotDb) {
+    const AnnotDirs dirs("fdt_test_annot_db_full");
+    const AnnotDirs batch("fdt_test_annot_db_batch");
+    const std::string db = dirs.Root() + "/annot.db";
+    const auto expect_export = [&]() {
+        for (const auto backend :
+             {annot::Backend::SQLITE, annot::Backend::NATIVE}) {
+            EXPECT_EQ(db_to_coco(db, backend),
+                      to_coco(dirs.AnnotDir(), dirs.ExifDir(), backend));
+        }
+    };
+
+    dirs.Annot("r1.tsv", "r1\tG01.JPG\tcrack\tfair\t1\t2\t3\t4\n"
+                         "r1\tG02.JPG\tbump\tpoor\t5\t6\t7\t8\n");
+    dirs.Annot("r2.tsv", "r2\tG01.JPG\tpothole\tfair\t9\t9\t9\t9\n");
+    dirs.Exif("r1.tsv", "r1\tG01.JPG\t4872\t5568\t2023-11-15T01:00:58\n"
+                        "r1\tG02.JPG\t4872\t5568\t2023-11-15T01:00:59\n");
+    dirs.Exif("r2.tsv", "r2\tG01.JPG\t4872\t5568\t2023-11-16T02:00:00\n");
+    annot::updateDb(db, dirs.AnnotDir(), dirs.ExifDir());
+    expect_export();
+
+    // re-labelled r1 replaces its annotations only
+    const std::string kRelabel = "r1\tG02.JPG\tcrack\tvpoor\t0\t0\t4\t4\n";
+    batch.Annot("r1.tsv", kRelabel);
+    dirs.Annot("r1.tsv", kRelabel);
+    annot::updateDb(db, batch.AnnotDir(), "");
+    expect_export();
+
+    // appended rows are added to those of r2
+    const std::string kExtra = "r2\tG01.JPG\tbump\tfair\t3\t3\t3\t3\n";
+    batch.Annot("r1.tsv", "");
+    batch.Annot("r2.tsv", kExtra);
+    dirs.Annot("r2b.tsv", kExtra);
+    annot::updateDb(db, batch.AnnotDir(), "", true);
+    expect_export();
+
+    EXPECT_THROW(db_to_coco(dirs.Root() + "/none.db", annot::Backend::SQLITE),
+                 std::runtime_error);
+}
+
+// The parts of a split and sharded export must hold every image once, with
+// its annotations, the ids of the single file and all categories.
+TEST(annot, ToCocoFiles) {
+    const AnnotDirs dirs("fdt_test_annot_files");
+    std::string annots, exifs;
+    for (int i = 0; i < 40; ++i) {
+        const std::string kKey =
+            "r" + std::to_string(i % 4) + "\tG" + std::to_string(i) + ".JPG\t";
+        annots += kKey + (i % 2 ? "crack" : "bump") + "\tfair\t1\t2\t3\t4\n";
+        annots += kKey + "pothole\tpoor\t5\t6\t7\t8\n";
+        exifs += kKey + "4872\t5568\t2023-11-15T01:00:58\n";
+    }
+    dirs.Annot("a.tsv", annots);
+    dirs.Exif("a.tsv", exifs);
+    const auto whole = nlohmann::json::parse(
+        to_coco(dirs.AnnotDir(), dirs.ExifDir(), annot::Backend::SQLITE));
+
+    const std::string kOut = dirs.Root() + "/coco.json";
+    for (const auto split_by : {annot::SplitBy::HASH, annot::SplitBy::PREFIX}) {
+        for (const auto backend :
+             {annot::Backend::SQLITE, annot::Backend::NATIVE}) {
+            const annot::CocoOpts kOpts = {
+                .backend = backend, .split_by = split_by, .shards = 3};
+            const auto paths = annot::toCocoFiles(
+                dirs.AnnotDir(), dirs.ExifDir(), kOut, kOpts);
+            ASSERT_EQ(paths.size(), 9);
+            EXPECT_EQ(paths[0],
+                      dirs.Root() + "/coco.train.00000-of-00003.json");
+            EXPECT_EQ(paths[8],
+                      dirs.Root() + "/coco.test.00002-of-00003.json");
+
+            std::map<int, nlohmann::json> images, annotations;
+            std::set<std::string> split_prefixes[3];
+            for (size_t i = 0; i < paths.size(); ++i) {
+                const auto part =
+                    nlohmann::json::parse(std::ifstream(paths[i]));
+                EXPECT_EQ(part["categories"], whole["categories"]);
+                std::set<int> ids;
+                for (const auto &img : part["images"]) {
+                    EXPECT_TRUE(images.emplace(img["id"], img).second);
+                    ids.insert(img["id"].get<int>());
+                    const std::string kName = img["file_name"];
+                    split_prefixes[i / 3].insert(kName.substr(0, 2));
+                }
+                for (const auto &a : part["annotations"]) {
+                    EXPECT_TRUE(ids.count(a["image_id"]));
+                    annotations.emplace(a["id"], a);
+                }
+            }
+            ASSERT_EQ(images.size(), whole["images"].size());
+            ASSERT_EQ(annotations.size(), whole["annotations"].size());
+            for (const auto &img : whole["images"]) {
+                EXPECT_EQ(images[img["id"]], img);
+            }
+            for (const auto &a : whole["annotations"]) {
+                EXPECT_EQ(annotations[a["id"]], a);
+            }
+            if (split_by == annot::SplitBy::PREFIX) {
+                const size_t kPrefixes = split_prefixes[0].size() +
+                                         split_prefixes[1].size() +
+                                         split_prefixes[2].size();
+                EXPECT_EQ(kPrefixes, 4);
+            }
+        }
+    }
+
+    // more parts than writer threads: every writer serves several files
+    const auto paths = annot::toCocoFiles(dirs.AnnotDir(), dirs.ExifDir(),
+                                          kOut, {.shards = 256});
+    ASSERT_EQ(paths.size(), 256);
+    size_t n_images = 0;
+    for (const auto &path : paths) {
+        const auto part = nlohmann::json::parse(std::ifstream(path));
+        EXPECT_EQ(part["categories"], whole["categories"]);
+        n_images += part["images"].size();
+        std::filesystem::remove(path);
+    }
+    EXPECT_EQ(n_images, whole["images"].size());
+
+    // a writer that cannot write stops the export instead of hanging it
+    EXPECT_THROW(annot::toCocoFiles(dirs.AnnotDir(), dirs.ExifDir(),
+                                    dirs.Root() + "/none/coco.json",
+                                    {.shards = 16}),
+                 std::runtime_error);
+
+    std::ostringstream oss;
+    EXPECT_THROW(annot::toCoco(dirs.AnnotDir(), dirs.ExifDir(), oss,
+                               {.shards = 2}),
+                 std::invalid_argument);
+}
+
+// Statistics count joined annotations only, each once per matching image.
+TEST(annot, Stats) {
+    const AnnotDirs dirs("fdt_test_annot_stats");
+    dirs.Annot("a.tsv", "r1\tG01.JPG\tcrack\tfair\t0\t0\t10\t10\n"
+                        "r1\tG01.JPG\tcrack\tpoor\t0\t0\t4\t4\n"
+                        "r2\tG01.JPG\tbump\tfair\t0\t0\t1\t1\n"
+                        "r9\tG99.JPG\tpothole\tpoor\t0\t0\t9\t9\n");
+    dirs.Exif("a.tsv", "r2\tG01.JPG\t4872\t5568\t2023-11-16T02:00:00\n"
+                       "r1\tG01.JPG\t4872\t5568\t2023-11-15T01:00:58\n");
+
+    std::ostringstream oss;
+    annot::stats(dirs.AnnotDir(), dirs.ExifDir(), oss);
+    const auto stats = nlohmann::json::parse(oss.str());
+    EXPECT_EQ(stats["images"], 2);
+    EXPECT_EQ(stats["unmatched"], 1);
+    EXPECT_EQ(stats["total"]["count"], 3);
+    EXPECT_EQ(stats["total"]["area"], 117.0);
+    EXPECT_NEAR(stats["total"]["coco_area"].get<double>(),
+                117.0 * 640 * 480 / 5568 / 4872, 1e-4);
+    EXPECT_EQ(stats["total"]["coco_size"]["small"], 3);
+    EXPECT_FALSE(stats["categories"].contains("pothole"));
+
+    const auto &crack = stats["categories"]["crack"];
+    EXPECT_EQ(crack["count"], 2);
+    // 16 in [2^4, 2^5), 100 in [2^6, 2^7)
+    EXPECT_EQ(crack["histogram"],
+              nlohmann::json({0, 0, 0, 0, 1, 0, 1}));
+    EXPECT_EQ(crack["levels"], nlohmann::json({{"fair", 1}, {"poor", 1}}));
+    EXPECT_EQ(stats["levels"]["fair"]["count"], 2);
+    EXPECT_EQ(stats["prefixes"]["r1"]["count"], 2);
+    EXPECT_EQ(stats["prefixes"]["r1"]["images"], 1);
+    EXPECT_EQ(stats["days"]["2023-11-16"]["count"], 1);
+    EXPECT_EQ(stats["days"]["2023-11-15"]["area"], 116.0);
+    EXPECT_EQ(stats["total"]["coco_size"]["unknown"], 0);
+
+    // no COCO area for an image without size
+    dirs.Exif("a.tsv", "r1\tG01.JPG\t0\t0\t2023-11-15T01:00:58\n"
+                       "r2\tG01.JPG\t4872\t5568\t2023-11-16T02:00:00\n");
+    oss.str("");
+    annot::stats(dirs.AnnotDir(), dirs.ExifDir(), oss);
+    const auto unsized = nlohmann::json::parse(oss.str());
+    EXPECT_EQ(unsized["total"]["count"], 3);
+    EXPECT_EQ(unsized["total"]["coco_size"]["unknown"], 2);
+    EXPECT_EQ(unsized["total"]["coco_size"]["small"], 1);
+    EXPECT_EQ(unsized["total"]["coco_histogram"], nlohmann::json({1}));
+    EXPECT_NEAR(unsized["total"]["coco_area"].get<double>(),
+                1.0 * 640 * 480 / 5568 / 4872, 1e-6);
+}
+
+// Annotated images without EXIF rows get their size from the JPEG frame
+// header, with the flat files as with an EXIF database.
+TEST(annot, ToCocoProbe) {
+    const AnnotDirs dirs("fdt_test_annot_probe");
+    std::filesystem::create_directories(dirs.Root() + "/new");
+    std::filesystem::copy_file("tests/img/gps.jpg",
+                               dirs.Root() + "/new/gps.jpg");
+    std::filesystem::copy_file("tests/img/gps.jpg",
+                               dirs.Root() + "/new/bad.jpg");
+    std::filesystem::resize_file(dirs.Root() + "/new/bad.jpg", 64);
+    dirs.Annot("a.tsv", "img\tgps.jpg\tcrack\tfair\t1\t2\t3\t4\n"
+                        "new\tgps.jpg\tcrack\tfair\t1\t2\t3\t4\n"
+                        "new\tbad.jpg\tcrack\tfair\t1\t2\t3\t4\n"
+                        "new\tnone.jpg\tcrack\tfair\t1\t2\t3\t4\n");
+    dirs.Exif("a.tsv", "img\tgps.jpg\t480\t640\t2023-11-15T01:00:58\n");
+    const std::string db = dirs.Root() + "/exif.db";
+    annot::exportExifDb("tests/img", db);
+
+    for (const auto &exif : {dirs.ExifDir(), db}) {
+        std::string expected;
+        for (const auto backend :
+             {annot::Backend::SQLITE, annot::Backend::NATIVE}) {
+            std::ostringstream oss;
+            annot::toCoco(dirs.AnnotDir(), exif, oss,
+                          {.backend = backend, .img_root = dirs.Root()});
+            if (expected.empty()) {
+                expected = oss.str();
+            }
+            EXPECT_EQ(oss.str(), expected);
+        }
+
+        const auto coco = nlohmann::json::parse(expected);
+        ASSERT_EQ(coco["images"].size(), 2);
+        EXPECT_EQ(coco["images"][1]["file_name"], "new/gps.jpg");
+        EXPECT_EQ(coco["images"][1]["width"], 640);
+        EXPECT_EQ(coco["images"][1]["height"], 480);
+        EXPECT_EQ(coco["images"][1]["date_captured"], " ");
+        EXPECT_EQ(coco["annotations"].size(), 2);
+        EXPECT_EQ(coco["images"][0]["height"], coco["images"][1]["height"]);
+    }
+}
+
+// Metrics of pycocotools' COCOeval on the same boxes, with areas scaled to
+// 640x480 and image ids in name order
+TEST(annot, Eval) {
+    const AnnotDirs dirs("fdt_test_annot_eval");
+    dirs.Annot("gt.tsv",
+               "r1\tG0001.JPG\tpothole\tfair\t4774\t475\t188\t101\n"
+               "r1\tG0001.JPG\tcrack\tfair\t4774\t475\t188\t101\n"
+               "r1\tG0001.JPG\tcrack\tfair\t4632\t1014\t269\t375\n"
+               "r1\tG0001.JPG\tcrack\tfair\t3433\t1181\t156\t105\n"
+               "r1\tG0001.JPG\tcrack\tfair\t2535\t843\t2339\t2102\n"
+               "r1\tG0002.JPG\tcrack\tfair\t2813\t3676\t158\t153\n"
+               "r1\tG0002.JPG\tcrack\tfair\t2570\t2786\t181\t158\n"
+               "r1\tG0002.JPG\tdisplacement\tfair\t3650\t1165\t782\t976\n"
+               "r1\tG0003.JPG\tpothole\tfair\t3526\t2253\t1247\t1568\n"
+               "r1\tG0003.JPG\tcrack\tfair\t1493\t2152\t243\t505\n"
+               "r1\tG0003.JPG\tdisplacement\tfair\t3582\t2787\t1583\t1468\n"
+               "r1\tG0003.JPG\tcrack\tfair\t3582\t2787\t1583\t1468\n"
+               "r1\tG0003.JPG\tcrack\tfair\t4643\t1239\t756\t477\n"
+               "r1\tG0003.JPG\tpothole\tfair\t3477\t1999\t1782\t1396\n"
+               "r1\tG0004.JPG\tdisplacement\tfair\t4327\t2963\t405\t305\n"
+               "r1\tG0004.JPG\tpothole\tfair\t3161\t912\t1786\t1467\n"
+               "r1\tG0004.JPG\tcrack\tfair\t237\t228\t303\t397\n"
+               "r1\tG0004.JPG\tpothole\tfair\t237\t228\t303\t397\n"
+               "r1\tG0004.JPG\tcrack\tfair\t1674\t3953\t117\t113\n"
+               "r1\tG0005.JPG\tcrack\tfair\t2604\t1361\t1573\t1136\n"
+               "r1\tG0005.JPG\tdisplacement\tfair\t695\t2968\t1164\t1433\n"
+               "r1\tG0005.JPG\tcrack\tfair\t5372\t1197\t108\t198\n"
+               "r1\tG0005.JPG\tdisplacement\tfair\t1073\t87\t1350\t1056\n"
+               "r1\tG0005.JPG\tdisplacement\tfair\t3553\t1595\t153\t202\n");
+    std::filesystem::create_directories(dirs.Root() + "/pred");
+    std::ofstream(dirs.Root() + "/pred/a.tsv")
+        << "image\tcategory\tlevel\tx\ty\tw\th\tscore_cate_top1\n"
+        << "G0001.JPG\tpothole\tfair\t4836\t500\t188\t101\t0.074\n"
+        << "G0001.JPG\tcrack\tfair\t4721\t1107\t269\t375\t0.425\n"
+        << "G0001.JPG\tcrack\tfair\t3413\t1172\t153\t98\t0.694\n"
+        << "G0001.JPG\tcrack\tfair\t2128\t761\t1808\t2218\t0.549\n"
+        << "G0002.JPG\tcrack\tfair\t2821\t3675\t132\t167\t0.405\n"
+        << "G0002.JPG\tcrack\tfair\t2551\t2773\t148\t167\t0.952\n"
+        << "G0002.JPG\tuneven\tfair\t2630\t2825\t181\t158\t0.503\n"
+        << "G0002.JPG\tdisplacement\tfair\t3708\t1115\t855\t948\t0.722\n"
+        << "G0002.JPG\tuneven\tfair\t3910\t1409\t782\t976\t0.088\n"
+        << "G0002.JPG\tpothole\tfair\t2028\t3259\t200\t160\t0.829\n"
+        << "G0003.JPG\tpothole\tfair\t3410\t2321\t1517\t1328\t0.404\n"
+        << "G0003.JPG\tcrack\tfair\t1529\t2199\t211\t479\t0.387\n"
+        << "G0003.JPG\tdisplacement\tfair\t3469\t2877\t1745\t1591\t0.343\n"
+        << "G0003.JPG\tcrack\tfair\t3469\t2877\t1745\t1591\t0.343\n"
+        << "G0003.JPG\tcrack\tfair\t4109\t3154\t1583\t1468\t0.69\n"
+        << "G0003.JPG\tcrack\tfair\t4752\t1203\t807\t501\t0.56\n"
+        << "G0003.JPG\tuneven\tfair\t4071\t2348\t1782\t1396\t0.362\n"
+        << "G0003.JPG\tdisplacement\tfair\t1180\t837\t200\t160\t0.341\n"
+        << "G0004.JPG\tdisplacement\tfair\t4317\t2960\t275\t282\t0.896\n"
+        << "G0004.JPG\tpothole\tfair\t3199\t701\t1859\t1899\t0.98\n"
+        << "G0004.JPG\tcrack\tfair\t206\t233\t269\t370\t0.858\n"
+        << "G0004.JPG\tpothole\tfair\t206\t233\t269\t370\t0.858\n"
+        << "G0004.JPG\tdisplacement\tfair\t338\t327\t303\t397\t0.671\n"
+        << "G0004.JPG\tcrack\tfair\t1701\t3933\t92\t116\t0.852\n"
+        << "G0004.JPG\tcrack\tfair\t1713\t3981\t117\t113\t0.593\n"
+        // not labelled, hence skipped
+        << "G0009.JPG\tcrack\tfair\t0\t0\t500\t500\t0.99\n";
+    const auto gt = fdt::ibox::fromTsv(dirs.AnnotDir());
+    const auto dt = fdt::ibox::fromTsv(dirs.Root() + "/pred");
+
+    const std::map<std::string, annot::EvalStats> expected = {
+        {"all",
+         {0.18005343391482, 0.5108832311802609, 0.0026402640264026403,
+          0.04996699669966997, 0.3344059405940594, 0.18536853685368532,
+          0.15641025641025638, 0.23692307692307693, 0.23692307692307693,
+          0.07222222222222222, 0.35, 0.2222222222222222}},
+        {"crack",
+         {0.14461574728901463, 0.5153229608675154, 0.007920792079207921,
+          0.1499009900990099, 0.25173267326732673, 0.056105610561056105,
+          0.06923076923076923, 0.23076923076923075, 0.23076923076923075,
+          0.21666666666666665, 0.3, 0.16666666666666666}},
+        {"displacement",
+         {0.14306930693069306, 0.4628712871287129, 0.0, 0.0,
+          0.35148514851485146, 0.1683168316831683, 0.19999999999999998,
+          0.19999999999999998, 0.19999999999999998, 0.0, 0.35,
+          0.16666666666666666}},
+        {"pothole",
+         {0.2524752475247525, 0.5544554455445545, 0.0, 0.0,
+          0.39999999999999997, 0.3316831683168317, 0.2, 0.27999999999999997,
+          0.27999999999999997, 0.0, 0.4, 0.3333333333333333}},
+    };
+    const auto expect_near = [](const annot::EvalStats &actual,
+                                const annot::EvalStats &ref) {
+        for (size_t i = 0; i < ref.size(); ++i) {
+            EXPECT_NEAR(actual[i], ref[i], 1e-12) << "stats[" << i << "]";
+        }
+    };
+    for (const unsigned threads : {1u, 3u}) {
+        const auto res = annot::evaluate(gt, dt, {.threads = threads});
+        EXPECT_EQ(res.skipped, 1u);
+        expect_near(res.all, expected.at("all"));
+        ASSERT_EQ(res.categories.size(), 3);
+        for (const auto &[name, stats] : res.categories) {
+            expect_near(stats, expected.at(name));
+        }
+    }
+}
@@ -1,5 +1,6 @@
 #include "crs.hpp"
 #include <gtest/gtest.h>
+#include <vector>
 
 using namespace fdt::crs;
 
@@ -45,3 +46,24 @@ TEST(CRS, FromNZGD2000) {
     EXPECT_NEAR(lat4, kLat4, 1e-2);
     EXPECT_NEAR(lon4, kLon4, 1e-2);
 }
+
+// The batch conversion must agree with the scalar one and pass invalid
+// positions through as NaN.
+TEST(CRS, ToNZGD2000Batch) {
+    const std::vector<double> lat = {kLat1, kLat2, NAN, kLat3, 91, kLat4};
+    const std::vector<double> lon = {kLon1, Klon2, kLon1, kLon3, 0, kLon4};
+    std::vector<double> east(lat.size()), north(lat.size());
+    ToNzgd2000(lat, lon, east, north);
+
+    for (const size_t i : {0, 1, 3, 5}) {
+        const auto [e, n] = ToNzgd2000(lat[i], lon[i]);
+        EXPECT_DOUBLE_EQ(east[i], e);
+        EXPECT_DOUBLE_EQ(north[i], n);
+    }
+    EXPECT_TRUE(std::isnan(east[2]) && std::isnan(north[2]));
+    EXPECT_TRUE(std::isnan(east[4]) && std::isnan(north[4]));
+
+    std::vector<double> short_out(1);
+    EXPECT_THROW(ToNzgd2000(lat, lon, short_out, north),
+                 std::invalid_argument);
+}
@@ -1,5 +1,7 @@
 #include "exif.hpp"
 #include <ctime>
+#include <filesystem>
+#include <fstream>
 #include <gtest/gtest.h>
 
 using namespace fdt::exif;
@@ -81,3 +83,533 @@ TEST(exif, ExportCsv) {
     exportCsv(valid_gps_path, oss);
     EXPECT_STREQ(oss.str().c_str(), kExpectedCsv);
 }
+
+// Builder of minimal JPEG files holding only an EXIF APP1 segment
+class ExifJpeg {
+  public:
+    explicit ExifJpeg(bool le) : le_(le) {}
+
+    ExifJpeg &Ascii(int ifd, uint16_t tag, const std::string &str) {
+        std::vector<uint8_t> val(str.begin(), str.end());
+        val.push_back('\0');
+        return add(ifd, tag, 2, val.size(), val);
+    }
+
+    ExifJpeg &Undefined(int ifd, uint16_t tag, const std::string &str) {
+        std::vector<uint8_t> val(str.begin(), str.end());
+        return add(ifd, tag, 7, val.size(), val);
+    }
+
+    ExifJpeg &Short(int ifd, uint16_t tag, uint16_t v) {
+        std::vector<uint8_t> val;
+        put16(val, v);
+        return add(ifd, tag, 3, 1, val);
+    }
+
+    ExifJpeg &Long(int ifd, uint16_t tag, uint32_t v) {
+        std::vector<uint8_t> val;
+        put32(val, v);
+        return add(ifd, tag, 4, 1, val);
+    }
+
+    // RATIONAL (type 5) or SRATIONAL (type 10)
+    ExifJpeg &Rational(int ifd, uint16_t tag,
+                       const std::vector<std::pair<int32_t, int32_t>> &rs,
+                       bool is_signed = false) {
+        std::vector<uint8_t> val;
+        for (const auto &[num, den] : rs) {
+            put32(val, num);
+            put32(val, den);
+        }
+        return add(ifd, tag, is_signed ? 10 : 5, rs.size(), val);
+    }
+
+    // Embed a thumbnail referenced by IFD1
+    ExifJpeg &Thumbnail(const std::vector<uint8_t> &jpeg) {
+        thumb_ = jpeg;
+        return *this;
+    }
+
+    // Write the JPEG file and return its path
+    std::string Write(const std::string &name) const {
+        // TIFF: header, IFD0, Exif IFD, GPS IFD, IFD1, then the thumbnail and
+        // out-of-line values
+        std::vector<Entry> ifds[4] = {ifds_[0], ifds_[1], ifds_[2], {}};
+        const int n_ifds = thumb_.empty() ? 3 : 4;
+        if (n_ifds == 4) {
+            ifds[3].resize(2);
+        }
+        uint32_t off_ifd[4];
+        uint32_t off = 8;
+        for (int i = 0; i < n_ifds; ++i) {
+            if (i == 0) {
+                // room for the two sub-IFD pointers
+                off_ifd[i] = off;
+                off += 2 + 12 * (ifds[i].size() + 2) + 4;
+            } else {
+                off_ifd[i] = off;
+                off += 2 + 12 * ifds[i].size() + 4;
+            }
+        }
+        std::vector<uint8_t> ptr;
+        put32(ptr, off_ifd[1]);
+        ifds[0].push_back({0x8769, 4, 1, ptr});
+        ptr.clear();
+        put32(ptr, off_ifd[2]);
+        ifds[0].push_back({0x8825, 4, 1, ptr});
+
+        std::vector<uint8_t> tiff, data(thumb_);
+        if (n_ifds == 4) {
+            ptr.clear();
+            put32(ptr, off);
+            ifds[3][0] = {0x0201, 4, 1, ptr};
+            ptr.clear();
+            put32(ptr, thumb_.size());
+            ifds[3][1] = {0x0202, 4, 1, ptr};
+            if (data.size() % 2) {
+                data.push_back(0);
+            }
+        }
+        tiff.push_back(le_ ? 'I' : 'M');
+        tiff.push_back(le_ ? 'I' : 'M');
+        put16(tiff, 42);
+        put32(tiff, 8);
+        for (int i = 0; i < n_ifds; ++i) {
+            auto &ifd = ifds[i];
+            std::sort(ifd.begin(), ifd.end(),
+                      [](const Entry &a, const Entry &b) {
+                          return a.tag < b.tag;
+                      });
+            put16(tiff, ifd.size());
+            for (const auto &e : ifd) {
+                put16(tiff, e.tag);
+                put16(tiff, e.type);
+                put32(tiff, e.count);
+                if (e.val.size() <= 4) {
+                    std::vector<uint8_t> inl = e.val;
+                    inl.resize(4, 0);
+                    tiff.insert(tiff.end(), inl.begin(), inl.end());
+                } else {
+                    put32(tiff, off + data.size());
+                    data.insert(data.end(), e.val.begin(), e.val.end());
+                    if (data.size() % 2) {
+                        data.push_back(0);
+                    }
+                }
+            }
+            put32(tiff, i == 0 && n_ifds == 4 ? off_ifd[3] : 0);
+        }
+        tiff.insert(tiff.end(), data.begin(), data.end());
+
+        const std::string path =
+            (std::filesystem::temp_directory_path() / name).string();
+        std::ofstream out(path, std::ios::binary);
+        const size_t len = 2 + 6 + tiff.size();
+        const uint8_t app1[] = {0xFF, 0xD8, 0xFF, 0xE1,
+                                static_cast<uint8_t>(len >> 8),
+                                static_cast<uint8_t>(len & 0xFF)};
+        out.write(reinterpret_cast<const char *>(app1), sizeof(app1));
+        out.write("Exif\0\0", 6);
+        out.write(reinterpret_cast<const char *>(tiff.data()), tiff.size());
+        out.write("\xFF\xD9", 2);
+        return path;
+    }
+
+  private:
+    struct Entry {
+        uint16_t tag;
+        uint16_t type;
+        uint32_t count;
+        std::vector<uint8_t> val;
+    };
+
+    ExifJpeg &add(int ifd, uint16_t tag, uint16_t type, uint32_t count,
+                  const std::vector<uint8_t> &val) {
+        ifds_[ifd].push_back({tag, type, count, val});
+        return *this;
+    }
+
+    void put16(std::vector<uint8_t> &buf, uint16_t v) const {
+        const uint8_t b[2] = {static_cast<uint8_t>(v >> 8),
+                              static_cast<uint8_t>(v)};
+        buf.push_back(le_ ? b[1] : b[0]);
+        buf.push_back(le_ ? b[0] : b[1]);
+    }
+
+    void put32(std::vector<uint8_t> &buf, uint32_t v) const {
+        put16(buf, le_ ? v & 0xFFFF : v >> 16);
+        put16(buf, le_ ? v >> 16 : v & 0xFFFF);
+    }
+
+    bool le_;
+    std::vector<Entry> ifds_[3];
+    std::vector<uint8_t> thumb_;
+};
+
+static constexpr int kIfd0 = 0, kIfdExif = 1, kIfdGps = 2;
+
+// Synthetic GoPro-like still in the given byte order
+static std::string write_gopro_jpeg(bool le, const std::string &name) {
+    return ExifJpeg(le)
+        .Ascii(kIfd0, 0x010E, "DCIM\\101GOPRO\\G0018842.JPG  ")
+        .Ascii(kIfd0, 0x010F, "GoPro")
+        .Ascii(kIfd0, 0x0110, "HERO11 Black")
+        .Rational(kIfdExif, 0x829A, {{1, 240}})
+        .Short(kIfdExif, 0x8827, 100)
+        .Undefined(kIfdExif, 0x9000, "0232")
+        .Rational(kIfdExif, 0x9201, {{-790, 100}}, true)
+        .Rational(kIfdExif, 0x9202, {{280, 100}})
+        .Rational(kIfdExif, 0x9206, {{0, 1}})
+        .Rational(kIfdExif, 0x920A, {{270, 100}})
+        .Long(kIfdExif, 0xA002, 5568)
+        .Long(kIfdExif, 0xA003, 4872)
+        .Ascii(kIfdGps, 0x0001, "S")
+        .Rational(kIfdGps, 0x0002, {{43, 1}, {31, 1}, {51469, 1000}})
+        .Ascii(kIfdGps, 0x0003, "E")
+        .Rational(kIfdGps, 0x0004, {{172, 1}, {40, 1}, {35733, 1000}})
+        .Rational(kIfdGps, 0x0006, {{19473, 1000}})
+        .Rational(kIfdGps, 0x0007, {{1, 1}, {2, 1}, {3, 1}})
+        .Ascii(kIfdGps, 0x001D, "2023:11:15")
+        .Write(name);
+}
+
+static void expect_attrs_eq(const Attrs &a, const Attrs &b) {
+    EXPECT_EQ(a.exif_ver, b.exif_ver);
+    EXPECT_EQ(a.desc, b.desc);
+    EXPECT_EQ(a.model, b.model);
+    EXPECT_EQ(a.height, b.height);
+    EXPECT_EQ(a.width, b.width);
+    EXPECT_EQ(a.lat.has_value(), b.lat.has_value());
+    EXPECT_EQ(a.lon.has_value(), b.lon.has_value());
+    if (a.lat && b.lat && a.lon && b.lon) {
+        EXPECT_DOUBLE_EQ(*a.lat, *b.lat);
+        EXPECT_DOUBLE_EQ(*a.lon, *b.lon);
+    }
+    EXPECT_DOUBLE_EQ(*a.altitude, *b.altitude);
+    EXPECT_EQ(a.ts_gps.has_value(), b.ts_gps.has_value());
+    if (a.ts_gps && b.ts_gps) {
+        EXPECT_EQ(a.ts_gps->tm_year, b.ts_gps->tm_year);
+        EXPECT_EQ(a.ts_gps->tm_mon, b.ts_gps->tm_mon);
+        EXPECT_EQ(a.ts_gps->tm_mday, b.ts_gps->tm_mday);
+        EXPECT_EQ(a.ts_gps->tm_hour, b.ts_gps->tm_hour);
+        EXPECT_EQ(a.ts_gps->tm_min, b.ts_gps->tm_min);
+        EXPECT_EQ(a.ts_gps->tm_sec, b.ts_gps->tm_sec);
+    }
+    EXPECT_EQ(a.coc, b.coc);
+    EXPECT_EQ(a.iso, b.iso);
+    EXPECT_DOUBLE_EQ(*a.subj_dist, *b.subj_dist);
+    EXPECT_DOUBLE_EQ(*a.aperture, *b.aperture);
+    EXPECT_DOUBLE_EQ(*a.shutter_speed, *b.shutter_speed);
+    EXPECT_DOUBLE_EQ(*a.exposure_time, *b.exposure_time);
+    EXPECT_DOUBLE_EQ(*a.focal_length, *b.focal_length);
+    EXPECT_DOUBLE_EQ(*a.hyperfocal_dist, *b.hyperfocal_dist);
+}
+
+// The native decoder must agree with Exiv2.
+TEST(Attrs, NativeVsExiv2) {
+    const std::string paths[] = {
+        "tests/img/gps.jpg",
+        write_gopro_jpeg(true, "fdt_test_exif_le.jpg"),
+        write_gopro_jpeg(false, "fdt_test_exif_be.jpg"),
+    };
+    for (const auto &path : paths) {
+        SCOPED_TRACE(path);
+        expect_attrs_eq(Attrs(path, Backend::NATIVE),
+                        Attrs(path, Backend::EXIV2));
+    }
+}
+
+TEST(Attrs, NativeSynthetic) {
+    for (const bool le : {true, false}) {
+        const auto path = write_gopro_jpeg(le, "fdt_test_exif_syn.jpg");
+        const auto attrs = Attrs(path, Backend::NATIVE);
+        EXPECT_EQ(attrs.exif_ver, "48 50 51 50");
+        EXPECT_EQ(attrs.desc, "DCIM\\101GOPRO\\G0018842.JPG");
+        EXPECT_EQ(attrs.model, "GoPro HERO11 Black");
+        EXPECT_EQ(attrs.width, 5568);
+        EXPECT_EQ(attrs.height, 4872);
+        EXPECT_EQ(attrs.iso, 100);
+        EXPECT_NEAR(*attrs.lat, -43.530963, kEps);
+        EXPECT_NEAR(*attrs.lon, 172.676592, kEps);
+        EXPECT_DOUBLE_EQ(*attrs.altitude, 19.473);
+        EXPECT_DOUBLE_EQ(*attrs.shutter_speed, -7.9);
+        EXPECT_DOUBLE_EQ(*attrs.focal_length, 2.7);
+        EXPECT_DOUBLE_EQ(*attrs.coc, 0.005);
+        EXPECT_EQ(attrs.ts_gps->tm_year, 123);
+        EXPECT_EQ(attrs.ts_gps->tm_mon, 10);
+        EXPECT_EQ(attrs.ts_gps->tm_mday, 15);
+        EXPECT_EQ(attrs.ts_gps->tm_hour, 1);
+        EXPECT_EQ(attrs.ts_gps->tm_min, 2);
+        EXPECT_EQ(attrs.ts_gps->tm_sec, 3);
+    }
+}
+
+// Files without an EXIF segment are left to Exiv2.
+TEST(Attrs, NativeNoExif) {
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "fdt_test_noexif.jpg")
+            .string();
+    std::ofstream(path, std::ios::binary).write("\xFF\xD8\xFF\xD9", 4);
+    EXPECT_THROW(Attrs(path, Backend::NATIVE), std::runtime_error);
+}
+
+// Cached attributes must equal decoded ones and deleted images are pruned.
+TEST(Cache, RoundTripAndPrune) {
+    namespace fs = std::filesystem;
+    const fs::path dir = fs::temp_directory_path() / "fdt_test_exif_cache";
+    const std::string db = (fs::temp_directory_path() / "fdt_test.db").string();
+    fs::remove_all(dir);
+    fs::remove(db);
+    fs::create_directories(dir);
+    const std::string paths[] = {
+        (dir / "le.jpg").string(),
+        (dir / "be.jpg").string(),
+    };
+    fs::rename(write_gopro_jpeg(true, "fdt_test_exif_cache_le.jpg"),
+               paths[0]);
+    fs::rename(write_gopro_jpeg(false, "fdt_test_exif_cache_be.jpg"),
+               paths[1]);
+
+    const ExportOpts opts{.threads = 2, .cache = db};
+    std::ostringstream oss_plain, oss_cold, oss_warm;
+    exportCsv(dir.string(), oss_plain, ExportOpts{.threads = 2});
+    exportCsv(dir.string(), oss_cold, opts);
+    exportCsv(dir.string(), oss_warm, opts);
+    EXPECT_EQ(oss_plain.str(), oss_cold.str());
+    EXPECT_EQ(oss_plain.str(), oss_warm.str());
+
+    {
+        Cache cache(db);
+        cache.Load(dir.string());
+        for (const auto &path : paths) {
+            SCOPED_TRACE(path);
+            const Attrs *hit = cache.Find(path, FileStamp::Of(path));
+            ASSERT_NE(hit, nullptr);
+            expect_attrs_eq(*hit, Attrs(path));
+            EXPECT_EQ(cache.Find(path, FileStamp{}), nullptr);
+        }
+        cache.Commit({paths[0], paths[1]});
+    }
+
+    const FileStamp kStamp = FileStamp::Of(paths[1]);
+    fs::remove(paths[1]);
+    std::ostringstream oss_pruned;
+    exportCsv(dir.string(), oss_pruned, opts);
+    {
+        Cache cache(db);
+        cache.Load(dir.string());
+        EXPECT_NE(cache.Find(paths[0], FileStamp::Of(paths[0])), nullptr);
+        EXPECT_EQ(cache.Find(paths[1], kStamp), nullptr);
+        cache.Commit({paths[0]});
+    }
+    fs::remove_all(dir);
+    fs::remove(db);
+}
+
+// The streamed array must equal dumping the whole array; NDJSON holds one
+// record per line.
+TEST(exif, ExportJsonStream) {
+    namespace fs = std::filesystem;
+    const fs::path dir = fs::temp_directory_path() / "fdt_test_exif_json";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    const std::string paths[] = {
+        (dir / "a.jpg").string(),
+        (dir / "b.jpg").string(),
+        (dir / "c.jpg").string(),
+    };
+    fs::copy_file("tests/img/gps.jpg", paths[0]);
+    fs::rename(write_gopro_jpeg(true, "fdt_test_exif_json_b.jpg"), paths[1]);
+    fs::rename(write_gopro_jpeg(false, "fdt_test_exif_json_c.jpg"), paths[2]);
+
+    nlohmann::json js;
+    for (const auto &path : paths) {
+        js.push_back(Attrs(path).ToJson());
+    }
+    for (const unsigned threads : {1u, 2u}) {
+        std::ostringstream oss;
+        ExportOpts opts;
+        opts.threads = threads;
+        exportJson(dir.string(), oss, opts);
+        EXPECT_EQ(oss.str(), js.dump(4) + "\n");
+
+        std::ostringstream oss_nd;
+        opts.ndjson = true;
+        exportJson(dir.string(), oss_nd, opts);
+        std::istringstream iss(oss_nd.str());
+        std::string line;
+        size_t n = 0;
+        while (std::getline(iss, line)) {
+            ASSERT_LT(n, js.size());
+            EXPECT_EQ(nlohmann::json::parse(line), js[n]);
+            ++n;
+        }
+        EXPECT_EQ(n, js.size());
+    }
+
+    std::ostringstream oss_empty;
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    exportJson(dir.string(), oss_empty);
+    EXPECT_EQ(oss_empty.str(), "[]\n");
+    fs::remove_all(dir);
+}
+
+TEST(exif, ExportCsvFields) {
+    static constexpr char kExpectedCsv[] =
+        "image\tlatitude\tlongitude\tmodel\n"
+        "gps.jpg\t43.467447\t11.885128\tNIKON COOLPIX P6000\n";
+
+    ExportOpts opts;
+    opts.fields = parseFields("path,lat,longitude,model");
+    std::ostringstream oss;
+    exportCsv("tests/img", oss, opts);
+    EXPECT_EQ(oss.str(), kExpectedCsv);
+
+    EXPECT_THROW(parseFields("path,nonsense"), std::runtime_error);
+}
+
+// Rows come out in path order whatever the number of worker threads.
+TEST(exif, ExportCsvThreads) {
+    constexpr int kImages = 40;
+    const auto dir =
+        std::filesystem::temp_directory_path() / "fdt_test_exif_threads";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+
+    // written in reverse so that the directory order is not the path order
+    std::string expected = "image\twidth\n";
+    for (int i = kImages - 1; i >= 0; --i) {
+        char name[16];
+        std::snprintf(name, sizeof(name), "img_%03d.jpg", i);
+        ExifJpeg(i % 2 == 0)
+            .Long(kIfdExif, 0xA002, 1000 + i)
+            .Write((dir.filename() / name).string());
+    }
+    for (int i = 0; i < kImages; ++i) {
+        char row[32];
+        std::snprintf(row, sizeof(row), "img_%03d.jpg\t%d\n", i, 1000 + i);
+        expected += row;
+    }
+
+    for (const unsigned threads : {1u, 3u, 8u}) {
+        ExportOpts opts;
+        opts.threads = threads;
+        opts.fields = parseFields("path,width");
+        std::ostringstream oss;
+        exportCsv(dir.string(), oss, opts);
+        EXPECT_EQ(oss.str(), expected) << threads << " threads";
+    }
+    std::filesystem::remove_all(dir);
+}
+
+// Only the tags needed by the selected fields are decoded.
+TEST(Attrs, Fields) {
+    const auto path = write_gopro_jpeg(true, "fdt_test_exif_fields.jpg");
+    const auto attrs = Attrs(path, Backend::NATIVE, Field::WIDTH);
+    EXPECT_EQ(attrs.width, 5568);
+    EXPECT_FALSE(attrs.height);
+    EXPECT_FALSE(attrs.lat);
+    EXPECT_FALSE(attrs.model);
+    EXPECT_FALSE(attrs.altitude);
+    EXPECT_FALSE(attrs.hyperfocal_dist);
+
+    // derived fields pull in their sources
+    const auto hfd = Attrs(path, Backend::NATIVE, Field::HYPERFOCAL_DIST);
+    EXPECT_DOUBLE_EQ(*hfd.hyperfocal_dist,
+                     *Attrs(path, Backend::NATIVE).hyperfocal_dist);
+
+    const auto js = Attrs(path, Backend::NATIVE, Field::EASTING)
+                        .ToJson(Field::PATH | Field::EASTING);
+    EXPECT_EQ(js.size(), 2);
+    EXPECT_TRUE(js.contains("easting"));
+}
+
+TEST(exif, ExportColumnar) {
+    namespace fs = std::filesystem;
+    const std::string path =
+        (fs::temp_directory_path() / "fdt_test_exif.fdtc").string();
+    exportColumnar("tests/img", path);
+
+    const ColumnarReader reader(path);
+    ASSERT_EQ(reader.Size(), 1);
+    EXPECT_EQ(reader.Dir(0), "tests/img");
+    EXPECT_EQ(reader.Name(0), "gps.jpg");
+    EXPECT_EQ(reader.Column<int32_t>("height")[0], 480);
+    EXPECT_EQ(reader.Column<int32_t>("width")[0], 640);
+    // 2008-10-23T14:27:07Z
+    EXPECT_EQ(reader.Column<int64_t>("timestamp")[0], 1224772027);
+    EXPECT_NEAR(reader.Column<double>("lat")[0], 43.467447, kEps);
+    EXPECT_NEAR(reader.Column<double>("lon")[0], 11.885128, kEps);
+    EXPECT_NEAR(reader.Column<double>("easting")[0], 7395536.307628, kEps);
+    EXPECT_NEAR(reader.Column<double>("northing")[0], 51343528.675131, kEps);
+    EXPECT_DOUBLE_EQ(reader.Column<double>("altitude")[0], 0);
+    EXPECT_THROW(reader.Column<double>("height"), std::runtime_error);
+
+    // a column of another length than the rows is rejected, even when its
+    // byte extent overflows
+    std::vector<char> bytes;
+    {
+        std::ifstream is(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(is), {});
+    }
+    for (const uint64_t count : {uint64_t{0}, uint64_t{1} << 62}) {
+        auto corrupt = bytes;
+        auto *descs = reinterpret_cast<fdtc::ColumnDesc *>(
+            corrupt.data() + sizeof(fdtc::Header));
+        const auto *header =
+            reinterpret_cast<const fdtc::Header *>(corrupt.data());
+        for (size_t c = 0; c < header->n_cols; ++c) {
+            if (std::string(descs[c].name.data()) == "height") {
+                descs[c].count = count;
+            }
+        }
+        const std::string bad_path = path + ".bad";
+        std::ofstream(bad_path, std::ios::binary)
+            .write(corrupt.data(), corrupt.size());
+        EXPECT_THROW(ColumnarReader{bad_path}, std::runtime_error) << count;
+        fs::remove(bad_path);
+    }
+
+    // an empty directory still makes a valid file
+    const fs::path empty = fs::temp_directory_path() / "fdt_test_exif_empty";
+    fs::create_directories(empty);
+    exportColumnar(empty.string(), path);
+    EXPECT_EQ(ColumnarReader(path).Size(), 0);
+    fs::remove(empty);
+
+    std::ofstream(path) << "not a columnar file";
+    EXPECT_THROW(ColumnarReader{path}, std::runtime_error);
+    fs::remove(path);
+}
+
+TEST(exif, Thumbnails) {
+    namespace fs = std::filesystem;
+    const std::vector<uint8_t> kThumb = {0xFF, 0xD8, 0xFF, 0xDB, 0x00,
+                                         0x02, 0xFF, 0xD9, 0x2A};
+    const fs::path dir = fs::temp_directory_path() / "fdt_test_thumbs";
+    const fs::path out = fs::temp_directory_path() / "fdt_test_thumbs_out";
+    fs::remove_all(dir);
+    fs::remove_all(out);
+    fs::create_directories(dir / "sub");
+
+    for (const bool le : {true, false}) {
+        const auto path = ExifJpeg(le)
+                              .Ascii(kIfd0, 0x010F, "GoPro")
+                              .Thumbnail(kThumb)
+                              .Write("fdt_test_thumb.jpg");
+        EXPECT_EQ(readThumb(path), kThumb);
+        fs::rename(path, dir / "sub" / (le ? "le.jpg" : "be.jpg"));
+    }
+    EXPECT_TRUE(readThumb("tests/img/gps.jpg").empty());
+    fs::copy_file("tests/img/gps.jpg", dir / "gps.jpg");
+
+    EXPECT_EQ(exportThumbs(dir.string(), out.string()), 2);
+    std::ifstream is(out / "sub" / "le.jpg", std::ios::binary);
+    const std::vector<uint8_t> kRead{std::istreambuf_iterator<char>(is), {}};
+    EXPECT_EQ(kRead, kThumb);
+    EXPECT_FALSE(fs::exists(out / "gps.jpg"));
+
+    fs::remove_all(dir);
+    fs::remove_all(out);
+}
@@ -1,5 +1,8 @@
 #include "ibox.hpp"
+#include <filesystem>
+#include <fstream>
 #include <gtest/gtest.h>
+#include <sstream>
 
 using namespace fdt::ibox;
 
@@ -12,6 +15,60 @@ TEST(Fault, AndOrOp) {
     EXPECT_EQ(static_cast<int>(fault), 0b0010000000111110);
 }
 
+TEST(Fault, Codec) {
+    static_assert(faultTypeOf("vegetation") == 6);
+    static_assert(faultLevelOf("verypoor") == 3);
+    static_assert(faultOf(0b101, 2) ==
+                  (Fault::BUMP_POOR | Fault::DEPRESSION_POOR));
+
+    for (uint8_t t = 0; t < kNFaultType; ++t) {
+        EXPECT_EQ(faultTypeOf(faultTypeStr(t)), t);
+    }
+    for (uint8_t l = 1; l <= kNFaultLevel; ++l) {
+        EXPECT_EQ(faultLevelOf(faultLevelStr(l)), l);
+    }
+    for (const char *s : {"", "Bump", "crack ", "vegetatio", "depressioN"}) {
+        EXPECT_EQ(faultTypeOf(s), kNFaultType) << s;
+    }
+    for (const char *s : {"", "none", "pair", "fair ", "verygood"}) {
+        EXPECT_EQ(faultLevelOf(s), 0) << s;
+    }
+    EXPECT_EQ(faultTypeStr(kNFaultType), "");
+    EXPECT_EQ(faultLevelStr(kNFaultLevel + 1), "");
+    EXPECT_EQ(faultOf(1 << kNFaultType, 3), Fault::NONE);
+}
+
+// SWAR maximum against a type-by-type loop, over all faults without padding
+TEST(Fault, MaxSwar) {
+    const auto max_loop = [](const uint16_t a, const uint16_t b) {
+        uint16_t res = 0;
+        uint8_t lvl = 0;
+        for (uint8_t t = 0; t < kNFaultType; ++t) {
+            const uint8_t kA = a >> (2 * t) & 0b11;
+            const uint8_t kB = b >> (2 * t) & 0b11;
+            res |= (kA > kB ? kA : kB) << (2 * t);
+            lvl = kA > lvl ? kA : lvl;
+        }
+        return std::make_pair(res, lvl);
+    };
+    std::vector<Fault> faults;
+    for (uint32_t a = 0; a < (1 << 14); ++a) {
+        const Fault kA = static_cast<Fault>(a);
+        EXPECT_EQ(maxSeverity(kA), max_loop(a, 0).second);
+        for (const uint16_t b : {0x0000, 0x1B1B, 0x2D2D, 0x3FFF, 0x0C63}) {
+            ASSERT_EQ(static_cast<uint16_t>(maxFault(kA, Fault(b))),
+                      max_loop(a, b).first);
+        }
+        faults.push_back(kA);
+    }
+    EXPECT_EQ(maxFault(faults), Fault(0x3FFF));
+    EXPECT_EQ(maxSeverity(std::span(faults.data(), 2)), 1);
+    std::vector<uint8_t> levels(faults.size());
+    maxSeverity(faults, levels);
+    EXPECT_EQ(levels[0b10], 2);
+    EXPECT_EQ(levels[0b11 << 12], 3);
+}
+
 TEST(Box, MaxSeverityOp) {
     Box bx;
     bx.fault = Fault::NONE;
@@ -106,6 +163,45 @@ TEST(ImgBox, FromViaCsv) {
     EXPECT_EQ(arr[20], 0);
 }
 
+// Exports of other tools: a UTF-8 BOM, CRLF records, quoted newlines and
+// doubled quotes, and coordinates written as floats
+TEST(ImgBox, FromViaCsvQuirks) {
+    static const std::string str_csv =
+        ("\xEF\xBB\xBF"
+         "filename,file_size,file_attributes,region_count,region_id,region_"
+         "shape_attributes,region_attributes\r\n"
+         "\"G\"\"01\"\".JPG\",1,\"{\"\"note\"\":\"\"a,\r\nb\"\"}\",1,0,"
+         "\"{\"\"name\"\":\"\"rect\"\",\"\"x\"\":12.7,\"\"y\"\":1e2,"
+         "\"\"width\"\":3.5E1,\"\"height\"\":-4}\","
+         "\"{\"\"fault\"\":{\"\"crack\"\":true},\"\"condition\"\":{"
+         "\"\"poor\"\":true}}\"\r\n"
+         "G02.JPG,1,\"{}\",1,0,\"{\"\"x\"\":1,\"\"y\"\":2,\"\"width\"\":3,"
+         "\"\"height\"\":4}\",\"{\"\"fault\"\":{\"\"bump\"\":true},"
+         "\"\"condition\"\":{\"\"fair\"\":true}}\"\r\n");
+
+    std::istringstream istream_csv(str_csv);
+    const auto ibx_arr = from_via_csv(istream_csv);
+    ASSERT_EQ(ibx_arr.size(), 2);
+    EXPECT_EQ(ibx_arr[0].image, "G\"01\".JPG");
+    ASSERT_EQ(ibx_arr[0].boxes.size(), 1);
+    EXPECT_EQ(ibx_arr[0].boxes[0].x, 12);
+    EXPECT_EQ(ibx_arr[0].boxes[0].y, 100);
+    EXPECT_EQ(ibx_arr[0].boxes[0].w, 35);
+    EXPECT_EQ(ibx_arr[0].boxes[0].h, -4);
+    EXPECT_EQ(ibx_arr[0].boxes[0].fault, Fault::CRACK_POOR);
+    EXPECT_EQ(ibx_arr[1].image, "G02.JPG");
+    ASSERT_EQ(ibx_arr[1].boxes.size(), 1);
+    EXPECT_EQ(ibx_arr[1].boxes[0].h, 4);
+    EXPECT_EQ(ibx_arr[1].boxes[0].fault, Fault::BUMP_FAIR);
+
+    // malformed attribute JSON is an error, not an empty region
+    std::istringstream istream_bad(
+        "filename,region_shape_attributes,region_attributes\n"
+        "G01.JPG,\"{\"\"x\"\":1\",\"{\"\"fault\"\":{\"\"crack\"\":true},"
+        "\"\"condition\"\":{\"\"fair\"\":true}}\"\n");
+    EXPECT_THROW(from_via_csv(istream_bad), std::runtime_error);
+}
+
 TEST(ImgBox, FromViaJson) {
     static const std::string str_json =
         ("{\n"
@@ -388,6 +484,55 @@ TEST(ImgBox, FromViaJson) {
     EXPECT_EQ(arr[20], 1);
 }
 
+// Project layouts the SAX handler must follow: file names after the
+// regions, several images, VIA1 regions keyed by index in an object, and
+// invalid documents, which give no boxes
+TEST(ImgBox, FromViaJsonLayouts) {
+    static const std::string str_json = R"({
+        "_via_settings": {"regions": [{"x": 0}]},
+        "_via_img_metadata": {
+            "G02.JPG2": {
+                "regions": [{
+                    "shape_attributes": {"x": 1, "y": 2, "width": 3,
+                                         "height": 4},
+                    "region_attributes": {"fault": {"crack": true},
+                                          "condition": {"poor": true}}}],
+                "filename": "G02.JPG"},
+            "G01.JPG1": {
+                "filename": "G01.JPG",
+                "regions": {
+                    "0": {"shape_attributes": {"x": 5, "y": 6, "width": 7,
+                                               "height": 8},
+                          "region_attributes": {
+                              "fault": {"bump": true},
+                              "condition": {"fair": true}}},
+                    "1": {"shape_attributes": {"x": 9, "y": 6, "width": 7,
+                                               "height": 8},
+                          "region_attributes": {
+                              "fault": {"pothole": true},
+                              "condition": {"verypoor": true}}}}},
+            "G03.JPG3": {"filename": "G03.JPG", "regions": []}}})";
+
+    std::istringstream istream_json(str_json);
+    const auto ibx_arr = from_via_json(istream_json);
+    ASSERT_EQ(ibx_arr.size(), 2);
+    EXPECT_EQ(ibx_arr[0].image, "G01.JPG");
+    ASSERT_EQ(ibx_arr[0].boxes.size(), 2);
+    EXPECT_EQ(ibx_arr[0].boxes[0].x, 5);
+    EXPECT_EQ(ibx_arr[0].boxes[0].fault, Fault::BUMP_FAIR);
+    EXPECT_EQ(ibx_arr[0].boxes[1].x, 9);
+    EXPECT_EQ(ibx_arr[0].boxes[1].fault, Fault::POTHOLE_VPOOR);
+    EXPECT_EQ(ibx_arr[1].image, "G02.JPG");
+    ASSERT_EQ(ibx_arr[1].boxes.size(), 1);
+    EXPECT_EQ(ibx_arr[1].boxes[0].h, 4);
+    EXPECT_EQ(ibx_arr[1].boxes[0].fault, Fault::CRACK_POOR);
+
+    // truncated after a complete image
+    std::istringstream istream_bad(
+        str_json.substr(0, str_json.find("\"G01.JPG1\"")));
+    EXPECT_TRUE(from_via_json(istream_bad).empty());
+}
+
 TEST(ImgBox, FromTsv) {
     static const std::string str_tsv =
         ("prefix\timage\tx\ty\tw\th\tcategory\tscore_cate_top1\tclass_"
@@ -470,3 +615,127 @@ TEST(ImgBox, FromTsv) {
     EXPECT_EQ(arr[19], 0);
     EXPECT_EQ(arr[20], 0);
 }
+
+// Annotations may come before the images and categories they refer to, and
+// nested members of the records are skipped.
+TEST(ImgBox, CocoToTsv) {
+    const auto file =
+        std::filesystem::temp_directory_path() / "fdt_test_coco.json";
+    std::ofstream(file) << R"({
+        "info": {"description": "test", "id": 7},
+        "annotations": [
+            {"id": 1, "image_id": 2, "category_id": 1, "iscrowd": 0,
+             "segmentation": [[1, 2, 3, 4]], "bbox": [10.4, 20.6, 30, 40]},
+            {"id": 2, "image_id": 1, "category_id": 2,
+             "attributes": {"id": 9, "bbox": [0, 0, 0, 0]},
+             "bbox": [1, 2, 3, 4], "score": 0.5},
+            {"id": 3, "image_id": 9, "category_id": 1, "bbox": [1, 1, 1, 1]}
+        ],
+        "categories": [
+            {"id": 1, "name": "crack-poor", "supercategory": "fault"},
+            {"id": 2, "name": "bump"}
+        ],
+        "images": [
+            {"id": 2, "file_name": "r1/G01.JPG", "width": 5568},
+            {"id": 1, "file_name": "G02.JPG"}
+        ]
+    })";
+
+    std::ostringstream oss;
+    cocoToTsv(file.string(), "grp", oss);
+    std::filesystem::remove(file);
+    EXPECT_EQ(oss.str(), "prefix\timage\tcate\tlevel\tx\ty\tw\th\n"
+                         "r1\tG01.JPG\tcrack\tpoor\t10\t21\t30\t40\n"
+                         "grp\tG02.JPG\tbump\t\t1\t2\t3\t4\n");
+}
+
+// Files are parsed concurrently; the boxes of an image are merged across
+// files, in the order of the file paths
+TEST(ImgBox, FromViaDir) {
+    const auto dir = std::filesystem::temp_directory_path() / "fdt_test_via";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir / "sub");
+    const auto csv = [](const int x, const std::string &image) {
+        return image + ",1,\"{}\",1,0,\"{\"\"x\"\":" + std::to_string(x) +
+               ",\"\"y\"\":2,\"\"width\"\":3,\"\"height\"\":4}\","
+               "\"{\"\"fault\"\":{\"\"crack\"\":true},"
+               "\"\"condition\"\":{\"\"fair\"\":true}}\"\n";
+    };
+    const std::string header = "filename,file_size,file_attributes,"
+                               "region_count,region_id,"
+                               "region_shape_attributes,region_attributes\n";
+    std::ofstream(dir / "b.csv") << header << csv(2, "G01.JPG");
+    std::ofstream(dir / "a.csv")
+        << header << csv(1, "G01.JPG") << csv(5, "G02.JPG");
+    std::ofstream(dir / "sub" / "c.json") << R"({"_via_img_metadata": {
+        "G01.JPG1": {"regions": [{
+            "shape_attributes": {"x": 3, "y": 2, "width": 3, "height": 4},
+            "region_attributes": {"fault": {"bump": true},
+                                  "condition": {"poor": true}}}],
+            "filename": "G01.JPG"}}})";
+    std::ofstream(dir / "x.tsv") << "prefix\timage\tcate\tlevel\tx\ty\tw\th\n"
+                                 << "r\tG01.JPG\tcrack\tfair\t6\t2\t3\t4\n";
+    std::ofstream(dir / "sub" / "w.tsv")
+        << "prefix\timage\tcate\tlevel\tx\ty\tw\th\n"
+        << "r\tG01.JPG\tcrack\tfair\t7\t2\t3\t4\n";
+    // an unreadable file is skipped
+    std::filesystem::create_symlink(dir / "none", dir / "z.csv");
+
+    const auto via = fromVia(dir.string());
+    ASSERT_EQ(via.size(), 2);
+    EXPECT_EQ(via[0].image, "G01.JPG");
+    ASSERT_EQ(via[0].boxes.size(), 3);
+    EXPECT_EQ(via[0].boxes[0].x, 1);
+    EXPECT_EQ(via[0].boxes[1].x, 2);
+    EXPECT_EQ(via[0].boxes[2].x, 3);
+    EXPECT_EQ(via[0].boxes[2].fault, Fault::BUMP_POOR);
+    EXPECT_EQ(via[1].boxes.at(0).x, 5);
+
+    const auto tsv = fromTsv(dir.string());
+    std::filesystem::remove_all(dir);
+    ASSERT_EQ(tsv.size(), 1);
+    ASSERT_EQ(tsv[0].boxes.size(), 2);
+    EXPECT_EQ(tsv[0].boxes[0].x, 7); // "sub/w.tsv" < "x.tsv"
+    EXPECT_EQ(tsv[0].boxes[1].x, 6);
+}
+
+TEST(ImgBox, BoxSet) {
+    BoxSet::Part p0, p1;
+    p0.Add("G02.JPG", {1, 0, 1, 1, Fault::CRACK_FAIR});
+    p0.Add("G01.JPG", {2, 0, 1, 1, Fault::BUMP_POOR});
+    p0.Add("G03.JPG", {3, 0, 1, 1, Fault::NONE});
+    p0.Add("G02.JPG", {4, 0, 1, 1, Fault::CRACK_FAIR, 0.5f});
+    p1.Add("G01.JPG", {5, 0, 1, 1, Fault::CRACK_FAIR});
+    std::vector<BoxSet::Part> parts;
+    parts.push_back(std::move(p0));
+    parts.push_back(std::move(p1));
+
+    // images by name, boxes in part order, images without faults dropped
+    BoxSet set(std::move(parts));
+    ASSERT_EQ(set.Size(), 2);
+    EXPECT_EQ(set.NumBoxes(), 4);
+    EXPECT_EQ(set[0].image, "G01.JPG");
+    ASSERT_EQ(set[0].boxes.size(), 2);
+    EXPECT_EQ(set[0].boxes[0].x, 2);
+    EXPECT_EQ(set[0].boxes[1].x, 5);
+    EXPECT_EQ(set[1].image, "G02.JPG");
+    ASSERT_EQ(set[1].boxes.size(), 2);
+    EXPECT_EQ(set[1].boxes[1].score, 0.5f);
+
+    const auto ibx_arr = set.ToImgBoxes();
+    ASSERT_EQ(ibx_arr.size(), 2);
+    EXPECT_EQ(ibx_arr[1].boxes[1].image, "G02.JPG");
+    EXPECT_EQ(ibx_arr[1].boxes[1].x, 4);
+    std::ostringstream tsv_set, tsv_arr;
+    toTsv(set, "r", tsv_set);
+    toTsv(ibx_arr, "r", tsv_arr);
+    EXPECT_EQ(tsv_set.str(), tsv_arr.str());
+
+    // views stay valid when the set is moved
+    BoxSet moved;
+    EXPECT_EQ(moved.Size(), 0);
+    const auto view = set[0];
+    moved = std::move(set);
+    EXPECT_EQ(moved[0].image.data(), view.image.data());
+    EXPECT_EQ(moved[0].boxes.data(), view.boxes.data());
+}
@@ -0,0 +1,147 @@
+#include "ibox.hpp"
+#include <array>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <sstream>
+
+// Benchmarks, run with --gtest_also_run_disabled_tests
+
+// VIA CSV export of `n_rows` records: one in eight without a region, and
+// several fault types or conditions in some regions
+static std::string synthetic_via_csv(const size_t n_rows) {
+    static const std::array<const char *, 7> kTypes = {
+        "bump",    "crack",  "depression", "displacement",
+        "pothole", "uneven", "vegetation"};
+    static const std::array<const char *, 3> kLevels = {"fair", "poor",
+                                                        "verypoor"};
+    std::string csv = "filename,file_size,file_attributes,region_count,"
+                      "region_id,region_shape_attributes,region_attributes\n";
+    uint32_t rnd = 12345;
+    const auto next = [&rnd]() { return rnd = rnd * 1103515245 + 12345; };
+    for (size_t i = 0; i < n_rows; ++i) {
+        const std::string kImage = "G" + std::to_string(1000000 + i / 3);
+        if (next() % 8 == 0) {
+            csv += kImage + ".JPG,3142365,\"{}\",0,0,\"{}\",\"{}\"\n";
+            continue;
+        }
+        csv += kImage + ".JPG,3142365,\"{}\",3," + std::to_string(i % 3) +
+               ",\"{\"\"name\"\":\"\"rect\"\",\"\"x\"\":" +
+               std::to_string(next() % 5000) +
+               ",\"\"y\"\":" + std::to_string(next() % 4000) +
+               ",\"\"width\"\":" + std::to_string(next() % 1000 + 1) +
+               ",\"\"height\"\":" + std::to_string(next() % 1000 + 1) +
+               "}\",\"{\"\"fault\"\":{\"\"" + kTypes[next() % 7] +
+               "\"\":true";
+        if (next() % 4 == 0) {
+            csv += std::string(",\"\"") + kTypes[next() % 7] + "\"\":true";
+        }
+        csv += std::string("},\"\"condition\"\":{\"\"") + kLevels[next() % 3] +
+               "\"\":true";
+        if (next() % 16 == 0) {
+            csv += std::string(",\"\"") + kLevels[next() % 3] + "\"\":true";
+        }
+        csv += "}}\"\n";
+    }
+    return csv;
+}
+
+// The former route: split each line into unescaped cells, parse the
+// attribute cells into JSON documents, then walk them for the boxes
+static std::vector<Box> via_csv_dom(const std::string &csv) {
+    const auto cells = [](const std::string &line) {
+        std::vector<std::string> res(1);
+        bool in_quotes = false;
+        for (size_t i = 0; i < line.size(); ++i) {
+            if (line[i] == '"' && in_quotes && i + 1 < line.size() &&
+                line[i + 1] == '"') {
+                res.back() += line[++i];
+            } else if (line[i] == '"') {
+                in_quotes = !in_quotes;
+            } else if (line[i] == ',' && !in_quotes) {
+                res.emplace_back();
+            } else {
+                res.back() += line[i];
+            }
+        }
+        return res;
+    };
+    static const std::map<std::string, int> kTypes = {
+        {"bump", 0},    {"crack", 1},  {"depression", 2}, {"displacement", 3},
+        {"pothole", 4}, {"uneven", 5}, {"vegetation", 6}};
+    static const std::map<std::string, int> kLevels = {
+        {"fair", 1}, {"poor", 2}, {"verypoor", 3}};
+
+    std::vector<Box> boxes;
+    std::istringstream iss(csv);
+    std::string line;
+    std::getline(iss, line);
+    while (std::getline(iss, line)) {
+        const auto row = cells(line);
+        const auto region = nlohmann::json::parse(row[6]);
+        const auto shape = nlohmann::json::parse(row[5]);
+        if (!region.contains("condition") || !region.contains("fault") ||
+            region["condition"].empty() || region["fault"].empty() ||
+            !kLevels.count(region["condition"].items().begin().key())) {
+            continue;
+        }
+        const int kLevel =
+            kLevels.at(region["condition"].items().begin().key());
+        uint16_t fault = 0;
+        for (const auto &it : region["fault"].items()) {
+            fault |= kTypes.count(it.key())
+                         ? kLevel << (2 * kTypes.at(it.key()))
+                         : 0;
+        }
+        Box bx;
+        bx.image = row[0];
+        bx.x = shape.value("x", -1);
+        bx.y = shape.value("y", -1);
+        bx.w = shape.value("width", -1);
+        bx.h = shape.value("height", -1);
+        bx.fault = static_cast<Fault>(fault);
+        boxes.push_back(bx);
+    }
+    return boxes;
+}
+
+TEST(ImgBox, DISABLED_FromViaCsvBench) {
+    constexpr size_t kRows = 300000;
+    const std::string csv = synthetic_via_csv(kRows);
+    using Clock = std::chrono::steady_clock;
+    const auto ms = [](const Clock::time_point &t0) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - t0)
+            .count();
+    };
+
+    // both grouped by image
+    auto t0 = Clock::now();
+    std::map<std::string, std::vector<Box>> expected;
+    for (auto &bx : via_csv_dom(csv)) {
+        expected[bx.image].push_back(std::move(bx));
+    }
+    const double kMsDom = ms(t0);
+
+    t0 = Clock::now();
+    std::istringstream iss(csv);
+    const auto ibx_arr = from_via_csv(iss);
+    const double kMsDirect = ms(t0);
+
+    std::cout << kRows << " rows, " << csv.size() / (1 << 20)
+              << " MiB: JSON documents " << kMsDom << " ms, in place "
+              << kMsDirect << " ms" << std::endl;
+
+    ASSERT_EQ(ibx_arr.size(), expected.size());
+    for (const auto &ibx : ibx_arr) {
+        const auto &boxes = expected.at(ibx.image);
+        ASSERT_EQ(ibx.boxes.size(), boxes.size());
+        for (size_t i = 0; i < boxes.size(); ++i) {
+            EXPECT_EQ(ibx.boxes[i].x, boxes[i].x);
+            EXPECT_EQ(ibx.boxes[i].y, boxes[i].y);
+            EXPECT_EQ(ibx.boxes[i].w, boxes[i].w);
+            EXPECT_EQ(ibx.boxes[i].h, boxes[i].h);
+            EXPECT_EQ(ibx.boxes[i].fault, boxes[i].fault);
+        }
+    }
+}
@@ -1,7 +1,10 @@
+#include "test_annot.cpp"
 #include "test_crs.cpp"
 #include "test_exif.cpp"
 #include "test_gis.cpp"
 #include "test_ibox.cpp"
+#include "test_ibox_bench.cpp"
+#include "test_utils.cpp"
 
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
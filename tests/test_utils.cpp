@@ -0,0 +1,51 @@
+#include "utils.hpp"
+#include <chrono>
+#include <future>
+#include <gtest/gtest.h>
+
+using fdt::utils::BoundedQueue;
+
+// Items pushed before Close are still popped, then Pop reports the end.
+TEST(BoundedQueue, CloseDrains) {
+    BoundedQueue<int> queue(4);
+    EXPECT_TRUE(queue.Push(1));
+    EXPECT_TRUE(queue.Push(2));
+    EXPECT_TRUE(queue.Push(3));
+    queue.Close();
+    EXPECT_FALSE(queue.Push(4));
+    for (const int expected : {1, 2, 3}) {
+        const auto item = queue.Pop();
+        ASSERT_TRUE(item);
+        EXPECT_EQ(*item, expected);
+    }
+    EXPECT_FALSE(queue.Pop());
+    EXPECT_FALSE(queue.Pop());
+}
+
+// A Push on a full queue waits for a Pop, or fails once the queue is closed.
+TEST(BoundedQueue, BlockedPush) {
+    using namespace std::chrono_literals;
+    BoundedQueue<int> queue(1);
+    ASSERT_TRUE(queue.Push(1));
+    auto pushed = std::async(std::launch::async, [&] { return queue.Push(2); });
+    EXPECT_EQ(pushed.wait_for(50ms), std::future_status::timeout);
+    EXPECT_EQ(queue.Pop(), 1);
+    EXPECT_TRUE(pushed.get());
+    EXPECT_EQ(queue.Pop(), 2);
+
+    ASSERT_TRUE(queue.Push(3));
+    pushed = std::async(std::launch::async, [&] { return queue.Push(4); });
+    EXPECT_EQ(pushed.wait_for(50ms), std::future_status::timeout);
+    queue.Close();
+    EXPECT_FALSE(pushed.get());
+    EXPECT_EQ(queue.Pop(), 3);
+    EXPECT_FALSE(queue.Pop());
+}
+
+// A blocked Pop returns what another thread pushes.
+TEST(BoundedQueue, BlockedPop) {
+    BoundedQueue<int> queue(2);
+    auto popped = std::async(std::launch::async, [&] { return queue.Pop(); });
+    ASSERT_TRUE(queue.Push(7));
+    EXPECT_EQ(popped.get(), 7);
+}